@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "logger.h"
+#include "log_format.h"
+
+/*
+ * The time log_message() takes on the calling thread, with 1 and 4 threads
+ * logging at once into a temporary file. Bursts fit into a thread's ring and
+ * are flushed outside the timed part, so they show the hot path alone; the
+ * sustained run never waits and is bound by how fast the writer drains. Both
+ * a text and a binary handler are measured. Afterwards the file is read back
+ * (decoded first if it is binary) to check that no message was lost and every
+ * thread's messages kept their order.
+ *
+ * The filtered run times DEBUG messages with only an INFO handler, which
+ * return before the ring is touched, and checks that none was written. The
+ * messages are DEBUG, so the bench is built with LOG_LEVEL_FLOOR at 0 to
+ * keep them from being compiled out.
+ */
+const size_t BENCH_MESSAGES		= 200000;
+const size_t BENCH_BURST		= 256;
+const size_t BENCH_THREADS[]	= {1, 4};
+const size_t BENCH_MAX_THREADS	= 4;
+
+struct BenchThread {
+	size_t id;
+	double burst_ms;
+	double sustained_ms;
+};
+
+static void *bench_thread(void *arg);
+static bool check_log(FILE *log, size_t num_threads);
+static bool run_filtered();
+static double now_ms();
+
+int main()
+{
+	for (size_t run = 0; run < 2 * sizeof(BENCH_THREADS) / sizeof(BENCH_THREADS[0]); run++) {
+		size_t num_threads = BENCH_THREADS[run / 2];
+		bool is_binary = run % 2;
+		FILE *log = tmpfile();
+		FILE *text = is_binary ? tmpfile() : log;
+		if (!log || !text)
+			return 1;
+
+		logger_ctor();
+		add_log_handler({log, DEBUG, false, is_binary, 0});
+
+		pthread_t threads[BENCH_MAX_THREADS] = {};
+		struct BenchThread args[BENCH_MAX_THREADS] = {};
+		for (size_t i = 0; i < num_threads; i++) {
+			args[i].id = i;
+			pthread_create(&threads[i], NULL, bench_thread, &args[i]);
+		}
+		double burst_ms = 0;
+		double sustained_ms = 0;
+		for (size_t i = 0; i < num_threads; i++) {
+			pthread_join(threads[i], NULL);
+			if (args[i].burst_ms > burst_ms)
+				burst_ms = args[i].burst_ms;
+			if (args[i].sustained_ms > sustained_ms)
+				sustained_ms = args[i].sustained_ms;
+		}
+
+		logger_dtor();
+
+		if (is_binary) {
+			rewind(log);
+			log_binary_decode(log, text);
+			fclose(log);
+		}
+		bool is_ok = check_log(text, num_threads);
+		fclose(text);
+		printf("%zu thread(s) %s\tburst %8.1f ns/message\tsustained %8.1f ns/message\t%s\n",
+			   num_threads, is_binary ? "binary" : "text  ", burst_ms * 1e6 / (double) BENCH_MESSAGES,
+			   sustained_ms * 1e6 / (double) BENCH_MESSAGES, is_ok ? "ok" : "LOST MESSAGES");
+		if (!is_ok)
+			return 1;
+	}
+
+	if (!run_filtered())
+		return 1;
+	return 0;
+}
+
+static bool run_filtered()
+{
+	FILE *log = tmpfile();
+	if (!log)
+		return false;
+
+	logger_ctor();
+	add_log_handler({log, INFO, false, false, 0});
+	double start = now_ms();
+	for (size_t i = 0; i < BENCH_MESSAGES; i++)
+		log_message(DEBUG, "thread %zu message %zu\n", (size_t) 0, i);
+	double filtered_ms = now_ms() - start;
+	logger_dtor();
+
+	bool is_ok = true;
+	char line[128] = "";
+	rewind(log);
+	while (fgets(line, sizeof(line), log))
+		if (strncmp(line, "[DEBUG]", strlen("[DEBUG]")) == 0)
+			is_ok = false;
+	fclose(log);
+
+	printf("1 thread(s) filtered\tcall  %8.1f ns/message\t%s\n",
+		   filtered_ms * 1e6 / (double) BENCH_MESSAGES, is_ok ? "ok" : "WRITTEN");
+	return is_ok;
+}
+
+static void *bench_thread(void *arg)
+{
+	struct BenchThread *self = (struct BenchThread*) arg;
+
+	size_t num = 0;
+	self->burst_ms = 0;
+	while (num < BENCH_MESSAGES) {
+		double start = now_ms();
+		for (size_t i = 0; i < BENCH_BURST && num < BENCH_MESSAGES; i++, num++)
+			log_message(DEBUG, "thread %zu message %zu\n", self->id, num);
+		self->burst_ms += now_ms() - start;
+		log_flush();
+	}
+
+	double start = now_ms();
+	for (size_t i = 0; i < BENCH_MESSAGES; i++, num++)
+		log_message(DEBUG, "thread %zu message %zu\n", self->id, num);
+	self->sustained_ms = now_ms() - start;
+
+	return NULL;
+}
+
+static bool check_log(FILE *log, size_t num_threads)
+{
+	size_t next[BENCH_MAX_THREADS] = {};
+	char line[128] = "";
+
+	rewind(log);
+	while (fgets(line, sizeof(line), log)) {
+		size_t id = 0, num = 0;
+		if (sscanf(line, "[DEBUG] thread %zu message %zu", &id, &num) != 2)
+			continue;
+		if (id >= num_threads || num != next[id])
+			return false;
+		next[id]++;
+	}
+
+	for (size_t i = 0; i < num_threads; i++)
+		if (next[i] != 2 * BENCH_MESSAGES)
+			return false;
+	return true;
+}
+
+static double now_ms()
+{
+	struct timespec ts = {};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec * 1e3 + (double) ts.tv_nsec / 1e6;
+}
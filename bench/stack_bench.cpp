@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "stack.h"
+#include "logger.h"
+
+/*
+ * Push/pop throughput of struct Stack at the protection level it was compiled
+ * with. Every round fills a stack to the given depth and empties it again, so
+ * the expensive levels pay for the capacity on every operation. Rounds repeat
+ * until BENCH_MIN_MS have passed, since the levels differ by orders of magnitude.
+ */
+const double BENCH_MIN_MS	= 300;
+const size_t BENCH_DEPTHS[] = {16, 256, 4096};
+
+static const char *level_name(int level);
+static double now_ms();
+static void print_int(char *buf, stk_elem_t data, size_t n);
+
+int main()
+{
+	// failed validation aborts, the report itself is not needed here
+	logger_ctor();
+
+	for (size_t d = 0; d < sizeof(BENCH_DEPTHS) / sizeof(BENCH_DEPTHS[0]); d++) {
+		size_t depth = BENCH_DEPTHS[d];
+		size_t rounds = 0;
+		long long checksum = 0;
+
+		struct Stack stk = {};
+		if (STACK_CTOR(&stk, print_int) < 0) {
+			logger_dtor();
+			return 1;
+		}
+
+		double start = now_ms();
+		double elapsed = 0;
+		while (elapsed < BENCH_MIN_MS) {
+			for (size_t i = 0; i < depth; i++)
+				stack_push(&stk, (stk_elem_t) i);
+			stk_elem_t val = 0;
+			while (stack_pop(&stk, &val) == STACK_NO_ERR)
+				checksum += val;
+			rounds++;
+			elapsed = now_ms() - start;
+		}
+		stack_dtor(&stk);
+
+		double ops = (double) (2 * rounds * depth);
+		printf("level %d (%s)\tdepth %4zu\t%8.2f Mops/s\t(checksum %lld)\n",
+			   STACK_PROTECTION_LEVEL, level_name(STACK_PROTECTION_LEVEL), depth,
+			   ops / elapsed / 1e3, checksum);
+	}
+
+	logger_dtor();
+	return 0;
+}
+
+static const char *level_name(int level)
+{
+	switch (level) {
+		case STACK_PROTECT_OFF:
+			return "off";
+		case STACK_PROTECT_CANARY:
+			return "canary";
+		case STACK_PROTECT_SAMPLED:
+			return "sampled";
+		case STACK_PROTECT_FULL:
+			return "full";
+		default:
+			return "unknown";
+	}
+}
+
+static double now_ms()
+{
+	struct timespec ts = {};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec * 1e3 + (double) ts.tv_nsec / 1e6;
+}
+
+static void print_int(char *buf, stk_elem_t data, size_t n)
+{
+	snprintf(buf, n, "%d", data);
+}
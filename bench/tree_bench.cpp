@@ -0,0 +1,457 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "tree.h"
+#include "tree_io.h"
+#include "buffer.h"
+#include "name_index.h"
+#include "path.h"
+#include "batch.h"
+#include "akinator.h"
+#include "small_stack.h"
+#include "mem.h"
+
+/*
+ * Times the database operations on synthetic trees of three shapes: a balanced
+ * one, one grown by splitting random leaves (what guess() builds when objects
+ * come in a random order) and a right spine where every "yes" is an object.
+ * For each shape and size the tree is saved into a temporary file, read back
+ * with buffer_load_from_file() and tree_load_from_buf(), indexed, queried and
+ * deleted. Whole-tree operations report their time and throughput, queries on
+ * random objects report percentiles of their latencies: describe and compare
+ * are answered by batch_describe() and batch_compare(), and a game is played
+ * with guess_next() by a player who answers along the object's path.
+ * Everything goes to stdout as one JSON object, a case at a time.
+ *
+ * The queries run with mem_assert_no_alloc() on, so a describe or compare
+ * that allocates aborts the bench; from the first size on, the spine is
+ * deeper than the inline answers of a path.
+ *
+ * The file indents every level, so a spine's file grows quadratically; a case
+ * whose file would exceed BENCH_MAX_FILE is reported as skipped. The peak RSS
+ * is the process' maximum so far, which the largest case sets since the sizes
+ * grow.
+ */
+const size_t BENCH_SIZES[]		= {1000, 10000, 100000, 1000000, 10000000};
+const size_t BENCH_QUERIES		= 10000;
+const size_t BENCH_MAX_FILE		= 2ull << 30;
+const size_t BENCH_NAME_LEN		= 24;
+const size_t BENCH_INDENT		= 4;
+const uint64_t BENCH_SEED		= 0x9E3779B97F4A7C15ull;
+
+enum BenchShape {
+	SHAPE_BALANCED,
+	SHAPE_RANDOM,
+	SHAPE_SPINE,
+	NUM_SHAPES,
+};
+
+const char *const SHAPE_NAMES[NUM_SHAPES] = {"balanced", "random", "spine"};
+
+struct BenchTree {
+	struct Node *root;
+	// "q<i>" for questions and "o<i>" for objects, BENCH_NAME_LEN bytes each
+	char *names;
+	size_t num_objects;
+	size_t num_nodes;
+};
+
+struct SizeFrame {
+	const struct Node *node;
+	size_t depth;
+};
+
+struct Latencies {
+	double *ns;
+	size_t count;
+	double total_ns;
+};
+
+static bool gen_tree(struct BenchTree *tree, enum BenchShape shape, size_t num_objects);
+static bool gen_balanced(struct BenchTree *tree);
+static bool gen_random(struct BenchTree *tree, uint64_t *rand_state);
+static bool gen_spine(struct BenchTree *tree);
+static const char *name_of(struct BenchTree *tree, char kind, size_t id);
+static bool saved_size(const struct Node *tree, size_t *size, size_t *depth);
+static bool run_case(enum BenchShape shape, size_t num_nodes, size_t num_queries, bool is_first);
+static bool run_queries(const struct BenchTree *tree, const struct NameIndex *idx,
+						size_t num_queries, struct Latencies lat[3]);
+static const struct Node *play_game(const struct Node *root, const struct Path *path);
+static void print_op(const char *name, double ms, size_t num_nodes, size_t file_size);
+static void print_latencies(const char *name, struct Latencies *lat);
+static int cmp_double(const void *a, const void *b);
+static uint64_t rand_next(uint64_t *state);
+static double now_ns();
+
+int main(int argc, char *argv[])
+{
+	size_t max_nodes = BENCH_SIZES[sizeof(BENCH_SIZES) / sizeof(BENCH_SIZES[0]) - 1];
+	size_t num_queries = BENCH_QUERIES;
+	if (argc > 1)
+		max_nodes = strtoull(argv[1], NULL, 10);
+	if (argc > 2)
+		num_queries = strtoull(argv[2], NULL, 10);
+	if (num_queries == 0) {
+		fprintf(stderr, "Usage: %s [max nodes] [queries per case]\n", argv[0]);
+		return 1;
+	}
+
+	mem_assert_no_alloc(true);
+	printf("{\n\t\"max_nodes\": %zu,\n\t\"queries\": %zu,\n\t\"cases\": [", max_nodes,
+		   num_queries);
+	bool is_first = true;
+	for (size_t i = 0; i < sizeof(BENCH_SIZES) / sizeof(BENCH_SIZES[0]); i++) {
+		if (BENCH_SIZES[i] > max_nodes)
+			break;
+		for (size_t shape = 0; shape < NUM_SHAPES; shape++) {
+			if (!run_case((enum BenchShape) shape, BENCH_SIZES[i], num_queries, is_first))
+				return 1;
+			is_first = false;
+		}
+	}
+	printf("\n\t]\n}\n");
+
+	return 0;
+}
+
+static bool run_case(enum BenchShape shape, size_t num_nodes, size_t num_queries, bool is_first)
+{
+	struct BenchTree tree = {};
+	struct Buffer buf = {};
+	struct NameIndex idx = {};
+	struct Latencies lat[3] = {};
+	struct Node *loaded = NULL;
+	bool is_ok = false;
+	size_t file_size = 0;
+	size_t depth = 0;
+	double start = 0;
+	char file_name[] = "/tmp/tree_bench-XXXXXX";
+	int fd = -1;
+	FILE *file = NULL;
+
+	printf("%s\n\t\t{\"shape\": \"%s\", ", is_first ? "" : ",", SHAPE_NAMES[shape]);
+	if (!gen_tree(&tree, shape, (num_nodes + 1) / 2) ||
+		!saved_size(tree.root, &file_size, &depth))
+		goto finally;
+	printf("\"nodes\": %zu, \"objects\": %zu, \"depth\": %zu, \"file_bytes\": %zu",
+		   tree.num_nodes, tree.num_objects, depth, file_size);
+	if (file_size > BENCH_MAX_FILE) {
+		printf(", \"skipped\": \"the file is larger than %zu bytes\"}", BENCH_MAX_FILE);
+		is_ok = true;
+		goto finally;
+	}
+
+	fd = mkstemp(file_name);
+	if (fd < 0 || !(file = fdopen(fd, "w")))
+		goto finally;
+	start = now_ns();
+	if (tree_save(tree.root, file) < 0 || fflush(file) != 0)
+		goto finally;
+	print_op("tree_save", (now_ns() - start) / 1e6, tree.num_nodes, file_size);
+	fclose(file);
+	file = NULL;
+	node_op_delete(tree.root);
+	tree.root = NULL;
+
+	start = now_ns();
+	if (buffer_load_from_file(&buf, file_name) < 0)
+		goto finally;
+	print_op("buffer_load_from_file", (now_ns() - start) / 1e6, tree.num_nodes, file_size);
+
+	start = now_ns();
+	if (tree_load_from_buf(&loaded, &buf) < 0)
+		goto finally;
+	print_op("tree_load_from_buf", (now_ns() - start) / 1e6, tree.num_nodes, file_size);
+
+	start = now_ns();
+	if (name_index_ctor(&idx, loaded) < 0)
+		goto finally;
+	print_op("name_index_ctor", (now_ns() - start) / 1e6, tree.num_nodes, 0);
+
+	if (!run_queries(&tree, &idx, num_queries, lat))
+		goto finally;
+	print_latencies("describe", &lat[0]);
+	print_latencies("compare", &lat[1]);
+	print_latencies("guess", &lat[2]);
+
+	name_index_dtor(&idx);
+	start = now_ns();
+	node_op_delete(loaded);
+	loaded = NULL;
+	print_op("node_op_delete", (now_ns() - start) / 1e6, tree.num_nodes, 0);
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	printf(", \"peak_rss_kb\": %ld}", usage.ru_maxrss);
+	fflush(stdout);
+	is_ok = true;
+
+finally:
+	if (!is_ok)
+		fprintf(stderr, "The %s case with %zu nodes failed\n", SHAPE_NAMES[shape], num_nodes);
+	for (size_t i = 0; i < 3; i++)
+		free(lat[i].ns);
+	name_index_dtor(&idx);
+	node_op_delete(loaded);
+	node_op_delete(tree.root);
+	free(tree.names);
+	buffer_dtor(&buf);
+	if (file)
+		fclose(file);
+	else if (fd >= 0)
+		close(fd);
+	if (fd >= 0)
+		unlink(file_name);
+	return is_ok;
+}
+
+static bool run_queries(const struct BenchTree *tree, const struct NameIndex *idx,
+						size_t num_queries, struct Latencies lat[3])
+{
+	struct Path path1 = {};
+	struct Path path2 = {};
+	struct Buffer out = {};
+	uint64_t rand_state = BENCH_SEED;
+	bool is_ok = buffer_ctor(&out) == BUF_NO_ERR;
+	path_ctor(&path1);
+	path_ctor(&path2);
+
+	for (size_t i = 0; i < 3 && is_ok; i++) {
+		lat[i].ns = (double*) calloc(num_queries, sizeof(double));
+		is_ok = lat[i].ns;
+	}
+
+	for (size_t i = 0; i < num_queries && is_ok; i++) {
+		char name1[BENCH_NAME_LEN] = "";
+		char name2[BENCH_NAME_LEN] = "";
+		snprintf(name1, BENCH_NAME_LEN, "o%zu", rand_next(&rand_state) % tree->num_objects);
+		snprintf(name2, BENCH_NAME_LEN, "o%zu", rand_next(&rand_state) % tree->num_objects);
+
+		buffer_reset(&out);
+		double start = now_ns();
+		is_ok = batch_describe(&out, idx, &path1, name1) == BUF_NO_ERR;
+		double end = now_ns();
+		lat[0].ns[lat[0].count++] = end - start;
+
+		buffer_reset(&out);
+		start = now_ns();
+		is_ok = is_ok && batch_compare(&out, idx, &path1, &path2, name1, name2) == BUF_NO_ERR;
+		end = now_ns();
+		lat[1].ns[lat[1].count++] = end - start;
+
+		// the player's answers are the object's path, found outside the timed part
+		is_ok = is_ok && path_from_entry(&path1, idx, name_index_lookup(idx, name1)) == PATH_NO_ERR;
+		start = now_ns();
+		const struct Node *guessed = play_game(idx->root, &path1);
+		end = now_ns();
+		lat[2].ns[lat[2].count++] = end - start;
+		is_ok = is_ok && guessed && strcmp(guessed->data, name1) == 0;
+	}
+
+	path_dtor(&path1);
+	path_dtor(&path2);
+	buffer_dtor(&out);
+	return is_ok;
+}
+
+// the player answers the questions by the path and confirms the guess at its end
+static const struct Node *play_game(const struct Node *root, const struct Path *path)
+{
+	const struct Node *node = root;
+	for (size_t depth = 0; depth <= path->len; depth++) {
+		bool is_yes = depth == path->len || !path_answer(path, depth);
+		switch (guess_next(node, is_yes)) {
+			case GUESS_GO_YES:
+				node = node->left;
+				break;
+			case GUESS_GO_NO:
+				node = node->right;
+				break;
+			case GUESS_WON:
+				return node;
+			case GUESS_LOST:
+			default:
+				return NULL;
+		}
+	}
+	return NULL;
+}
+
+static bool gen_tree(struct BenchTree *tree, enum BenchShape shape, size_t num_objects)
+{
+	tree->num_objects = num_objects;
+	tree->num_nodes = 2 * num_objects - 1;
+	tree->names = (char*) calloc(tree->num_nodes, BENCH_NAME_LEN);
+	if (!tree->names)
+		return false;
+
+	uint64_t rand_state = BENCH_SEED;
+	switch (shape) {
+		case SHAPE_BALANCED:
+			return gen_balanced(tree);
+		case SHAPE_RANDOM:
+			return gen_random(tree, &rand_state);
+		case SHAPE_SPINE:
+			return gen_spine(tree);
+		case NUM_SHAPES:
+		default:
+			return false;
+	}
+}
+
+// a complete tree in heap order: node i asks a question iff i < num_objects - 1
+static bool gen_balanced(struct BenchTree *tree)
+{
+	struct Node **nodes = (struct Node**) calloc(tree->num_nodes, sizeof(struct Node*));
+	if (!nodes)
+		return false;
+
+	size_t num_questions = tree->num_objects - 1;
+	for (size_t i = 0; i < tree->num_nodes; i++) {
+		const char *name = i < num_questions ? name_of(tree, 'q', i) :
+											   name_of(tree, 'o', i - num_questions);
+		if (node_op_new(&nodes[i], name) < 0) {
+			for (size_t j = 0; j < i; j++)
+				free(nodes[j]);
+			free(nodes);
+			return false;
+		}
+	}
+	for (size_t i = 0; i < num_questions; i++) {
+		nodes[i]->left = nodes[2 * i + 1];
+		nodes[i]->right = nodes[2 * i + 2];
+	}
+
+	tree->root = nodes[0];
+	free(nodes);
+	return true;
+}
+
+// every new object splits a random one: the question goes in its place, the
+// new object becomes its "yes" and the old one its "no"
+static bool gen_random(struct BenchTree *tree, uint64_t *rand_state)
+{
+	struct Node **leaves = (struct Node**) calloc(tree->num_objects, sizeof(struct Node*));
+	if (!leaves || node_op_new(&tree->root, name_of(tree, 'o', 0)) < 0) {
+		free(leaves);
+		return false;
+	}
+	leaves[0] = tree->root;
+
+	for (size_t i = 1; i < tree->num_objects; i++) {
+		size_t split = rand_next(rand_state) % i;
+		struct Node *leaf = leaves[split];
+		if (node_op_new(&leaf->left, name_of(tree, 'o', i)) < 0 ||
+			node_op_new(&leaf->right, leaf->data) < 0) {
+			free(leaves);
+			return false;
+		}
+		leaf->data = name_of(tree, 'q', i - 1);
+		leaves[split] = leaf->right;
+		leaves[i] = leaf->left;
+	}
+
+	free(leaves);
+	return true;
+}
+
+static bool gen_spine(struct BenchTree *tree)
+{
+	struct Node **slot = &tree->root;
+	for (size_t i = 0; i + 1 < tree->num_objects; i++) {
+		if (node_op_new(slot, name_of(tree, 'q', i)) < 0 ||
+			node_op_new(&(*slot)->left, name_of(tree, 'o', i)) < 0)
+			return false;
+		slot = &(*slot)->right;
+	}
+	return node_op_new(slot, name_of(tree, 'o', tree->num_objects - 1)) == TREE_NO_ERR;
+}
+
+// questions take the first num_objects - 1 names, objects the rest
+static const char *name_of(struct BenchTree *tree, char kind, size_t id)
+{
+	size_t slot = kind == 'q' ? id : tree->num_objects - 1 + id;
+	char *name = tree->names + slot * BENCH_NAME_LEN;
+	snprintf(name, BENCH_NAME_LEN, "%c%zu", kind, id);
+	return name;
+}
+
+// the number of bytes tree_save() writes, and the depth of the tree
+static bool saved_size(const struct Node *tree, size_t *size, size_t *depth)
+{
+	SmallStack<struct SizeFrame, TRIO_INIT_DEPTH> stack = {};
+	small_stack_ctor(&stack);
+	small_stack_push(&stack, {tree, 0});
+
+	*size = 0;
+	*depth = 0;
+	struct SizeFrame frame = {};
+	while (small_stack_pop(&stack, &frame) == STACK_NO_ERR) {
+		size_t indent = BENCH_INDENT * frame.depth;
+		if (!frame.node) {
+			*size += indent + strlen("nil\n");
+			continue;
+		}
+		if (frame.depth > *depth)
+			*depth = frame.depth;
+		*size += 2 * indent + strlen("(<") + strlen(frame.node->data) + strlen(">\n)\n");
+		if (small_stack_push(&stack, {frame.node->right, frame.depth + 1}) < 0 ||
+			small_stack_push(&stack, {frame.node->left, frame.depth + 1}) < 0) {
+			small_stack_dtor(&stack);
+			return false;
+		}
+	}
+
+	small_stack_dtor(&stack);
+	return true;
+}
+
+static void print_op(const char *name, double ms, size_t num_nodes, size_t file_size)
+{
+	printf(",\n\t\t \"%s\": {\"ms\": %.3f, \"nodes_per_s\": %.0f", name, ms,
+		   (double) num_nodes / ms * 1e3);
+	if (file_size)
+		printf(", \"mb_per_s\": %.1f", (double) file_size / ms / 1e3);
+	printf("}");
+}
+
+static void print_latencies(const char *name, struct Latencies *lat)
+{
+	qsort(lat->ns, lat->count, sizeof(double), cmp_double);
+	lat->total_ns = 0;
+	for (size_t i = 0; i < lat->count; i++)
+		lat->total_ns += lat->ns[i];
+
+	printf(",\n\t\t \"%s\": {\"count\": %zu, \"ops_per_s\": %.0f, \"p50_ns\": %.0f, "
+		   "\"p90_ns\": %.0f, \"p99_ns\": %.0f, \"max_ns\": %.0f}", name, lat->count,
+		   (double) lat->count / lat->total_ns * 1e9, lat->ns[lat->count / 2],
+		   lat->ns[lat->count * 9 / 10], lat->ns[lat->count * 99 / 100], lat->ns[lat->count - 1]);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double*) a;
+	double y = *(const double*) b;
+	return (x > y) - (x < y);
+}
+
+// xorshift64*
+static uint64_t rand_next(uint64_t *state)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 2685821657736338717ull;
+}
+
+static double now_ns()
+{
+	struct timespec ts = {};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec * 1e9 + (double) ts.tv_nsec;
+}
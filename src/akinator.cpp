@@ -5,290 +5,262 @@
 #include <stdarg.h>
 #include <ctype.h>
 
-#include "stack.h"
-#include "stack_debug.h"
 #include "akinator.h"
+#include "path.h"
 #include "logger.h"
+#include "metrics.h"
+#include "mem.h"
 
-static struct AkError make_definition_stack(const struct Node *tr,
-											const char *elem, struct Stack *stk);
+static const struct Node *print_path(const struct Node *node, const struct Path *path,
+									 size_t begin, size_t end, struct Speech *speech);
+static struct AkError find_elem(const struct NameIndex *idx, const char *name,
+								struct Speech *speech, const struct NameEntry **elem);
 static void cut_after_newline(char *str, size_t n);
-static void print_int(char *buf, int data, size_t n);
-static void ak_output(bool do_speek, const char *fmt, ...);
+static void ak_output(struct Speech *speech, const char *fmt, ...);
+static void stop_speaking(struct Speech *speech);
 static char *skip_space(char *str);
 
-struct AkError guess(struct Node **tr, struct Buffer *buf, bool do_speak)
+struct AkError guess(struct Node **tr, struct Buffer *buf, struct Speech *speech)
 {
 	struct Node *cur_node = *tr;
+	// when the last answer was read, to time how long the next prompt takes
+	uint64_t answered = 0;
 
 	while (true) {
 		char ans[ANSWER_BUF_SIZE] = {};
+		metrics_stop(METRIC_GUESS_STEP, answered);
 		if (!cur_node->left && !cur_node->right)
-			ak_output(do_speak, "Это же %s! Да?\n", cur_node->data);
+			ak_output(speech, "Это же %s! Да?\n", cur_node->data);
 		else
-			ak_output(do_speak, "Оно %s?\n", cur_node->data);
+			ak_output(speech, "Оно %s?\n", cur_node->data);
 
 		char *read = fgets(ans, ANSWER_BUF_SIZE, stdin);
 		if (!read)
 			return compose_err(AK_ANS_READ_ERR, "");
+		stop_speaking(speech);
+		answered = metrics_start();
 
-		struct Node *new_node = cur_node;
+		enum GuessStep step = GUESS_LOST;
 		if (strcmp(ans, "да\n") == 0) {
-			new_node = cur_node->left;
-			if (!new_node) {
-				ak_output(do_speak, "Ура я угадал!\n");
-				return compose_err(AK_NO_ERR, "");
-			}
-		}
-		else if (strcmp(ans, "нет\n") == 0) {
-			new_node = cur_node->right;
+			step = guess_next(cur_node, true);
+		} else if (strcmp(ans, "нет\n") == 0) {
+			step = guess_next(cur_node, false);
 		} else {
-			ak_output(do_speak, "Неправильный ответ! Попробуйте снова.\n");
+			metrics_stop(METRIC_GUESS_STEP, answered);
+			answered = 0;
+			ak_output(speech, "Неправильный ответ! Попробуйте снова.\n");
+			continue;
 		}
 
-		if (!new_node) {
-			ak_output(do_speak, "Хз кто это. Кто это?\n");
-
-			if (buffer_size(buf) >= buf->cap)
-				return compose_err(AK_BUFFER_ERR, "");
-			read = fgets(buf->pos, (int) (buf->cap - buffer_size(buf)), stdin);
-			if (!read)
-				return compose_err(AK_ANS_READ_ERR, "");
-			buf->pos = skip_space(buf->pos);
-			cut_after_newline(buf->pos, ANSWER_BUF_SIZE);
-
-			enum TreeError tr_err = node_op_new(&cur_node->left, buf->pos);
-			if (tr_err < 0)
-				return compose_err(AK_TREE_ERR, tree_err_to_str(tr_err));
-			tr_err = node_op_new(&cur_node->right, cur_node->data);
-			if (tr_err < 0)
-				return compose_err(AK_TREE_ERR, tree_err_to_str(tr_err));
-
-			buf->pos += strlen(buf->pos) + 1;
-
-			if (buffer_size(buf) >= buf->cap)
-				return compose_err(AK_BUFFER_ERR, "");
-			ak_output(do_speak, "Как он отличается от %s?\n", cur_node->data);
-			read = fgets(buf->pos, (int) (buf->cap - buffer_size(buf)), stdin);
-			if (!read)
-				return compose_err(AK_ANS_READ_ERR, "");
-			buf->pos = skip_space(buf->pos);
-			cut_after_newline(buf->pos, ANSWER_BUF_SIZE);
-
-			cur_node->data = buf->pos;
-			buf->pos += strlen(buf->pos) + 1;
-			return compose_err(AK_NO_ERR, "");
-		} else {
-			cur_node = new_node;
+		switch (step) {
+			case GUESS_GO_YES:
+				cur_node = cur_node->left;
+				continue;
+			case GUESS_GO_NO:
+				cur_node = cur_node->right;
+				continue;
+			case GUESS_WON:
+				metrics_stop(METRIC_GUESS_STEP, answered);
+				ak_output(speech, "Ура я угадал!\n");
+				return compose_err(AK_NO_ERR, "");
+			case GUESS_LOST:
+			default:
+				break;
 		}
+
+		metrics_stop(METRIC_GUESS_STEP, answered);
+		ak_output(speech, "Хз кто это. Кто это?\n");
+
+		if (buffer_size(buf) >= buf->cap)
+			return compose_err(AK_BUFFER_ERR, "");
+		read = fgets(buf->pos, (int) (buf->cap - buffer_size(buf)), stdin);
+		if (!read)
+			return compose_err(AK_ANS_READ_ERR, "");
+		stop_speaking(speech);
+		buf->pos = skip_space(buf->pos);
+		cut_after_newline(buf->pos, ANSWER_BUF_SIZE);
+
+		enum TreeError tr_err = node_op_new(&cur_node->left, buf->pos);
+		if (tr_err < 0)
+			return compose_err(AK_TREE_ERR, tree_err_to_str(tr_err));
+		tr_err = node_op_new(&cur_node->right, cur_node->data);
+		if (tr_err < 0)
+			return compose_err(AK_TREE_ERR, tree_err_to_str(tr_err));
+
+		buf->pos += strlen(buf->pos) + 1;
+
+		if (buffer_size(buf) >= buf->cap)
+			return compose_err(AK_BUFFER_ERR, "");
+		ak_output(speech, "Как он отличается от %s?\n", cur_node->data);
+		read = fgets(buf->pos, (int) (buf->cap - buffer_size(buf)), stdin);
+		if (!read)
+			return compose_err(AK_ANS_READ_ERR, "");
+		stop_speaking(speech);
+		buf->pos = skip_space(buf->pos);
+		cut_after_newline(buf->pos, ANSWER_BUF_SIZE);
+
+		cur_node->data = buf->pos;
+		buf->pos += strlen(buf->pos) + 1;
+		return compose_err(AK_NO_ERR, "");
 	}
 	return compose_err(AK_NO_ERR, "");
 }
 
-// descr def
-static struct AkError make_definition_stack(const struct Node *tr, 
-											const char *elem, struct Stack *stk)
+// one step of a game: where an answer at node leads
+enum GuessStep guess_next(const struct Node *node, bool is_yes)
 {
-	assert(elem);
-	assert(stk);
+	assert(node);
 
-	enum StackError stk_err = STACK_NO_ERR;
-	struct AkError err = compose_err(AK_NO_ERR, "");
-	if (!tr)
-		return compose_err(AK_ELEM_NOT_FOUND_ERR, elem);
+	if (is_yes)
+		return node->left ? GUESS_GO_YES : GUESS_WON;
+	return node->right ? GUESS_GO_NO : GUESS_LOST;
+}
 
-	if (strcmp(tr->data, elem) == 0)
-		return err;
+static const struct Node *print_path(const struct Node *node, const struct Path *path,
+									 size_t begin, size_t end, struct Speech *speech)
+{
+	assert(node);
+	assert(path);
 
-	err = make_definition_stack(tr->left, elem, stk);
-	if (err.code == AK_NO_ERR) {
-		stk_err = stack_push(stk, 0);
-		if (stk_err < 0)
-			return compose_err(AK_STACK_ERR, stack_err_to_str(stk_err));
-		return err;
+	for (size_t depth = begin; depth < end; depth++) {
+		if (path_answer(path, depth)) {
+			ak_output(speech, "-Не %s\n", node->data);
+			node = node->right;
+		} else {
+			ak_output(speech, "-%s\n", node->data);
+			node = node->left;
+		}
 	}
-	if (err.code != AK_ELEM_NOT_FOUND_ERR)
-		return err;
+	return node;
+}
+
+static struct AkError find_elem(const struct NameIndex *idx, const char *name,
+								struct Speech *speech, const struct NameEntry **elem)
+{
+	assert(idx);
+	assert(name);
+	assert(elem);
 
-	err = make_definition_stack(tr->right, elem, stk);
-	if (err.code == AK_NO_ERR) {
-		stk_err = stack_push(stk, 1);
-		if (stk_err < 0)
-			return compose_err(AK_STACK_ERR, stack_err_to_str(stk_err));
+	// a lookup must not allocate, the suggestions for a miss may
+	mem_no_alloc_begin();
+	*elem = name_index_lookup(idx, name);
+	mem_no_alloc_end();
+	if (*elem)
 		return compose_err(AK_NO_ERR, "");
-	}
 
-	return err;
+	struct NameMatch matches[NAME_SUGGESTIONS] = {};
+	size_t found = name_index_suggest(idx, name, matches, NAME_SUGGESTIONS);
+	if (found > 0) {
+		ak_output(speech, "Не знаю никого по имени %s. Может быть, ты имел в виду:\n",
+				  name);
+		for (size_t i = 0; i < found; i++)
+			ak_output(speech, "-%s\n", matches[i].node->data);
+	}
+	return compose_err(AK_ELEM_NOT_FOUND_ERR, name);
 }
 
-struct AkError describe(const struct Node *tr, bool do_speak)
+struct AkError describe(const struct Node *tr, const struct NameIndex *idx,
+						struct Speech *speech)
 {
 	char ans_buf[ANSWER_BUF_SIZE] = {};
-	ak_output(do_speak, "Кого хочешь описать?\n");
+	ak_output(speech, "Кого хочешь описать?\n");
 	char *read = fgets(ans_buf, ANSWER_BUF_SIZE, stdin);
 	if (!read)
 		return compose_err(AK_ANS_READ_ERR, "");
 	cut_after_newline(ans_buf, ANSWER_BUF_SIZE);
-	ak_output(do_speak, "Окей! %s:\n", ans_buf);
-
-	struct Stack stk = {};
-	enum StackError stk_err = STACK_CTOR(&stk, print_int);
-	if (stk_err < 0) {
-		stack_dtor(&stk);
-		return compose_err(AK_STACK_ERR, stack_err_to_str(stk_err));
-	}
+	uint64_t start = metrics_start();
 
-	struct AkError err = make_definition_stack(tr, ans_buf, &stk);
-	if (err.code < 0) {
-		stack_dtor(&stk);
+	const struct NameEntry *elem = NULL;
+	struct AkError err = find_elem(idx, ans_buf, speech, &elem);
+	if (err.code < 0)
 		return err;
+	ak_output(speech, "Окей! %s:\n", elem->node->data);
+
+	struct Path path = {};
+	path_ctor(&path);
+	// sized before the lookup of the path, which must not allocate
+	enum PathError path_err = path_reserve(&path, idx->max_depth);
+	if (path_err == PATH_NO_ERR) {
+		mem_no_alloc_begin();
+		path_err = path_from_entry(&path, idx, elem);
+		mem_no_alloc_end();
 	}
-
-	const struct Node *cur_node = tr;
-	int val = 0;
-	stk_err = stack_pop(&stk, &val);
-	if (stk_err < 0) {
-		stack_dtor(&stk);
-		return compose_err(AK_STACK_ERR, stack_err_to_str(stk_err));
+	if (path_err < 0) {
+		path_dtor(&path);
+		return compose_err(AK_PATH_ERR, path_err_to_str(path_err));
 	}
-	while (stk_err >= 0) {
-		if (val) {
-			ak_output(do_speak, "-Не %s\n", cur_node->data);
-			cur_node = cur_node->right;
-		} else {
-			ak_output(do_speak, "-%s\n", cur_node->data);
-			cur_node = cur_node->left;
-		}
-		stk_err = stack_pop(&stk, &val);
-	}
-	if (stk_err != ERR_STACK_EMPTY && stk_err < 0) {
-		stack_dtor(&stk);
-		return compose_err(AK_STACK_ERR, stack_err_to_str(stk_err));
-	}
-	stack_dtor(&stk);
 
+	print_path(tr, &path, 0, path.len, speech);
+	path_dtor(&path);
+
+	metrics_stop(METRIC_DESCRIBE, start);
 	return compose_err(AK_NO_ERR, "");
 }
 
-struct AkError compare(const struct Node *tr, bool do_speak)
+struct AkError compare(const struct Node *tr, const struct NameIndex *idx,
+					   struct Speech *speech)
 {
 	char ans1_buf[ANSWER_BUF_SIZE] = {};
 	char ans2_buf[ANSWER_BUF_SIZE] = {};
 
-	ak_output(do_speak, "Кого хочешь сравнить?\n");
+	ak_output(speech, "Кого хочешь сравнить?\n");
 	char *read = fgets(ans1_buf, ANSWER_BUF_SIZE, stdin);
 	if (!read)
 		return compose_err(AK_NO_ERR, "");
 	cut_after_newline(ans1_buf, ANSWER_BUF_SIZE);
 
-	ak_output(do_speak, "И с кем?\n");
+	ak_output(speech, "И с кем?\n");
 	read = fgets(ans2_buf, ANSWER_BUF_SIZE, stdin);
 	if (!read)
 		return compose_err(AK_NO_ERR, "");
 	cut_after_newline(ans2_buf, ANSWER_BUF_SIZE);
+	uint64_t start = metrics_start();
 
-	struct Stack stk1 = {};
-	struct Stack stk2 = {};
-	enum StackError stk_err = STACK_CTOR(&stk1, print_int);
-	if (stk_err < 0) {
-		stack_dtor(&stk1);
-		return compose_err(AK_STACK_ERR, stack_err_to_str(stk_err));
-	}
-	stk_err = STACK_CTOR(&stk2, print_int);
-	if (stk_err < 0) {
-		stack_dtor(&stk1);
-		stack_dtor(&stk2);
-		return compose_err(AK_STACK_ERR, stack_err_to_str(stk_err));
-	}
-
-	struct AkError err = make_definition_stack(tr, ans1_buf, &stk1);
-	if (err.code < 0) {
-		stack_dtor(&stk1);
-		stack_dtor(&stk2);
+	const struct NameEntry *elem1 = NULL;
+	const struct NameEntry *elem2 = NULL;
+	struct AkError err = find_elem(idx, ans1_buf, speech, &elem1);
+	if (err.code < 0)
 		return err;
-	}
-	err = make_definition_stack(tr, ans2_buf, &stk2);
-	if (err.code < 0) {
-		stack_dtor(&stk1);
-		stack_dtor(&stk2);
+	err = find_elem(idx, ans2_buf, speech, &elem2);
+	if (err.code < 0)
 		return err;
+	const char *name1 = elem1->node->data;
+	const char *name2 = elem2->node->data;
+
+	struct Path path1 = {};
+	struct Path path2 = {};
+	path_ctor(&path1);
+	path_ctor(&path2);
+	enum PathError path_err = path_reserve(&path1, idx->max_depth);
+	if (path_err == PATH_NO_ERR)
+		path_err = path_reserve(&path2, idx->max_depth);
+	if (path_err == PATH_NO_ERR) {
+		mem_no_alloc_begin();
+		path_err = path_from_entry(&path1, idx, elem1);
+		if (path_err == PATH_NO_ERR)
+			path_err = path_from_entry(&path2, idx, elem2);
+		mem_no_alloc_end();
 	}
-
-	ak_output(do_speak, "И %s, и %s:\n", ans1_buf, ans2_buf);
-	const struct Node *cur_node = tr;
-	int val1 = 0;
-	int val2 = 0;
-	enum StackError stk_err1 = STACK_NO_ERR;
-	enum StackError stk_err2 = STACK_NO_ERR;
-	while (true) {
-		stk_err1 = stack_pop(&stk1, &val1);
-		if (stk_err1 < 0)
-			break;
-		stk_err2 = stack_pop(&stk2, &val2);
-		if (stk_err2 < 0)
-			break;
-		if (val1 != val2)
-			break;
-		if (val1) {
-			ak_output(do_speak, "-Не %s\n", cur_node->data);
-			cur_node = cur_node->right;
-		} else {
-			ak_output(do_speak, "-%s\n", cur_node->data);
-			cur_node = cur_node->left;
-		}
+	if (path_err < 0) {
+		path_dtor(&path1);
+		path_dtor(&path2);
+		return compose_err(AK_PATH_ERR, path_err_to_str(path_err));
 	}
 
-	if (stk_err1 < 0 && stk_err1 != ERR_STACK_EMPTY) {
-		stack_dtor(&stk1);
-		stack_dtor(&stk2);
-		return compose_err(AK_STACK_ERR, stack_err_to_str(stk_err1));
-	}
-	if (stk_err2 < 0 && stk_err2 != ERR_STACK_EMPTY) {
-		stack_dtor(&stk1);
-		stack_dtor(&stk2);
-		return compose_err(AK_STACK_ERR, stack_err_to_str(stk_err2));
-	}
+	size_t common = path_common_prefix(&path1, &path2);
 
-	ak_output(do_speak, "Помимо этого, %s:\n", ans1_buf);
-	const struct Node *cur_node1 = cur_node; // func
-	while (stk_err1 >= 0) {
-		if (val1) {
-			ak_output(do_speak, "-Не %s\n", cur_node1->data);
-			cur_node1 = cur_node1->right;
-		} else {
-			ak_output(do_speak, "-%s\n", cur_node1->data);
-			cur_node1 = cur_node1->left;
-		}
-		stk_err1 = stack_pop(&stk1, &val1);
-	}
+	ak_output(speech, "И %s, и %s:\n", name1, name2);
+	const struct Node *cur_node = print_path(tr, &path1, 0, common, speech);
 
-	if (stk_err1 < 0 && stk_err1 != ERR_STACK_EMPTY) {
-		stack_dtor(&stk1);
-		stack_dtor(&stk2);
-		return compose_err(AK_STACK_ERR, stack_err_to_str(stk_err1));
-	}
+	ak_output(speech, "Помимо этого, %s:\n", name1);
+	print_path(cur_node, &path1, common, path1.len, speech);
 
-	ak_output(do_speak,  "Помимо этого, %s:\n", ans2_buf);
-	const struct Node *cur_node2 = cur_node;
-	while (stk_err2 >= 0) {
-		if (val2) {
-			ak_output(do_speak, "-Не %s\n", cur_node2->data);
-			cur_node2 = cur_node2->right;
-		} else {
-			ak_output(do_speak, "-%s\n", cur_node2->data);
-			cur_node2 = cur_node2->left;
-		}
-		stk_err2 = stack_pop(&stk2, &val2);
-	}
+	ak_output(speech,  "Помимо этого, %s:\n", name2);
+	print_path(cur_node, &path2, common, path2.len, speech);
 
-	if (stk_err2 < 0 && stk_err2 != ERR_STACK_EMPTY) {
-		stack_dtor(&stk1);
-		stack_dtor(&stk2);
-		return compose_err(AK_STACK_ERR, stack_err_to_str(stk_err1));
-	}
-
-	stack_dtor(&stk1);
-	stack_dtor(&stk2);
+	path_dtor(&path1);
+	path_dtor(&path2);
+	metrics_stop(METRIC_COMPARE, start);
 	return compose_err(AK_NO_ERR, "");
 }
 
@@ -302,15 +274,11 @@ static void cut_after_newline(char *str, size_t n)
 	}
 }
 
-static void print_int(char *buf, int data, size_t n)
-{
-	snprintf(buf, n, "%d", data);
-}
-
 struct AkError compose_err(enum AkErrorCode code, const char *context)
 {
 	struct AkError err = {code, ""};
-	strncpy(err.context, context, ERR_CONTEXT_SIZE);
+	// the context is zeroed, so a long one stays terminated
+	strncpy(err.context, context, ERR_CONTEXT_SIZE - 1);
 	return err;
 }
 
@@ -324,8 +292,8 @@ void ak_err_to_str(char *str, struct AkError err, size_t n)
 		case AK_ANS_READ_ERR:
 			strncpy(str, "Error reading the answer", n);
 			return;
-		case AK_STACK_ERR:
-			strncpy(str, "Error in the stack: ", n);
+		case AK_PATH_ERR:
+			strncpy(str, "Error building the path: ", n);
 			strncat(str, err.context, n - strlen(str));
 			return;
 		case AK_TREE_ERR:
@@ -344,7 +312,7 @@ void ak_err_to_str(char *str, struct AkError err, size_t n)
 	}
 }
 
-static void ak_output(bool do_speek, const char *fmt, ...)
+static void ak_output(struct Speech *speech, const char *fmt, ...)
 {
 	assert(fmt);
 
@@ -353,16 +321,23 @@ static void ak_output(bool do_speek, const char *fmt, ...)
 
 	char buf[OUTPUT_BUF_SIZE] = "";
 	vsnprintf(buf, OUTPUT_BUF_SIZE, fmt, args);
+	va_end(args);
 	fputs(buf, stdout);
 
-	if (do_speek) {
-		char cmd[2 * OUTPUT_BUF_SIZE] = "echo \"";
-		strncat(cmd, buf, 2 * OUTPUT_BUF_SIZE - strlen(cmd));
-		strncat(cmd, "\" | festival --tts", 2 * OUTPUT_BUF_SIZE - strlen(cmd));
-		system(cmd);
+	if (speech) {
+		enum SpeechError err = speech_say(speech, buf);
+		if (err < 0)
+			log_message(WARN, "Couldn't speak: %s\n", speech_err_to_str(err));
 	}
 }
 
+// once the player has answered, the rest of the prompt is stale
+static void stop_speaking(struct Speech *speech)
+{
+	if (speech)
+		speech_cancel(speech);
+}
+
 static char *skip_space(char *str)
 {
 	assert(str);
@@ -1,10 +1,12 @@
 #include "tree.h"
 #include "buffer.h"
+#include "name_index.h"
+#include "speech.h"
 
 enum AkErrorCode {
 	AK_ELEM_NOT_FOUND_ERR = -5,
 	AK_ANS_READ_ERR = -4,
-	AK_STACK_ERR = -3,
+	AK_PATH_ERR = -3,
 	AK_TREE_ERR = -2,
 	AK_BUFFER_ERR = -1,
 	AK_NO_ERR = 0,
@@ -21,8 +23,19 @@ struct AkError {
 };
 
 
-struct AkError describe(const struct Node *tr, bool do_speak);
-struct AkError compare(const struct Node *tr, bool do_speak);
-struct AkError guess(struct Node **tr, struct Buffer *buf, bool do_speak);
+// what an answer leads to: the next question, the guess being right, or a new object
+enum GuessStep {
+	GUESS_GO_YES,
+	GUESS_GO_NO,
+	GUESS_WON,
+	GUESS_LOST,
+};
+
+struct AkError describe(const struct Node *tr, const struct NameIndex *idx,
+						struct Speech *speech);
+struct AkError compare(const struct Node *tr, const struct NameIndex *idx,
+					   struct Speech *speech);
+struct AkError guess(struct Node **tr, struct Buffer *buf, struct Speech *speech);
+enum GuessStep guess_next(const struct Node *node, bool is_yes);
 struct AkError compose_err(enum AkErrorCode code, const char *context);
 void ak_err_to_str(char *str, struct AkError err, size_t n);
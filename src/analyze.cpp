@@ -0,0 +1,298 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#include "analyze.h"
+#include "small_stack.h"
+#include "mem.h"
+
+// a node still to be visited, with the spine that ends at its parent
+struct AnalyzeFrame {
+	const struct Node *node;
+	size_t depth;
+	size_t spine;
+	const struct Node *spine_start;
+};
+
+static bool is_leaf(const struct Node *node);
+static bool count_depth(struct TreeStats *stats, size_t depth, bool is_leaf_node);
+static bool add_name(struct AnalyzeNames *names, const char *text, size_t *len);
+static bool grow_names(struct AnalyzeNames *names);
+static uint64_t hash_text(const char *text, size_t *len);
+static void print_histogram(const struct TreeStats *stats, FILE *out);
+static void print_duplicates(const struct AnalyzeNames *names, const char *kind, FILE *out);
+
+enum AnalyzeError tree_analyze(const struct Node *tree, struct TreeStats *stats)
+{
+	assert(stats);
+
+	memset(stats, 0, sizeof(struct TreeStats));
+	if (!tree)
+		return ANALYZE_NO_ERR;
+
+	enum AnalyzeError err = ANALYZE_NO_ERR;
+	SmallStack<struct AnalyzeFrame, ANALYZE_INIT_DEPTH> stack = {};
+	small_stack_ctor(&stack);
+	small_stack_push(&stack, {tree, 0, 0, NULL});
+
+	struct AnalyzeFrame frame = {};
+	while (err == ANALYZE_NO_ERR && small_stack_pop(&stack, &frame) == STACK_NO_ERR) {
+		const struct Node *node = frame.node;
+		bool is_leaf_node = is_leaf(node);
+		size_t len = 0;
+		if (!count_depth(stats, frame.depth, is_leaf_node) ||
+			!add_name(is_leaf_node ? &stats->leaf_names : &stats->questions, node->data, &len)) {
+			err = ANALYZE_NO_MEM_ERR;
+			continue;
+		}
+		stats->num_nodes++;
+		stats->text_bytes += len + 1;
+		if (is_leaf_node) {
+			stats->num_leaves++;
+			stats->total_leaf_depth += frame.depth;
+			continue;
+		}
+		stats->num_questions++;
+
+		size_t spine = 0;
+		const struct Node *spine_start = NULL;
+		if ((node->left && is_leaf(node->left)) || (node->right && is_leaf(node->right))) {
+			spine = frame.spine + 1;
+			spine_start = frame.spine ? frame.spine_start : node;
+			if (spine > stats->longest_spine) {
+				stats->longest_spine = spine;
+				stats->spine_start = spine_start;
+			}
+		}
+
+		if ((node->right && small_stack_push(&stack, {node->right, frame.depth + 1, spine,
+													  spine_start}) < 0) ||
+			(node->left && small_stack_push(&stack, {node->left, frame.depth + 1, spine,
+													 spine_start}) < 0))
+			err = ANALYZE_NO_MEM_ERR;
+	}
+
+	small_stack_dtor(&stack);
+	if (err < 0)
+		tree_stats_dtor(stats);
+	return err;
+}
+
+static bool is_leaf(const struct Node *node)
+{
+	return !node->left && !node->right;
+}
+
+static bool count_depth(struct TreeStats *stats, size_t depth, bool is_leaf_node)
+{
+	assert(stats);
+
+	if (depth >= stats->depth_cap) {
+		size_t new_cap = stats->depth_cap ? 2 * stats->depth_cap : ANALYZE_INIT_DEPTH;
+		size_t *nodes_at = (size_t*) realloc(stats->nodes_at, new_cap * sizeof(size_t));
+		if (!nodes_at)
+			return false;
+		stats->nodes_at = nodes_at;
+		size_t *leaves_at = (size_t*) realloc(stats->leaves_at, new_cap * sizeof(size_t));
+		if (!leaves_at)
+			return false;
+		stats->leaves_at = leaves_at;
+
+		memset(stats->nodes_at + stats->depth_cap, 0,
+			   (new_cap - stats->depth_cap) * sizeof(size_t));
+		memset(stats->leaves_at + stats->depth_cap, 0,
+			   (new_cap - stats->depth_cap) * sizeof(size_t));
+		stats->depth_cap = new_cap;
+	}
+
+	stats->nodes_at[depth]++;
+	if (is_leaf_node)
+		stats->leaves_at[depth]++;
+	if (depth > stats->max_depth)
+		stats->max_depth = depth;
+	return true;
+}
+
+// counts the text and stores its length to len
+static bool add_name(struct AnalyzeNames *names, const char *text, size_t *len)
+{
+	assert(names);
+	assert(text);
+	assert(len);
+
+	// keep the table at most half full
+	if (2 * (names->num_names + 1) > names->cap && !grow_names(names))
+		return false;
+
+	uint64_t hash = hash_text(text, len);
+	size_t slot = hash & (names->cap - 1);
+	while (names->slots[slot].text) {
+		struct AnalyzeName *name = &names->slots[slot];
+		if (name->hash == hash && strcmp(name->text, text) == 0) {
+			if (++name->count == 2)
+				names->num_duplicates++;
+			return true;
+		}
+		slot = (slot + 1) & (names->cap - 1);
+	}
+
+	names->slots[slot] = {text, hash, 1};
+	names->num_names++;
+	return true;
+}
+
+static bool grow_names(struct AnalyzeNames *names)
+{
+	assert(names);
+
+	size_t new_cap = names->cap ? 2 * names->cap : ANALYZE_INIT_NAMES;
+	struct AnalyzeName *slots = (struct AnalyzeName*) calloc(new_cap,
+															 sizeof(struct AnalyzeName));
+	if (!slots)
+		return false;
+
+	for (size_t i = 0; i < names->cap; i++) {
+		if (!names->slots[i].text)
+			continue;
+		size_t slot = names->slots[i].hash & (new_cap - 1);
+		while (slots[slot].text)
+			slot = (slot + 1) & (new_cap - 1);
+		slots[slot] = names->slots[i];
+	}
+
+	free(names->slots);
+	names->slots = slots;
+	names->cap = new_cap;
+	return true;
+}
+
+static uint64_t hash_text(const char *text, size_t *len)
+{
+	assert(text);
+	assert(len);
+
+	uint64_t hash = 14695981039346656037ull;
+	const char *iter = text;
+	for (; *iter; iter++) {
+		hash ^= (unsigned char) *iter;
+		hash *= 1099511628211ull;
+	}
+	*len = (size_t) (iter - text);
+	return hash;
+}
+
+void tree_stats_dtor(struct TreeStats *stats)
+{
+	assert(stats);
+
+	free(stats->nodes_at);
+	free(stats->leaves_at);
+	free(stats->leaf_names.slots);
+	free(stats->questions.slots);
+	memset(stats, 0, sizeof(struct TreeStats));
+}
+
+void tree_stats_print(const struct TreeStats *stats, FILE *out)
+{
+	assert(stats);
+	assert(out);
+
+	double mean_depth = stats->num_leaves ?
+						(double) stats->total_leaf_depth / (double) stats->num_leaves : 0;
+	double weighted_depth = 0;
+	double total_weight = 0;
+	for (size_t depth = 0; stats->leaves_at && depth <= stats->max_depth; depth++) {
+		double weight = (double) stats->leaves_at[depth] * ldexp(1.0, -(int) depth);
+		weighted_depth += weight * (double) depth;
+		total_weight += weight;
+	}
+	if (total_weight > 0)
+		weighted_depth /= total_weight;
+
+	fprintf(out, "nodes\t%zu\nleaves\t%zu\nquestions\t%zu\nmax_depth\t%zu\n"
+			"mean_leaf_depth\t%.2f\nweighted_leaf_depth\t%.2f\nlongest_spine\t%zu\n",
+			stats->num_nodes, stats->num_leaves, stats->num_questions, stats->max_depth,
+			mean_depth, weighted_depth, stats->longest_spine);
+	if (stats->spine_start)
+		fprintf(out, "spine_start\t%s\n", stats->spine_start->data);
+	fprintf(out, "duplicate_leaf_names\t%zu\nduplicate_questions\t%zu\n"
+			"node_bytes\t%zu\ntext_bytes\t%zu\ntext_buffer_bytes\t%zu\n",
+			stats->leaf_names.num_duplicates, stats->questions.num_duplicates,
+			stats->num_nodes * sizeof(struct Node), stats->text_bytes,
+			mem_counter(MEM_TEXT).cur_bytes);
+
+	print_histogram(stats, out);
+	if (stats->leaf_names.num_duplicates || stats->questions.num_duplicates) {
+		fputs("\nkind\tcount\ttext\n", out);
+		print_duplicates(&stats->leaf_names, "leaf", out);
+		print_duplicates(&stats->questions, "question", out);
+	}
+}
+
+// at most ANALYZE_HIST_ROWS rows, so deep trees get ranges of equal width
+static void print_histogram(const struct TreeStats *stats, FILE *out)
+{
+	assert(stats);
+	assert(out);
+
+	if (!stats->nodes_at)
+		return;
+
+	size_t num_depths = stats->max_depth + 1;
+	size_t width = (num_depths + ANALYZE_HIST_ROWS - 1) / ANALYZE_HIST_ROWS;
+	fputs("\ndepth\tnodes\tleaves\n", out);
+	for (size_t from = 0; from < num_depths; from += width) {
+		size_t to = from + width < num_depths ? from + width : num_depths;
+		size_t nodes = 0;
+		size_t leaves = 0;
+		for (size_t depth = from; depth < to; depth++) {
+			nodes += stats->nodes_at[depth];
+			leaves += stats->leaves_at[depth];
+		}
+		if (width == 1)
+			fprintf(out, "%zu\t%zu\t%zu\n", from, nodes, leaves);
+		else
+			fprintf(out, "%zu-%zu\t%zu\t%zu\n", from, to - 1, nodes, leaves);
+	}
+}
+
+// the ANALYZE_MAX_LISTED most repeated texts, most repeated first
+static void print_duplicates(const struct AnalyzeNames *names, const char *kind, FILE *out)
+{
+	assert(names);
+	assert(kind);
+	assert(out);
+
+	const struct AnalyzeName *top[ANALYZE_MAX_LISTED] = {};
+	size_t num_top = 0;
+	for (size_t i = 0; i < names->cap; i++) {
+		const struct AnalyzeName *name = &names->slots[i];
+		if (!name->text || name->count < 2)
+			continue;
+		if (num_top == ANALYZE_MAX_LISTED && name->count <= top[num_top - 1]->count)
+			continue;
+
+		size_t pos = num_top < ANALYZE_MAX_LISTED ? num_top++ : num_top - 1;
+		while (pos > 0 && top[pos - 1]->count < name->count) {
+			top[pos] = top[pos - 1];
+			pos--;
+		}
+		top[pos] = name;
+	}
+
+	for (size_t i = 0; i < num_top; i++)
+		fprintf(out, "%s\t%zu\t%s\n", kind, top[i]->count, top[i]->text);
+}
+
+const char *analyze_err_to_str(enum AnalyzeError err)
+{
+	switch (err) {
+		case ANALYZE_NO_MEM_ERR:
+			return "Not enough memory to analyze the tree";
+		case ANALYZE_NO_ERR:
+			return "No error occured";
+		default:
+			return "An unknown error occured";
+	}
+}
@@ -0,0 +1,69 @@
+#ifndef _ANALYZE_H
+#define _ANALYZE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "tree.h"
+
+/*
+ * Shape statistics of a tree, gathered in one iterative pre-order walk, for
+ * deciding when the tree needs rebalancing. Next to the counts and the depth
+ * histogram it reports the weighted mean leaf depth, the expected number of
+ * questions when every answer is yes or no with equal chance (a leaf at depth d
+ * is reached with probability 2^-d), and the longest spine: the longest chain
+ * of questions each of which has an object as one of its answers, where the
+ * guesser is reduced to asking about objects one by one. Objects and questions
+ * with the same text are found with a hash table of texts each.
+ */
+struct AnalyzeName {
+	const char *text;
+	uint64_t hash;
+	size_t count;
+};
+
+struct AnalyzeNames {
+	struct AnalyzeName *slots;
+	size_t cap;
+	size_t num_names;
+	// texts seen more than once
+	size_t num_duplicates;
+};
+
+struct TreeStats {
+	size_t num_nodes;
+	size_t num_leaves;
+	size_t num_questions;
+
+	// nodes_at[d] nodes and leaves_at[d] leaves are d answers deep, d <= max_depth
+	size_t *nodes_at;
+	size_t *leaves_at;
+	size_t depth_cap;
+	size_t max_depth;
+	size_t total_leaf_depth;
+
+	size_t longest_spine;
+	const struct Node *spine_start;
+
+	struct AnalyzeNames leaf_names;
+	struct AnalyzeNames questions;
+
+	size_t text_bytes;
+};
+
+enum AnalyzeError {
+	ANALYZE_NO_MEM_ERR	= -1,
+	ANALYZE_NO_ERR		= 0,
+};
+
+const size_t ANALYZE_INIT_DEPTH		= 64;
+const size_t ANALYZE_INIT_NAMES		= 1024;
+const size_t ANALYZE_HIST_ROWS		= 64;
+const size_t ANALYZE_MAX_LISTED		= 20;
+
+enum AnalyzeError tree_analyze(const struct Node *tree, struct TreeStats *stats);
+void tree_stats_dtor(struct TreeStats *stats);
+void tree_stats_print(const struct TreeStats *stats, FILE *out);
+const char *analyze_err_to_str(enum AnalyzeError err);
+
+#endif /*_ANALYZE_H*/
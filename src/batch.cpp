@@ -0,0 +1,406 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "batch.h"
+#include "thread_pool.h"
+#include "path.h"
+#include "trace.h"
+#include "metrics.h"
+#include "mem.h"
+
+enum BatchSlotState {
+	SLOT_FREE,
+	SLOT_QUEUED,
+	SLOT_DONE,
+};
+
+struct BatchRun;
+
+struct BatchSlot {
+	struct BatchRun *run;
+	struct Buffer in;
+	size_t num_lines;
+	struct Buffer out;
+	struct Path path1;
+	struct Path path2;
+	enum BufferError err;
+	enum BatchSlotState state;
+};
+
+struct BatchRun {
+	const struct NameIndex *idx;
+	struct BatchSlot *slots;
+	size_t num_slots;
+	pthread_mutex_t lock;
+	pthread_cond_t slot_done;
+};
+
+static void batch_task(void *arg);
+static enum BufferError run_query(struct BatchSlot *slot, char *line);
+static enum BufferError print_not_found(struct Buffer *out, const struct NameIndex *idx,
+									   const char *name);
+static enum BufferError print_steps(struct Buffer *out, const struct Node **node,
+									const struct Path *path, size_t begin, size_t end);
+static size_t read_chunk(struct BatchSlot *slot, FILE *input, char **line,
+						 size_t *line_cap, enum BufferError *err);
+static enum BatchError write_slot(struct BatchSlot *slot, FILE *out);
+
+enum BatchError batch_run_queries(const struct NameIndex *idx, const char *queries_filename,
+								  FILE *out, size_t num_threads)
+{
+	assert(idx);
+	assert(queries_filename);
+	assert(out);
+	assert(num_threads > 0);
+
+	enum BatchError err = BATCH_NO_ERR;
+	enum BufferError buf_err = BUF_NO_ERR;
+	struct ThreadPool pool = {};
+	struct BatchRun run = {};
+	char *line = NULL;
+	size_t line_cap = 0;
+	size_t next_read = 0;
+	size_t next_write = 0;
+	bool is_eof = false;
+
+	FILE *input = fopen(queries_filename, "r");
+	if (!input)
+		return BATCH_FILE_ERR;
+
+	run.idx = idx;
+	run.num_slots = BATCH_SLOTS_PER_THREAD * num_threads;
+	run.slots = (struct BatchSlot*) calloc(run.num_slots, sizeof(struct BatchSlot));
+	if (!run.slots) {
+		fclose(input);
+		return BATCH_NO_MEM_ERR;
+	}
+	pthread_mutex_init(&run.lock, NULL);
+	pthread_cond_init(&run.slot_done, NULL);
+
+	for (size_t i = 0; i < run.num_slots; i++) {
+		run.slots[i].run = &run;
+		run.slots[i].state = SLOT_FREE;
+		path_ctor(&run.slots[i].path1);
+		path_ctor(&run.slots[i].path2);
+		// sized for the deepest object, so that no query of the run allocates a path
+		if (path_reserve(&run.slots[i].path1, idx->max_depth) < 0 ||
+			path_reserve(&run.slots[i].path2, idx->max_depth) < 0 ||
+			buffer_ctor(&run.slots[i].in) < 0 || buffer_ctor(&run.slots[i].out) < 0) {
+			err = BATCH_NO_MEM_ERR;
+			goto finally;
+		}
+	}
+
+	if (pool_ctor(&pool, num_threads) < 0) {
+		err = BATCH_THREAD_ERR;
+		goto finally;
+	}
+
+	while (!is_eof || next_write < next_read) {
+		struct BatchSlot *head = &run.slots[next_write % run.num_slots];
+		bool can_read = !is_eof && next_read - next_write < run.num_slots;
+
+		pthread_mutex_lock(&run.lock);
+		while (!can_read && head->state != SLOT_DONE)
+			pthread_cond_wait(&run.slot_done, &run.lock);
+		bool head_done = next_write < next_read && head->state == SLOT_DONE;
+		pthread_mutex_unlock(&run.lock);
+
+		if (head_done) {
+			err = write_slot(head, out);
+			if (err < 0)
+				break;
+			next_write++;
+			continue;
+		}
+
+		struct BatchSlot *slot = &run.slots[next_read % run.num_slots];
+		size_t num_lines = read_chunk(slot, input, &line, &line_cap, &buf_err);
+		if (buf_err < 0) {
+			err = BATCH_NO_MEM_ERR;
+			break;
+		}
+		if (num_lines < BATCH_CHUNK_LINES)
+			is_eof = true;
+		if (num_lines == 0)
+			continue;
+
+		slot->state = SLOT_QUEUED;
+		if (pool_submit(&pool, batch_task, slot) < 0) {
+			err = BATCH_NO_MEM_ERR;
+			break;
+		}
+		next_read++;
+	}
+	if (err == BATCH_NO_ERR && ferror(input))
+		err = BATCH_FILE_ERR;
+
+	finally:
+		// queued chunks still point into the slots
+		if (pool.threads)
+			pool_dtor(&pool);
+		for (size_t i = 0; i < run.num_slots; i++) {
+			buffer_dtor(&run.slots[i].in);
+			buffer_dtor(&run.slots[i].out);
+			path_dtor(&run.slots[i].path1);
+			path_dtor(&run.slots[i].path2);
+		}
+		free(run.slots);
+		free(line);
+		pthread_mutex_destroy(&run.lock);
+		pthread_cond_destroy(&run.slot_done);
+		fclose(input);
+
+	return err;
+}
+
+static size_t read_chunk(struct BatchSlot *slot, FILE *input, char **line,
+						 size_t *line_cap, enum BufferError *err)
+{
+	assert(slot);
+	assert(input);
+	assert(line);
+	assert(line_cap);
+	assert(err);
+
+	buffer_reset(&slot->in);
+	slot->num_lines = 0;
+	while (slot->num_lines < BATCH_CHUNK_LINES) {
+		ssize_t len = getline(line, line_cap, input);
+		if (len < 0)
+			break;
+		while (len > 0 && ((*line)[len - 1] == '\n' || (*line)[len - 1] == '\r'))
+			(*line)[--len] = '\0';
+
+		// lines are kept NUL-separated, so the terminator is copied as well
+		*err = buffer_append(&slot->in, *line, (size_t) len + 1);
+		if (*err < 0)
+			return 0;
+		slot->num_lines++;
+	}
+	return slot->num_lines;
+}
+
+static enum BatchError write_slot(struct BatchSlot *slot, FILE *out)
+{
+	assert(slot);
+	assert(out);
+
+	if (slot->err < 0)
+		return BATCH_NO_MEM_ERR;
+	fwrite(slot->out.data, sizeof(char), buffer_size(&slot->out), out);
+	slot->state = SLOT_FREE;
+	if (ferror(out))
+		return BATCH_OUTPUT_ERR;
+	return BATCH_NO_ERR;
+}
+
+static void batch_task(void *arg)
+{
+	struct BatchSlot *slot = (struct BatchSlot*) arg;
+	struct TraceSpan span = trace_begin("batch_chunk");
+
+	buffer_reset(&slot->out);
+	slot->err = BUF_NO_ERR;
+
+	char *line = slot->in.data;
+	for (size_t i = 0; i < slot->num_lines && slot->err == BUF_NO_ERR; i++) {
+		size_t len = strlen(line);
+		slot->err = run_query(slot, line);
+		line += len + 1;
+	}
+	trace_end(&span);
+
+	pthread_mutex_lock(&slot->run->lock);
+	slot->state = SLOT_DONE;
+	pthread_cond_signal(&slot->run->slot_done);
+	pthread_mutex_unlock(&slot->run->lock);
+}
+
+static enum BufferError run_query(struct BatchSlot *slot, char *line)
+{
+	assert(slot);
+	assert(line);
+
+	if (*line == '\0')
+		return BUF_NO_ERR;
+
+	char *args[3] = {};
+	size_t num_args = 0;
+	char *field = line;
+	while (num_args < 3) {
+		args[num_args++] = field;
+		field = strchr(field, '\t');
+		if (!field)
+			break;
+		*field++ = '\0';
+	}
+
+	if (num_args == 2 && !field && strcmp(args[0], "describe") == 0) {
+		uint64_t start = metrics_start();
+		enum BufferError err = batch_describe(&slot->out, slot->run->idx, &slot->path1,
+											  args[1]);
+		metrics_stop(METRIC_DESCRIBE, start);
+		return err;
+	}
+	if (num_args == 3 && !field && strcmp(args[0], "compare") == 0) {
+		uint64_t start = metrics_start();
+		enum BufferError err = batch_compare(&slot->out, slot->run->idx, &slot->path1,
+											 &slot->path2, args[1], args[2]);
+		metrics_stop(METRIC_COMPARE, start);
+		return err;
+	}
+
+	// the fields were split in place, so the request is printed back joined
+	enum BufferError err = buffer_printf(&slot->out, "Неправильный запрос: %s", args[0]);
+	for (size_t i = 1; i < num_args && err == BUF_NO_ERR; i++)
+		err = buffer_printf(&slot->out, "\t%s", args[i]);
+	if (err == BUF_NO_ERR && field)
+		err = buffer_printf(&slot->out, "\t%s", field);
+	if (err == BUF_NO_ERR)
+		err = buffer_append(&slot->out, "\n\n", 2);
+	return err;
+}
+
+enum BufferError batch_describe(struct Buffer *out, const struct NameIndex *idx,
+								struct Path *path, const char *name)
+{
+	assert(out);
+	assert(idx);
+	assert(path);
+	assert(name);
+
+	// answering is allocation free, only the output may grow; the path grows to
+	// the tree's depth once and is reused by the next queries
+	if (path_reserve(path, idx->max_depth) < 0)
+		return BUF_NO_MEM_ERR;
+	mem_no_alloc_begin();
+	const struct NameEntry *entry = name_index_lookup(idx, name);
+	bool has_path = entry && path_from_entry(path, idx, entry) == PATH_NO_ERR;
+	mem_no_alloc_end();
+	if (!entry)
+		return print_not_found(out, idx, name);
+	if (!has_path)
+		return BUF_NO_MEM_ERR;
+
+	const struct Node *node = idx->root;
+	enum BufferError err = buffer_printf(out, "Окей! %s:\n", entry->node->data);
+	if (err == BUF_NO_ERR)
+		err = print_steps(out, &node, path, 0, path->len);
+	if (err == BUF_NO_ERR)
+		err = buffer_append(out, "\n", 1);
+	return err;
+}
+
+enum BufferError batch_compare(struct Buffer *out, const struct NameIndex *idx,
+							   struct Path *path1, struct Path *path2,
+							   const char *name1, const char *name2)
+{
+	assert(out);
+	assert(idx);
+	assert(path1);
+	assert(path2);
+	assert(name1);
+	assert(name2);
+
+	if (path_reserve(path1, idx->max_depth) < 0 || path_reserve(path2, idx->max_depth) < 0)
+		return BUF_NO_MEM_ERR;
+	mem_no_alloc_begin();
+	const struct NameEntry *entry1 = name_index_lookup(idx, name1);
+	const struct NameEntry *entry2 = name_index_lookup(idx, name2);
+	bool has_paths = entry1 && entry2 &&
+					 path_from_entry(path1, idx, entry1) == PATH_NO_ERR &&
+					 path_from_entry(path2, idx, entry2) == PATH_NO_ERR;
+	size_t common = has_paths ? path_common_prefix(path1, path2) : 0;
+	mem_no_alloc_end();
+	if (!entry1)
+		return print_not_found(out, idx, name1);
+	if (!entry2)
+		return print_not_found(out, idx, name2);
+	if (!has_paths)
+		return BUF_NO_MEM_ERR;
+
+	const char *data1 = entry1->node->data;
+	const char *data2 = entry2->node->data;
+	const struct Node *shared = idx->root;
+	enum BufferError err = buffer_printf(out, "И %s, и %s:\n", data1, data2);
+	if (err == BUF_NO_ERR)
+		err = print_steps(out, &shared, path1, 0, common);
+
+	const struct Node *node = shared;
+	if (err == BUF_NO_ERR)
+		err = buffer_printf(out, "Помимо этого, %s:\n", data1);
+	if (err == BUF_NO_ERR)
+		err = print_steps(out, &node, path1, common, path1->len);
+
+	node = shared;
+	if (err == BUF_NO_ERR)
+		err = buffer_printf(out, "Помимо этого, %s:\n", data2);
+	if (err == BUF_NO_ERR)
+		err = print_steps(out, &node, path2, common, path2->len);
+	if (err == BUF_NO_ERR)
+		err = buffer_append(out, "\n", 1);
+	return err;
+}
+
+static enum BufferError print_not_found(struct Buffer *out, const struct NameIndex *idx,
+									   const char *name)
+{
+	assert(out);
+	assert(idx);
+	assert(name);
+
+	struct NameMatch matches[NAME_SUGGESTIONS] = {};
+	size_t found = name_index_suggest(idx, name, matches, NAME_SUGGESTIONS);
+
+	enum BufferError err = buffer_printf(out, "Не знаю никого по имени %s.\n", name);
+	if (err == BUF_NO_ERR && found > 0)
+		err = buffer_printf(out, "Может быть, ты имел в виду:\n");
+	for (size_t i = 0; i < found && err == BUF_NO_ERR; i++)
+		err = buffer_printf(out, "-%s\n", matches[i].node->data);
+	if (err == BUF_NO_ERR)
+		err = buffer_append(out, "\n", 1);
+	return err;
+}
+
+// *node is the question at depth begin and is advanced along the path
+static enum BufferError print_steps(struct Buffer *out, const struct Node **node,
+									const struct Path *path, size_t begin, size_t end)
+{
+	assert(out);
+	assert(node);
+	assert(path);
+
+	enum BufferError err = BUF_NO_ERR;
+	for (size_t depth = begin; depth < end && err == BUF_NO_ERR; depth++) {
+		if (path_answer(path, depth)) {
+			err = buffer_printf(out, "-Не %s\n", (*node)->data);
+			*node = (*node)->right;
+		} else {
+			err = buffer_printf(out, "-%s\n", (*node)->data);
+			*node = (*node)->left;
+		}
+	}
+	return err;
+}
+
+const char *batch_err_to_str(enum BatchError err)
+{
+	switch (err) {
+		case BATCH_THREAD_ERR:
+			return "Couldn't start the thread pool";
+		case BATCH_OUTPUT_ERR:
+			return "Error writing the answers";
+		case BATCH_FILE_ERR:
+			return "Error reading the queries file";
+		case BATCH_NO_MEM_ERR:
+			return "Not enough memory for the queries";
+		case BATCH_NO_ERR:
+			return "No error occured";
+		default:
+			return "An unknown error occured";
+	}
+}
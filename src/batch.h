@@ -0,0 +1,42 @@
+#ifndef _BATCH_H
+#define _BATCH_H
+
+#include <stdio.h>
+
+#include "name_index.h"
+#include "buffer.h"
+#include "path.h"
+
+/*
+ * Runs a file of describe/compare queries against an immutable tree. Every
+ * line is either "describe\t<name>" or "compare\t<name>\t<name>". Lines are
+ * cut into chunks that run on a thread pool; finished chunks wait in a ring of
+ * slots (the reorder buffer) until every earlier chunk has been written, so
+ * the answers come out in input order while memory stays bounded.
+ *
+ * batch_describe() and batch_compare() answer a single query into a buffer,
+ * the way a line of the file is answered; the paths are scratch space that
+ * the caller keeps across queries.
+ */
+enum BatchError {
+	BATCH_THREAD_ERR	= -4,
+	BATCH_OUTPUT_ERR	= -3,
+	BATCH_FILE_ERR		= -2,
+	BATCH_NO_MEM_ERR	= -1,
+	BATCH_NO_ERR		= 0,
+};
+
+const size_t BATCH_CHUNK_LINES		= 512;
+// chunks in flight per worker thread
+const size_t BATCH_SLOTS_PER_THREAD = 4;
+
+enum BatchError batch_run_queries(const struct NameIndex *idx, const char *queries_filename,
+								  FILE *out, size_t num_threads);
+enum BufferError batch_describe(struct Buffer *out, const struct NameIndex *idx,
+								struct Path *path, const char *name);
+enum BufferError batch_compare(struct Buffer *out, const struct NameIndex *idx,
+							   struct Path *path1, struct Path *path2,
+							   const char *name1, const char *name2);
+const char *batch_err_to_str(enum BatchError err);
+
+#endif /*_BATCH_H*/
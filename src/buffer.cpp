@@ -1,12 +1,15 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
 #include <sys/stat.h>
 
 #include "buffer.h"
 
 static enum BufferError buffer_resize(struct Buffer *buf, size_t new_size);
 static enum BufferError get_file_size(FILE *file, size_t *size);
+static enum BufferError buffer_reserve(struct Buffer *buf, size_t add);
 
 enum BufferError buffer_ctor(struct Buffer *buf)
 {
@@ -30,17 +33,16 @@ enum BufferError buffer_load_from_file(struct Buffer *buf, const char *filename)
 
 	size_t filesize = 0;
 	enum BufferError err = get_file_size(input, &filesize);
-	if (err < 0)
-		return err;
-	err = buffer_resize(buf, filesize + 1);
+	if (err == BUF_NO_ERR)
+		err = buffer_resize(buf, filesize + 1);
+	if (err == BUF_NO_ERR && fread(buf->data, sizeof(char), filesize, input) < filesize)
+		err = BUF_FILE_READ_ERR;
+	fclose(input);
 	if (err < 0)
 		return err;
 
-	size_t read_chars = fread(buf->data, sizeof(char), buf->cap - 1, input);
-	if (read_chars < buf->cap - 1)
-		return BUF_FILE_READ_ERR;
+	buf->data[filesize] = '\0';
 	buffer_reset(buf);
-
 	return BUF_NO_ERR;
 }
 
@@ -53,7 +55,8 @@ void buffer_reset(struct Buffer *buf)
 
 static enum BufferError buffer_resize(struct Buffer *buf, size_t new_size)
 {
-	char *tmp = (char*) realloc(buf->data, new_size * sizeof(char));
+	char *tmp = (char*) mem_realloc(buf->tag, buf->data, buf->cap * sizeof(char),
+									new_size * sizeof(char));
 	if (!tmp)
 		return BUF_NO_MEM_ERR;
 	buf->data = tmp;
@@ -63,8 +66,8 @@ static enum BufferError buffer_resize(struct Buffer *buf, size_t new_size)
 
 void buffer_dtor(struct Buffer *buf)
 {
+	mem_free(buf->tag, buf->data, buf->cap * sizeof(char));
 	buf->cap = 0;
-	free(buf->data);
 	buf->data = NULL;
 	buf->pos = NULL;
 }
@@ -76,6 +79,62 @@ size_t buffer_size(struct Buffer *buf)
 	return (size_t) (buf->pos - buf->data);
 }
 
+static enum BufferError buffer_reserve(struct Buffer *buf, size_t add)
+{
+	assert(buf);
+
+	size_t size = buffer_size(buf);
+	if (size + add < buf->cap)
+		return BUF_NO_ERR;
+
+	size_t new_cap = buf->cap ? buf->cap : BUF_INIT_SIZE;
+	while (new_cap <= size + add)
+		new_cap *= BUF_GROW_COEFF;
+	enum BufferError err = buffer_resize(buf, new_cap);
+	if (err < 0)
+		return err;
+	buf->pos = buf->data + size;
+	return BUF_NO_ERR;
+}
+
+enum BufferError buffer_append(struct Buffer *buf, const char *str, size_t len)
+{
+	assert(buf);
+	assert(str);
+
+	enum BufferError err = buffer_reserve(buf, len);
+	if (err < 0)
+		return err;
+	memcpy(buf->pos, str, len);
+	buf->pos += len;
+	*buf->pos = '\0';
+	return BUF_NO_ERR;
+}
+
+enum BufferError buffer_printf(struct Buffer *buf, const char *fmt, ...)
+{
+	assert(buf);
+	assert(fmt);
+
+	va_list args;
+	va_start(args, fmt);
+	int len = vsnprintf(buf->pos, buf->cap - buffer_size(buf), fmt, args);
+	va_end(args);
+	if (len < 0)
+		return BUF_NO_MEM_ERR;
+
+	if ((size_t) len >= buf->cap - buffer_size(buf)) {
+		enum BufferError err = buffer_reserve(buf, (size_t) len);
+		if (err < 0)
+			return err;
+		va_start(args, fmt);
+		vsnprintf(buf->pos, buf->cap - buffer_size(buf), fmt, args);
+		va_end(args);
+	}
+	buf->pos += len;
+	return BUF_NO_ERR;
+}
+
 static enum BufferError get_file_size(FILE *file, size_t *size)
 {
 	assert(file);
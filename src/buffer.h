@@ -3,10 +3,14 @@
 
 #include <stdio.h>
 
+#include "mem.h"
+
 struct Buffer {
 	char *data;
 	char *pos;
 	size_t cap;
+	// MEM_TEXT for the buffers that node texts point into
+	enum MemTag tag;
 };
 
 enum BufferError {
@@ -24,6 +28,9 @@ enum BufferError buffer_load_from_file(struct Buffer *buf, const char *filename)
 void buffer_reset(struct Buffer *buf);
 void buffer_dtor(struct Buffer *buf);
 size_t buffer_size(struct Buffer *buf);
+enum BufferError buffer_append(struct Buffer *buf, const char *str, size_t len);
+enum BufferError buffer_printf(struct Buffer *buf, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
 const char *buffer_err_to_str(enum BufferError err);
 
 #endif /*_BUFFER_H*/
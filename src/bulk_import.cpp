@@ -0,0 +1,300 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "bulk_import.h"
+#include "logger.h"
+
+static enum BulkImportError parse_records(char *data, struct ImportRecord **records,
+										  size_t *num_records, struct ImportReport *report);
+static bool split_record(char *line, size_t line_num, struct ImportRecord *record);
+static bool is_valid_text(const char *text);
+static int compare_records(const void *first, const void *second);
+static enum BulkImportError resolve_leaves(struct Node *tree, struct ImportRecord *records,
+										   size_t num_records, struct ImportReport *report);
+static enum BulkImportError apply_records(struct ImportRecord *records, size_t num_records,
+										  struct ImportReport *report);
+static size_t group_end(const struct ImportRecord *records, size_t num_records, size_t begin,
+						bool *is_same);
+static enum BulkImportError insert_object(const struct ImportRecord *record);
+
+enum BulkImportError bulk_import(struct Node *tree, struct Buffer *records,
+								 struct ImportReport *report)
+{
+	assert(records);
+	assert(records->data);
+	assert(report);
+
+	memset(report, 0, sizeof(struct ImportReport));
+
+	struct ImportRecord *recs = NULL;
+	size_t num_recs = 0;
+	enum BulkImportError err = parse_records(records->data, &recs, &num_recs, report);
+	if (err < 0)
+		goto finally;
+
+	qsort(recs, num_recs, sizeof(struct ImportRecord), compare_records);
+	err = resolve_leaves(tree, recs, num_recs, report);
+	if (err < 0)
+		goto finally;
+	err = apply_records(recs, num_recs, report);
+
+	finally:
+		free(recs);
+
+	return err;
+}
+
+// splits data into records in place
+static enum BulkImportError parse_records(char *data, struct ImportRecord **records,
+										  size_t *num_records, struct ImportReport *report)
+{
+	assert(data);
+	assert(records);
+	assert(num_records);
+	assert(report);
+
+	size_t cap = 0;
+	size_t line_num = 0;
+	char *line = data;
+	while (*line) {
+		line_num++;
+		char *end = strchr(line, '\n');
+		char *next = end ? end + 1 : line + strlen(line);
+		if (end)
+			*end = '\0';
+		size_t len = strlen(line);
+		if (len > 0 && line[len - 1] == '\r')
+			line[--len] = '\0';
+		if (len == 0) {
+			line = next;
+			continue;
+		}
+
+		report->num_records++;
+		if (*num_records == cap) {
+			size_t new_cap = cap ? 2 * cap : IMPORT_INIT_RECORDS;
+			struct ImportRecord *tmp = (struct ImportRecord*) realloc(*records,
+												new_cap * sizeof(struct ImportRecord));
+			if (!tmp)
+				return IMPORT_NO_MEM_ERR;
+			*records = tmp;
+			cap = new_cap;
+		}
+		if (split_record(line, line_num, &(*records)[*num_records]))
+			(*num_records)++;
+		else
+			report->num_invalid++;
+		line = next;
+	}
+
+	return IMPORT_NO_ERR;
+}
+
+static bool split_record(char *line, size_t line_num, struct ImportRecord *record)
+{
+	assert(line);
+	assert(record);
+
+	char *object = strchr(line, '\t');
+	char *question = object ? strchr(object + 1, '\t') : NULL;
+	if (!question || strchr(question + 1, '\t')) {
+		log_message(WARN, "Import line %zu: expected path, object and question separated "
+					"by tabs\n", line_num);
+		return false;
+	}
+	*object++ = '\0';
+	*question++ = '\0';
+
+	const char answers[] = {IMPORT_YES, IMPORT_NO, '\0'};
+	if (strspn(line, answers) != strlen(line)) {
+		log_message(WARN, "Import line %zu: a path is made of %c and %c answers, not %s\n",
+					line_num, IMPORT_YES, IMPORT_NO, line);
+		return false;
+	}
+	// the texts are saved between angle brackets
+	if (!is_valid_text(object) || !is_valid_text(question)) {
+		log_message(WARN, "Import line %zu: an object or a question is empty or has angle "
+					"brackets\n", line_num);
+		return false;
+	}
+
+	*record = {line, object, question, line_num, NULL};
+	return true;
+}
+
+static bool is_valid_text(const char *text)
+{
+	assert(text);
+
+	return *text && !strchr(text, '<') && !strchr(text, '>');
+}
+
+// by path, so that records follow their leaves depth first, then by line
+static int compare_records(const void *first, const void *second)
+{
+	const struct ImportRecord *rec1 = (const struct ImportRecord*) first;
+	const struct ImportRecord *rec2 = (const struct ImportRecord*) second;
+
+	int cmp = strcmp(rec1->path, rec2->path);
+	if (cmp != 0)
+		return cmp;
+	return (rec1->line > rec2->line) - (rec1->line < rec2->line);
+}
+
+// finds the leaf of every record in the tree before the import; trail[k] is
+// the node k answers down the previous path, for the first trail_len answers
+static enum BulkImportError resolve_leaves(struct Node *tree, struct ImportRecord *records,
+										   size_t num_records, struct ImportReport *report)
+{
+	assert(records || num_records == 0);
+	assert(report);
+
+	size_t trail_cap = IMPORT_INIT_DEPTH;
+	struct Node **trail = (struct Node**) calloc(trail_cap, sizeof(struct Node*));
+	if (!trail)
+		return IMPORT_NO_MEM_ERR;
+	trail[0] = tree;
+	size_t trail_len = 1;
+	const char *prev_path = "";
+
+	for (size_t i = 0; i < num_records; i++) {
+		struct ImportRecord *record = &records[i];
+		size_t depth = 0;
+		while (depth + 1 < trail_len && record->path[depth] &&
+			   record->path[depth] == prev_path[depth])
+			depth++;
+		prev_path = record->path;
+
+		struct Node *node = trail[depth];
+		for (; node && record->path[depth]; depth++) {
+			node = record->path[depth] == IMPORT_YES ? node->left : node->right;
+			if (depth + 1 == trail_cap) {
+				struct Node **tmp = (struct Node**) realloc(trail, 2 * trail_cap *
+																   sizeof(struct Node*));
+				if (!tmp) {
+					free(trail);
+					return IMPORT_NO_MEM_ERR;
+				}
+				trail = tmp;
+				trail_cap *= 2;
+			}
+			trail[depth + 1] = node;
+		}
+		trail_len = node ? depth + 1 : depth;
+
+		if (!node) {
+			log_message(WARN, "Import line %zu: the path %s leaves the tree\n", record->line,
+						record->path);
+			report->num_invalid++;
+		} else if (node->left || node->right) {
+			log_message(WARN, "Import line %zu: the path %s ends at the question %s\n",
+						record->line, record->path, node->data);
+			report->num_invalid++;
+		} else {
+			record->leaf = node;
+		}
+	}
+
+	free(trail);
+	return IMPORT_NO_ERR;
+}
+
+// nothing is applied unless every record can be, so a rejected record never
+// leaves the tree half imported
+static enum BulkImportError apply_records(struct ImportRecord *records, size_t num_records,
+										  struct ImportReport *report)
+{
+	assert(records || num_records == 0);
+	assert(report);
+
+	bool is_same = true;
+	for (size_t begin = 0, end = 0; begin < num_records; begin = end) {
+		end = group_end(records, num_records, begin, &is_same);
+		struct Node *leaf = records[begin].leaf;
+		if (!leaf)
+			continue;
+		if (is_same) {
+			report->num_duplicates += end - begin - 1;
+			continue;
+		}
+
+		for (size_t i = begin; i < end; i++)
+			log_message(WARN, "Import line %zu: %s conflicts with line %zu, both replace "
+						"the leaf %s\n", records[i].line, records[i].object,
+						records[i == begin ? begin + 1 : begin].line, leaf->data);
+		report->num_conflicts += end - begin;
+	}
+	if (report->num_conflicts > 0 || report->num_invalid > 0)
+		return IMPORT_NO_ERR;
+
+	for (size_t begin = 0, end = 0; begin < num_records; begin = end) {
+		end = group_end(records, num_records, begin, &is_same);
+		if (insert_object(&records[begin]) < 0)
+			return IMPORT_NO_MEM_ERR;
+		report->num_applied++;
+	}
+
+	return IMPORT_NO_ERR;
+}
+
+// the end of the records of the leaf of records[begin], which are next to each
+// other after the sort; is_same tells if they are all the same
+static size_t group_end(const struct ImportRecord *records, size_t num_records, size_t begin,
+						bool *is_same)
+{
+	assert(records);
+	assert(is_same);
+
+	const struct ImportRecord *first = &records[begin];
+	*is_same = true;
+	size_t end = begin + 1;
+	for (; end < num_records && first->leaf && records[end].leaf == first->leaf; end++)
+		*is_same = *is_same && strcmp(records[end].object, first->object) == 0 &&
+				   strcmp(records[end].question, first->question) == 0;
+	return end;
+}
+
+// as guess() learns an object: the leaf becomes the question
+static enum BulkImportError insert_object(const struct ImportRecord *record)
+{
+	assert(record);
+	assert(record->leaf);
+
+	struct Node *leaf = record->leaf;
+	struct Node *yes = NULL;
+	struct Node *no = NULL;
+	if (node_op_new(&yes, record->object) < 0)
+		return IMPORT_NO_MEM_ERR;
+	if (node_op_new(&no, leaf->data) < 0) {
+		node_op_delete(yes);
+		return IMPORT_NO_MEM_ERR;
+	}
+
+	leaf->left = yes;
+	leaf->right = no;
+	leaf->data = record->question;
+	return IMPORT_NO_ERR;
+}
+
+void import_report_print(const struct ImportReport *report, FILE *out)
+{
+	assert(report);
+	assert(out);
+
+	fprintf(out, "records\t%zu\napplied\t%zu\nduplicates\t%zu\nconflicts\t%zu\ninvalid\t%zu\n",
+			report->num_records, report->num_applied, report->num_duplicates,
+			report->num_conflicts, report->num_invalid);
+}
+
+const char *bulk_import_err_to_str(enum BulkImportError err)
+{
+	switch (err) {
+		case IMPORT_NO_MEM_ERR:
+			return "Not enough memory for the import";
+		case IMPORT_NO_ERR:
+			return "No error occured";
+		default:
+			return "An unknown error occured";
+	}
+}
@@ -0,0 +1,57 @@
+#ifndef _BULK_IMPORT_H
+#define _BULK_IMPORT_H
+
+#include <stdio.h>
+
+#include "tree.h"
+#include "buffer.h"
+
+/*
+ * Applies many learned objects at once, as guess() learns one. A record is a
+ * line "path<TAB>object<TAB>question": the answers from the root to the leaf
+ * the guesser ended at, 'y' for yes and 'n' for no, the object it should have
+ * guessed and the question that is true for the object and false for the leaf.
+ * The leaf becomes the question, with the object as its yes answer and the old
+ * leaf as its no answer.
+ *
+ * Every path refers to the tree as it was before the import. Records are
+ * sorted by path, which is a depth-first order of their leaves, and resolved
+ * first, each walk starting from the part of the previous path it shares;
+ * then the insertions are applied in the same order, so the new nodes are
+ * allocated next to each other. Records that end at the same leaf conflict,
+ * unless they are identical, and so does a record with a bad path or text;
+ * with any conflict nothing is applied. The texts stay in the records buffer,
+ * which must outlive the tree.
+ */
+struct ImportRecord {
+	const char *path;
+	const char *object;
+	const char *question;
+	size_t line;
+	struct Node *leaf;
+};
+
+struct ImportReport {
+	size_t num_records;
+	size_t num_applied;
+	size_t num_duplicates;
+	size_t num_conflicts;
+	size_t num_invalid;
+};
+
+enum BulkImportError {
+	IMPORT_NO_MEM_ERR	= -1,
+	IMPORT_NO_ERR		= 0,
+};
+
+const size_t IMPORT_INIT_RECORDS	= 1024;
+const size_t IMPORT_INIT_DEPTH		= 64;
+const char IMPORT_YES				= 'y';
+const char IMPORT_NO				= 'n';
+
+enum BulkImportError bulk_import(struct Node *tree, struct Buffer *records,
+								 struct ImportReport *report);
+void import_report_print(const struct ImportReport *report, FILE *out);
+const char *bulk_import_err_to_str(enum BulkImportError err);
+
+#endif /*_BULK_IMPORT_H*/
@@ -15,6 +15,11 @@ enum ArgError process_args(const struct ArgDef arg_defs[], size_t arg_defs_size,
 	size_t count_required = 0;
 	while (i < argc) {
 		if (argv[i][0] == '-' && argv[i][1] == '-') {
+			if (strcmp(argv[i] + 2, "help") == 0) {
+				arg_show_usage(arg_defs, arg_defs_size, argv[0]);
+				return ARG_HELP_CALLED;
+			}
+			bool processed = false;
 			for (size_t def_ind = 0; def_ind < arg_defs_size; def_ind++) {
 				if (!arg_defs[def_ind].long_name)
 					continue;
@@ -35,13 +40,12 @@ enum ArgError process_args(const struct ArgDef arg_defs[], size_t arg_defs_size,
 					else
 						i += 2;
 
+					processed = true;
 					break;
 				}
 			}
-			if (strcmp(argv[i] + 2, "help") == 0) {
-				arg_show_usage(arg_defs, arg_defs_size, argv[0]);
-				return ARG_HELP_CALLED;
-			}
+			if (!processed)
+				return ARG_WRONG_ARGS_ERR;
 		} else if (argv[i][0] == '-') {
 			const char *short_name = argv[i] + 1;
 			while (*short_name != '\0') {
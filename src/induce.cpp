@@ -0,0 +1,588 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include "induce.h"
+#include "thread_pool.h"
+#include "small_stack.h"
+#include "logger.h"
+#include "trace.h"
+
+const size_t WORD_BITS = 64;
+const size_t NO_QUESTION = SIZE_MAX;
+
+struct InduceTable {
+	const char **questions;
+	size_t num_questions;
+	// row_words words of answers per object, bit q of a row for question q
+	size_t row_words;
+
+	const char **names;
+	uint64_t *rows;
+	size_t num_objects;
+	size_t cap;
+};
+
+// the balance of a split is its smaller side
+struct InduceSplit {
+	size_t question;
+	size_t balance;
+};
+
+struct InduceTask {
+	struct Inducer *ind;
+	size_t group_begin;
+	size_t group_end;
+	struct InduceSplit best;
+};
+
+struct Inducer {
+	struct InduceTable table;
+	// the objects of a node are a range of order
+	size_t *order;
+	size_t *scratch;
+
+	// the node split by the tasks
+	size_t lo;
+	size_t hi;
+	// the first group with a question that splits the node in halves
+	size_t halves_group;
+
+	struct ThreadPool pool;
+	struct InduceTask *tasks;
+	size_t num_tasks;
+};
+
+// a node still to be made, of the objects [lo, hi) of the order
+struct InduceFrame {
+	size_t lo;
+	size_t hi;
+	size_t depth;
+	struct Node **slot;
+};
+
+static enum InduceError parse_table(char *data, struct InduceTable *table);
+static enum InduceError parse_header(char *line, size_t line_num, struct InduceTable *table);
+static enum InduceError parse_row(char *line, size_t line_num, struct InduceTable *table);
+static bool grow_table(struct InduceTable *table);
+static bool next_field(char **iter, char **field);
+static bool is_valid_text(const char *text);
+static void table_dtor(struct InduceTable *table);
+static enum InduceError start_tasks(struct Inducer *ind, size_t num_threads);
+static enum InduceError grow_tree(struct Inducer *ind, struct Node **tree,
+								  struct InduceReport *report);
+static struct InduceSplit find_split(struct Inducer *ind, size_t lo, size_t hi);
+static void split_task(void *arg);
+static struct InduceSplit best_in_group(const struct Inducer *ind, size_t lo, size_t hi,
+										size_t group);
+static size_t partition(struct Inducer *ind, size_t lo, size_t hi, size_t question);
+static void report_indistinct(const struct Inducer *ind, size_t lo, size_t hi);
+
+enum InduceError tree_induce(struct Node **tree, struct Buffer *table, size_t num_threads,
+							 struct InduceReport *report)
+{
+	assert(tree);
+	assert(table);
+	assert(table->data);
+	assert(num_threads > 0);
+	assert(report);
+
+	memset(report, 0, sizeof(struct InduceReport));
+	*tree = NULL;
+
+	struct timespec start = {};
+	struct timespec end = {};
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	struct Inducer ind = {};
+	enum InduceError err = parse_table(table->data, &ind.table);
+	if (err < 0)
+		goto finally;
+	report->num_objects = ind.table.num_objects;
+	report->num_questions = ind.table.num_questions;
+
+	ind.order = (size_t*) calloc(ind.table.num_objects, sizeof(size_t));
+	ind.scratch = (size_t*) calloc(ind.table.num_objects, sizeof(size_t));
+	if (!ind.order || !ind.scratch) {
+		err = INDUCE_NO_MEM_ERR;
+		goto finally;
+	}
+	for (size_t i = 0; i < ind.table.num_objects; i++)
+		ind.order[i] = i;
+
+	err = start_tasks(&ind, num_threads);
+	if (err < 0)
+		goto finally;
+	err = grow_tree(&ind, tree, report);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	report->seconds = (double) (end.tv_sec - start.tv_sec) +
+					  (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	finally:
+		if (ind.pool.threads)
+			pool_dtor(&ind.pool);
+		free(ind.tasks);
+		free(ind.order);
+		free(ind.scratch);
+		table_dtor(&ind.table);
+
+	return err;
+}
+
+// splits data into fields in place, the first line being the header
+static enum InduceError parse_table(char *data, struct InduceTable *table)
+{
+	assert(data);
+	assert(table);
+
+	TRACE_SCOPE("induce_parse");
+	bool has_header = false;
+	size_t line_num = 0;
+	char *line = data;
+	while (*line) {
+		line_num++;
+		char *end = strchr(line, '\n');
+		char *next = end ? end + 1 : line + strlen(line);
+		if (end)
+			*end = '\0';
+		size_t len = (size_t) ((end ? end : next) - line);
+		if (len > 0 && line[len - 1] == '\r')
+			line[--len] = '\0';
+		if (len == 0) {
+			line = next;
+			continue;
+		}
+
+		enum InduceError err = has_header ? parse_row(line, line_num, table) :
+											parse_header(line, line_num, table);
+		if (err < 0)
+			return err;
+		has_header = true;
+		line = next;
+	}
+
+	if (table->num_objects == 0) {
+		log_message(ERROR, "The table has no objects\n");
+		return INDUCE_FORMAT_ERR;
+	}
+	return INDUCE_NO_ERR;
+}
+
+// "name,question,question,...", the first column being the objects
+static enum InduceError parse_header(char *line, size_t line_num, struct InduceTable *table)
+{
+	assert(line);
+	assert(table);
+
+	size_t num_fields = 1;
+	for (const char *iter = line; *iter; iter++)
+		num_fields += *iter == ',';
+	// no more questions than fields, which quoted commas only add to
+	table->questions = (const char**) calloc(num_fields, sizeof(const char*));
+	if (!table->questions)
+		return INDUCE_NO_MEM_ERR;
+
+	char *iter = line;
+	char *field = NULL;
+	if (!next_field(&iter, &field)) {
+		log_message(ERROR, "Table line %zu: a quote isn't closed\n", line_num);
+		return INDUCE_FORMAT_ERR;
+	}
+	while (iter) {
+		if (!next_field(&iter, &field)) {
+			log_message(ERROR, "Table line %zu: a quote isn't closed\n", line_num);
+			return INDUCE_FORMAT_ERR;
+		}
+		// the texts are saved between angle brackets
+		if (!is_valid_text(field)) {
+			log_message(ERROR, "Table line %zu: question %zu is empty or has angle brackets\n",
+						line_num, table->num_questions + 1);
+			return INDUCE_FORMAT_ERR;
+		}
+		table->questions[table->num_questions++] = field;
+	}
+
+	table->row_words = (table->num_questions + WORD_BITS - 1) / WORD_BITS;
+	return INDUCE_NO_ERR;
+}
+
+// "object,answer,answer,...", an answer for every question of the header
+static enum InduceError parse_row(char *line, size_t line_num, struct InduceTable *table)
+{
+	assert(line);
+	assert(table);
+
+	if (table->num_objects == table->cap && !grow_table(table))
+		return INDUCE_NO_MEM_ERR;
+	uint64_t *row = table->rows + table->num_objects * table->row_words;
+	memset(row, 0, table->row_words * sizeof(uint64_t));
+
+	char *iter = line;
+	char *field = NULL;
+	if (!next_field(&iter, &field)) {
+		log_message(ERROR, "Table line %zu: a quote isn't closed\n", line_num);
+		return INDUCE_FORMAT_ERR;
+	}
+	if (!is_valid_text(field)) {
+		log_message(ERROR, "Table line %zu: the object is empty or has angle brackets\n",
+					line_num);
+		return INDUCE_FORMAT_ERR;
+	}
+	table->names[table->num_objects] = field;
+
+	size_t question = 0;
+	for (; iter && question < table->num_questions; question++) {
+		// most answers are one unquoted letter, cut off without a search
+		if (iter[0] && iter[0] != '"' && (iter[1] == ',' || !iter[1])) {
+			field = iter;
+			iter = iter[1] ? iter + 2 : NULL;
+			field[1] = '\0';
+		} else if (!next_field(&iter, &field)) {
+			log_message(ERROR, "Table line %zu: a quote isn't closed\n", line_num);
+			return INDUCE_FORMAT_ERR;
+		}
+		// 1 or y for yes, 0 or n for no
+		bool is_answer = field[0] && !field[1];
+		switch (is_answer ? field[0] : '\0') {
+			case '1':
+			case 'y':
+				row[question / WORD_BITS] |= 1ull << (question % WORD_BITS);
+				break;
+			case '0':
+			case 'n':
+				break;
+			default:
+				log_message(ERROR, "Table line %zu: the answer to %s is %s, not 1, y, 0 or n\n",
+							line_num, table->questions[question], field);
+				return INDUCE_FORMAT_ERR;
+		}
+	}
+	if (iter || question < table->num_questions) {
+		log_message(ERROR, "Table line %zu: %s has %s answers than the %zu questions of the "
+					"header\n", line_num, table->names[table->num_objects],
+					iter ? "more" : "fewer", table->num_questions);
+		return INDUCE_FORMAT_ERR;
+	}
+
+	table->num_objects++;
+	return INDUCE_NO_ERR;
+}
+
+static bool grow_table(struct InduceTable *table)
+{
+	assert(table);
+
+	size_t new_cap = table->cap ? 2 * table->cap : INDUCE_INIT_OBJECTS;
+	const char **names = (const char**) realloc(table->names, new_cap * sizeof(const char*));
+	if (!names)
+		return false;
+	table->names = names;
+	// a table without questions still needs a row to point at
+	size_t row_words = table->row_words ? table->row_words : 1;
+	uint64_t *rows = (uint64_t*) realloc(table->rows, new_cap * row_words * sizeof(uint64_t));
+	if (!rows)
+		return false;
+	table->rows = rows;
+	table->cap = new_cap;
+	return true;
+}
+
+// cuts the next field off *iter in place and unquotes it; *iter becomes NULL
+// after the last field of the line, and false is returned for a bad quote
+static bool next_field(char **iter, char **field)
+{
+	assert(iter);
+	assert(*iter);
+	assert(field);
+
+	char *src = *iter;
+	*field = src;
+	if (*src != '"') {
+		char *comma = strchr(src, ',');
+		if (comma)
+			*comma = '\0';
+		*iter = comma ? comma + 1 : NULL;
+		return true;
+	}
+
+	char *dst = src++;
+	while (*src != '"' || src[1] == '"') {
+		if (!*src)
+			return false;
+		if (*src == '"')
+			src++;
+		*dst++ = *src++;
+	}
+	src++;
+	if (*src && *src != ',')
+		return false;
+	*iter = *src ? src + 1 : NULL;
+	*dst = '\0';
+	return true;
+}
+
+static bool is_valid_text(const char *text)
+{
+	assert(text);
+
+	return *text && !strchr(text, '<') && !strchr(text, '>');
+}
+
+static void table_dtor(struct InduceTable *table)
+{
+	assert(table);
+
+	free(table->questions);
+	free(table->names);
+	free(table->rows);
+	memset(table, 0, sizeof(struct InduceTable));
+}
+
+// one thread counts every node by itself, without a pool
+static enum InduceError start_tasks(struct Inducer *ind, size_t num_threads)
+{
+	assert(ind);
+
+	size_t num_groups = (ind->table.row_words + INDUCE_GROUP_WORDS - 1) / INDUCE_GROUP_WORDS;
+	if (num_threads == 1 || num_groups < 2)
+		return INDUCE_NO_ERR;
+
+	ind->num_tasks = INDUCE_TASKS_PER_THREAD * num_threads;
+	if (ind->num_tasks > num_groups)
+		ind->num_tasks = num_groups;
+	ind->tasks = (struct InduceTask*) calloc(ind->num_tasks, sizeof(struct InduceTask));
+	if (!ind->tasks)
+		return INDUCE_NO_MEM_ERR;
+	for (size_t i = 0; i < ind->num_tasks; i++)
+		ind->tasks[i] = {ind, i * num_groups / ind->num_tasks,
+						 (i + 1) * num_groups / ind->num_tasks, {NO_QUESTION, 0}};
+
+	if (pool_ctor(&ind->pool, num_threads) < 0)
+		return INDUCE_THREAD_ERR;
+	return INDUCE_NO_ERR;
+}
+
+static enum InduceError grow_tree(struct Inducer *ind, struct Node **tree,
+								  struct InduceReport *report)
+{
+	assert(ind);
+	assert(tree);
+	assert(report);
+
+	TRACE_SCOPE("induce_grow");
+	enum InduceError err = INDUCE_NO_ERR;
+	SmallStack<struct InduceFrame, INDUCE_INIT_DEPTH> stack = {};
+	small_stack_ctor(&stack);
+	small_stack_push(&stack, {0, ind->table.num_objects, 0, tree});
+
+	struct InduceFrame frame = {};
+	while (err == INDUCE_NO_ERR && small_stack_pop(&stack, &frame) == STACK_NO_ERR) {
+		struct InduceSplit split = {NO_QUESTION, 0};
+		if (frame.hi - frame.lo > 1)
+			split = find_split(ind, frame.lo, frame.hi);
+		const char *text = split.balance ? ind->table.questions[split.question] :
+										   ind->table.names[ind->order[frame.lo]];
+		if (node_op_new(frame.slot, text) < 0) {
+			err = INDUCE_NO_MEM_ERR;
+			continue;
+		}
+		report->num_nodes++;
+		if (frame.depth > report->max_depth)
+			report->max_depth = frame.depth;
+		if (!split.balance) {
+			report->num_leaves++;
+			report->num_indistinct += frame.hi - frame.lo - 1;
+			report_indistinct(ind, frame.lo, frame.hi);
+			continue;
+		}
+
+		// yes is the left answer, as in a learned tree
+		struct Node *node = *frame.slot;
+		size_t mid = partition(ind, frame.lo, frame.hi, split.question);
+		if (small_stack_push(&stack, {mid, frame.hi, frame.depth + 1, &node->right}) < 0 ||
+			small_stack_push(&stack, {frame.lo, mid, frame.depth + 1, &node->left}) < 0)
+			err = INDUCE_NO_MEM_ERR;
+	}
+
+	small_stack_dtor(&stack);
+	if (err < 0) {
+		node_op_delete(*tree);
+		*tree = NULL;
+	}
+	return err;
+}
+
+// the most balanced question for the objects [lo, hi), or a zero balance if
+// every question has the same answer for all of them
+static struct InduceSplit find_split(struct Inducer *ind, size_t lo, size_t hi)
+{
+	assert(ind);
+	assert(lo < hi);
+
+	size_t num_groups = (ind->table.row_words + INDUCE_GROUP_WORDS - 1) / INDUCE_GROUP_WORDS;
+	size_t halves = (hi - lo) / 2;
+	struct InduceSplit best = {NO_QUESTION, 0};
+
+	if (ind->tasks && (hi - lo) * ind->table.row_words >= INDUCE_PARALLEL_WORK) {
+		ind->lo = lo;
+		ind->hi = hi;
+		__atomic_store_n(&ind->halves_group, num_groups, __ATOMIC_RELAXED);
+		for (size_t i = 0; i < ind->num_tasks; i++) {
+			ind->tasks[i].best = {NO_QUESTION, 0};
+			// a task that can't be queued is counted here instead
+			if (pool_submit(&ind->pool, split_task, &ind->tasks[i]) < 0)
+				split_task(&ind->tasks[i]);
+		}
+		pool_wait(&ind->pool);
+
+		// in the order of the groups, so the first of equal questions wins
+		for (size_t i = 0; i < ind->num_tasks; i++)
+			if (ind->tasks[i].best.balance > best.balance)
+				best = ind->tasks[i].best;
+		return best;
+	}
+
+	for (size_t group = 0; group < num_groups && best.balance < halves; group++) {
+		struct InduceSplit split = best_in_group(ind, lo, hi, group);
+		if (split.balance > best.balance)
+			best = split;
+	}
+	return best;
+}
+
+// a task skips the groups after one where a question splits the node in
+// halves, as no later question can be better; the groups before it are all
+// counted, so the result is the one of a single thread
+static void split_task(void *arg)
+{
+	struct InduceTask *task = (struct InduceTask*) arg;
+	struct Inducer *ind = task->ind;
+	size_t halves = (ind->hi - ind->lo) / 2;
+
+	for (size_t group = task->group_begin; group < task->group_end; group++) {
+		if (group > __atomic_load_n(&ind->halves_group, __ATOMIC_RELAXED))
+			break;
+		struct InduceSplit split = best_in_group(ind, ind->lo, ind->hi, group);
+		if (split.balance > task->best.balance)
+			task->best = split;
+		if (task->best.balance < halves)
+			continue;
+
+		size_t first = __atomic_load_n(&ind->halves_group, __ATOMIC_RELAXED);
+		while (group < first && !__atomic_compare_exchange_n(&ind->halves_group, &first, group,
+															 true, __ATOMIC_RELAXED,
+															 __ATOMIC_RELAXED))
+			;
+		break;
+	}
+}
+
+// counts the yes answers of the objects [lo, hi) to the questions of the
+// group: plane k of a word holds bit k of the 64 counts, and a row word is
+// added to them as a carry rippling up the planes
+static struct InduceSplit best_in_group(const struct Inducer *ind, size_t lo, size_t hi,
+										size_t group)
+{
+	assert(ind);
+	assert(lo < hi);
+
+	const struct InduceTable *table = &ind->table;
+	size_t first_word = group * INDUCE_GROUP_WORDS;
+	size_t num_words = table->row_words - first_word < INDUCE_GROUP_WORDS ?
+					   table->row_words - first_word : INDUCE_GROUP_WORDS;
+	size_t num_objects = hi - lo;
+	size_t num_planes = WORD_BITS - (size_t) __builtin_clzll(num_objects);
+
+	uint64_t planes[INDUCE_GROUP_WORDS][WORD_BITS];
+	for (size_t word = 0; word < num_words; word++)
+		memset(planes[word], 0, num_planes * sizeof(uint64_t));
+
+	for (size_t i = lo; i < hi; i++) {
+		const uint64_t *row = table->rows + ind->order[i] * table->row_words + first_word;
+		for (size_t word = 0; word < num_words; word++) {
+			uint64_t carry = row[word];
+			for (size_t plane = 0; carry; plane++) {
+				uint64_t sum = planes[word][plane] ^ carry;
+				carry &= planes[word][plane];
+				planes[word][plane] = sum;
+			}
+		}
+	}
+
+	struct InduceSplit best = {NO_QUESTION, 0};
+	for (size_t word = 0; word < num_words; word++) {
+		for (size_t bit = 0; bit < WORD_BITS; bit++) {
+			size_t question = (first_word + word) * WORD_BITS + bit;
+			if (question >= table->num_questions)
+				break;
+			size_t num_yes = 0;
+			for (size_t plane = 0; plane < num_planes; plane++)
+				num_yes |= ((planes[word][plane] >> bit) & 1) << plane;
+			size_t balance = num_yes < num_objects - num_yes ? num_yes : num_objects - num_yes;
+			if (balance > best.balance)
+				best = {question, balance};
+		}
+	}
+	return best;
+}
+
+// stably moves the objects of [lo, hi) that answer yes to the front and
+// returns where the others start
+static size_t partition(struct Inducer *ind, size_t lo, size_t hi, size_t question)
+{
+	assert(ind);
+
+	const struct InduceTable *table = &ind->table;
+	size_t word = question / WORD_BITS;
+	size_t bit = question % WORD_BITS;
+	size_t num_yes = lo;
+	size_t num_no = 0;
+	for (size_t i = lo; i < hi; i++) {
+		size_t object = ind->order[i];
+		if ((table->rows[object * table->row_words + word] >> bit) & 1)
+			ind->order[num_yes++] = object;
+		else
+			ind->scratch[num_no++] = object;
+	}
+	memcpy(ind->order + num_yes, ind->scratch, num_no * sizeof(size_t));
+	return num_yes;
+}
+
+static void report_indistinct(const struct Inducer *ind, size_t lo, size_t hi)
+{
+	assert(ind);
+
+	const char *kept = ind->table.names[ind->order[lo]];
+	for (size_t i = lo + 1; i < hi; i++)
+		log_message(WARN, "%s has the same answers as %s and is left out\n",
+					ind->table.names[ind->order[i]], kept);
+}
+
+void induce_report_print(const struct InduceReport *report, FILE *out)
+{
+	assert(report);
+	assert(out);
+
+	fprintf(out, "objects\t%zu\nquestions\t%zu\nnodes\t%zu\nleaves\t%zu\nmax_depth\t%zu\n"
+			"indistinct\t%zu\nseconds\t%.3f\n", report->num_objects, report->num_questions,
+			report->num_nodes, report->num_leaves, report->max_depth, report->num_indistinct,
+			report->seconds);
+}
+
+const char *induce_err_to_str(enum InduceError err)
+{
+	switch (err) {
+		case INDUCE_THREAD_ERR:
+			return "Couldn't start the threads that split the table";
+		case INDUCE_FORMAT_ERR:
+			return "The table isn't a CSV of objects and their answers";
+		case INDUCE_NO_MEM_ERR:
+			return "Not enough memory to build the tree";
+		case INDUCE_NO_ERR:
+			return "No error occured";
+		default:
+			return "An unknown error occured";
+	}
+}
@@ -0,0 +1,62 @@
+#ifndef _INDUCE_H
+#define _INDUCE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "tree.h"
+#include "buffer.h"
+
+/*
+ * Builds a tree from a table of objects and their answers instead of learning
+ * it game by game. The table is CSV: a header "name,question,question,..."
+ * and a row "object,answer,answer,..." per object, an answer being 1 or y for
+ * yes and 0 or n for no; a field with commas or quotes is quoted, with quotes
+ * doubled.
+ *
+ * The tree is grown greedily from the root. Every object is a class of its
+ * own, so the information gain of a question is the entropy of its yes/no
+ * split, which grows with the balance of the split: a node asks the question
+ * whose yes count is closest to half of its objects, the first such question
+ * if several are. A table row is a bitset of answers; the yes counts of 64
+ * questions are summed for all the objects of a node at once in bit-sliced
+ * counters, a group of INDUCE_GROUP_WORDS words (one cache line of a row) at a
+ * time, and the scan stops at the first question that splits the objects in
+ * halves. The groups of a large node are counted by the thread pool. The
+ * objects of a node are a range of an order array, partitioned stably by the
+ * question, so a subtree keeps the order of the table. Objects with the same
+ * answers to every question can't be told apart: the first of them becomes
+ * the leaf and the rest are reported. The texts stay in the table buffer,
+ * which must outlive the tree.
+ */
+struct InduceReport {
+	size_t num_objects;
+	size_t num_questions;
+	size_t num_nodes;
+	size_t num_leaves;
+	size_t max_depth;
+	// objects left out, as they have the answers of an earlier object
+	size_t num_indistinct;
+	double seconds;
+};
+
+enum InduceError {
+	INDUCE_THREAD_ERR	= -3,
+	INDUCE_FORMAT_ERR	= -2,
+	INDUCE_NO_MEM_ERR	= -1,
+	INDUCE_NO_ERR		= 0,
+};
+
+const size_t INDUCE_INIT_OBJECTS	= 1024;
+const size_t INDUCE_INIT_DEPTH		= 64;
+const size_t INDUCE_GROUP_WORDS		= 8;
+const size_t INDUCE_TASKS_PER_THREAD	= 4;
+// nodes with fewer objects times row words are split by the calling thread
+const size_t INDUCE_PARALLEL_WORK	= 1 << 16;
+
+enum InduceError tree_induce(struct Node **tree, struct Buffer *table, size_t num_threads,
+							 struct InduceReport *report);
+void induce_report_print(const struct InduceReport *report, FILE *out);
+const char *induce_err_to_str(enum InduceError err);
+
+#endif /*_INDUCE_H*/
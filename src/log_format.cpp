@@ -0,0 +1,525 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+
+#include "log_format.h"
+
+// arguments of kind LOG_ARG_LONG are read as long long whatever their length
+// modifier says, which holds on LP64
+static_assert(sizeof(long) == sizeof(long long) && sizeof(size_t) == sizeof(long long),
+			  "log_format expects an LP64 platform");
+
+struct Log_spec {
+	bool has_arg;
+	enum Log_arg_kind kind;
+	size_t num_stars;
+	int prec;
+};
+
+static const char *scan_spec(const char *c, struct Log_spec *spec);
+static int format_piece(char *out, size_t n, const char *spec, ...);
+template <typename T>
+static int format_value(char *out, size_t n, const char *spec, const int *stars,
+						size_t num_stars, T value);
+static bool get_varint(FILE *in, size_t *value);
+static bool args_fit(const struct Log_format *format, const char *args, size_t len);
+
+void log_format_parse(const char *fmt, struct Log_format *format)
+{
+	assert(fmt);
+	assert(format);
+
+	format->fmt = fmt;
+	format->num_args = 0;
+	format->is_deferrable = false;
+
+	for (const char *c = fmt; *c; c++) {
+		if (*c != '%')
+			continue;
+
+		struct Log_spec spec = {};
+		const char *end = scan_spec(c + 1, &spec);
+		if (!end || (size_t) (end - c) >= LOG_MAX_SPEC)
+			return;
+
+		if (spec.has_arg) {
+			if (format->num_args + spec.num_stars + 1 > LOG_MAX_ARGS)
+				return;
+			for (size_t i = 0; i < spec.num_stars; i++) {
+				format->kinds[format->num_args] = LOG_ARG_INT;
+				format->precs[format->num_args] = LOG_PREC_NONE;
+				format->num_args++;
+			}
+			format->kinds[format->num_args] = spec.kind;
+			format->precs[format->num_args] = spec.prec;
+			format->num_args++;
+		}
+		c = end;
+	}
+
+	format->is_deferrable = true;
+}
+
+// c points past the '%'; returns the conversion character or NULL if the
+// specification can't be deferred
+static const char *scan_spec(const char *c, struct Log_spec *spec)
+{
+	assert(c);
+	assert(spec);
+
+	spec->has_arg = true;
+	spec->num_stars = 0;
+	spec->prec = LOG_PREC_NONE;
+
+	if (*c == '%') {
+		spec->has_arg = false;
+		return c;
+	}
+
+	while (*c && strchr("-+ #0'", *c))
+		c++;
+	if (*c == '*') {
+		spec->num_stars++;
+		c++;
+	} else {
+		while (isdigit((unsigned char) *c))
+			c++;
+		if (*c == '$')
+			return NULL;
+	}
+
+	if (*c == '.') {
+		c++;
+		if (*c == '*') {
+			spec->num_stars++;
+			spec->prec = LOG_PREC_STAR;
+			c++;
+		} else {
+			spec->prec = 0;
+			for (; isdigit((unsigned char) *c) && spec->prec < (int) LOG_MAX_STRINGS; c++)
+				spec->prec = spec->prec * 10 + (*c - '0');
+			while (isdigit((unsigned char) *c))
+				c++;
+		}
+	}
+
+	bool is_long = false;
+	bool is_long_double = false;
+	while (*c && strchr("hlLqjzt", *c)) {
+		if (*c == 'L' || *c == 'q')
+			is_long_double = true;
+		else if (*c != 'h')
+			is_long = true;
+		c++;
+	}
+
+	switch (*c) {
+		case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+			spec->kind = is_long ? LOG_ARG_LONG : LOG_ARG_INT;
+			return c;
+		case 'c':
+			spec->kind = LOG_ARG_INT;
+			return is_long ? NULL : c;
+		case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+			spec->kind = is_long_double ? LOG_ARG_LONG_DOUBLE : LOG_ARG_DOUBLE;
+			return c;
+		case 's':
+			spec->kind = LOG_ARG_STR;
+			return is_long ? NULL : c;
+		case 'p':
+			spec->kind = LOG_ARG_PTR;
+			return c;
+		default:
+			return NULL;
+	}
+}
+
+// copies the arguments to out, which must have LOG_MAX_ARGS_SIZE bytes; strings
+// are copied with their terminating zero and share LOG_MAX_STRINGS bytes
+size_t log_args_capture(const struct Log_format *format, va_list args, char *out,
+						bool *is_truncated)
+{
+	assert(format);
+	assert(format->is_deferrable);
+	assert(out);
+	assert(is_truncated);
+
+	size_t len = 0;
+	size_t strings_left = LOG_MAX_STRINGS;
+	int last_int = 0;
+	*is_truncated = false;
+
+	for (size_t i = 0; i < format->num_args; i++) {
+		switch (format->kinds[i]) {
+			case LOG_ARG_INT: {
+				int value = va_arg(args, int);
+				memcpy(out + len, &value, sizeof(value));
+				len += sizeof(value);
+				last_int = value;
+				break;
+			}
+			case LOG_ARG_LONG: {
+				long long value = va_arg(args, long long);
+				memcpy(out + len, &value, sizeof(value));
+				len += sizeof(value);
+				break;
+			}
+			case LOG_ARG_DOUBLE: {
+				double value = va_arg(args, double);
+				memcpy(out + len, &value, sizeof(value));
+				len += sizeof(value);
+				break;
+			}
+			case LOG_ARG_LONG_DOUBLE: {
+				long double value = va_arg(args, long double);
+				memcpy(out + len, &value, sizeof(value));
+				len += sizeof(value);
+				break;
+			}
+			case LOG_ARG_PTR: {
+				const void *value = va_arg(args, const void*);
+				memcpy(out + len, &value, sizeof(value));
+				len += sizeof(value);
+				break;
+			}
+			case LOG_ARG_STR: {
+				const char *str = va_arg(args, const char*);
+				if (!str)
+					str = "(null)";
+
+				int prec = format->precs[i] == LOG_PREC_STAR ? last_int : format->precs[i];
+				bool is_bounded = prec >= 0 && (size_t) prec <= strings_left;
+				size_t max_len = is_bounded ? (size_t) prec : strings_left;
+				size_t str_len = strnlen(str, max_len);
+				if (!is_bounded && str_len == max_len && str[str_len] != '\0')
+					*is_truncated = true;
+
+				memcpy(out + len, str, str_len);
+				out[len + str_len] = '\0';
+				len += str_len + 1;
+				strings_left -= str_len;
+				break;
+			}
+			default:
+				assert(0 && "Unknown argument kind");
+				break;
+		}
+	}
+
+	return len;
+}
+
+// formats like snprintf from the arguments captured by log_args_capture
+size_t log_format_args(const char *fmt, const char *args, char *out, size_t n)
+{
+	assert(fmt);
+	assert(args);
+
+	size_t pos = 0;
+	for (const char *c = fmt; *c; c++) {
+		if (*c != '%') {
+			if (pos + 1 < n)
+				out[pos] = *c;
+			pos++;
+			continue;
+		}
+
+		struct Log_spec spec = {};
+		const char *end = scan_spec(c + 1, &spec);
+		if (!end)
+			break;
+		if (!spec.has_arg) {
+			if (pos + 1 < n)
+				out[pos] = '%';
+			pos++;
+			c = end;
+			continue;
+		}
+
+		char spec_buf[LOG_MAX_SPEC] = "";
+		memcpy(spec_buf, c, (size_t) (end - c) + 1);
+		int stars[2] = {};
+		for (size_t i = 0; i < spec.num_stars; i++) {
+			memcpy(&stars[i], args, sizeof(int));
+			args += sizeof(int);
+		}
+
+		char *dst = pos < n ? out + pos : NULL;
+		size_t rem = pos < n ? n - pos : 0;
+		int written = 0;
+		switch (spec.kind) {
+			case LOG_ARG_INT: {
+				int value = 0;
+				memcpy(&value, args, sizeof(value));
+				args += sizeof(value);
+				written = format_value(dst, rem, spec_buf, stars, spec.num_stars, value);
+				break;
+			}
+			case LOG_ARG_LONG: {
+				long long value = 0;
+				memcpy(&value, args, sizeof(value));
+				args += sizeof(value);
+				written = format_value(dst, rem, spec_buf, stars, spec.num_stars, value);
+				break;
+			}
+			case LOG_ARG_DOUBLE: {
+				double value = 0;
+				memcpy(&value, args, sizeof(value));
+				args += sizeof(value);
+				written = format_value(dst, rem, spec_buf, stars, spec.num_stars, value);
+				break;
+			}
+			case LOG_ARG_LONG_DOUBLE: {
+				long double value = 0;
+				memcpy(&value, args, sizeof(value));
+				args += sizeof(value);
+				written = format_value(dst, rem, spec_buf, stars, spec.num_stars, value);
+				break;
+			}
+			case LOG_ARG_PTR: {
+				const void *value = NULL;
+				memcpy(&value, args, sizeof(value));
+				args += sizeof(value);
+				written = format_value(dst, rem, spec_buf, stars, spec.num_stars, value);
+				break;
+			}
+			case LOG_ARG_STR:
+				written = format_value(dst, rem, spec_buf, stars, spec.num_stars, args);
+				args += strlen(args) + 1;
+				break;
+			default:
+				assert(0 && "Unknown argument kind");
+				break;
+		}
+		if (written > 0)
+			pos += (size_t) written;
+		c = end;
+	}
+
+	if (n > 0)
+		out[pos < n ? pos : n - 1] = '\0';
+	return pos;
+}
+
+static int format_piece(char *out, size_t n, const char *spec, ...)
+{
+	va_list args;
+	va_start(args, spec);
+	int written = vsnprintf(out, n, spec, args);
+	va_end(args);
+
+	return written;
+}
+
+template <typename T>
+static int format_value(char *out, size_t n, const char *spec, const int *stars,
+						size_t num_stars, T value)
+{
+	switch (num_stars) {
+		case 0:
+			return format_piece(out, n, spec, value);
+		case 1:
+			return format_piece(out, n, spec, stars[0], value);
+		default:
+			return format_piece(out, n, spec, stars[0], stars[1], value);
+	}
+}
+
+void log_put_varint(char *buf, size_t *len, size_t value)
+{
+	assert(buf);
+	assert(len);
+
+	while (value >= 0x80) {
+		buf[(*len)++] = (char) ((value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+	buf[(*len)++] = (char) value;
+}
+
+static bool get_varint(FILE *in, size_t *value)
+{
+	assert(in);
+	assert(value);
+
+	*value = 0;
+	for (unsigned shift = 0; shift < 8 * sizeof(size_t); shift += 7) {
+		int c = fgetc(in);
+		if (c == EOF)
+			return false;
+		*value |= (size_t) (c & 0x7F) << shift;
+		if (!(c & 0x80))
+			return true;
+	}
+	return false;
+}
+
+// whether the captured arguments of the format fit in len bytes
+static bool args_fit(const struct Log_format *format, const char *args, size_t len)
+{
+	assert(format);
+	assert(args);
+
+	size_t pos = 0;
+	for (size_t i = 0; i < format->num_args && pos <= len; i++) {
+		switch (format->kinds[i]) {
+			case LOG_ARG_INT:
+				pos += sizeof(int);
+				break;
+			case LOG_ARG_LONG:
+				pos += sizeof(long long);
+				break;
+			case LOG_ARG_DOUBLE:
+				pos += sizeof(double);
+				break;
+			case LOG_ARG_LONG_DOUBLE:
+				pos += sizeof(long double);
+				break;
+			case LOG_ARG_PTR:
+				pos += sizeof(void*);
+				break;
+			case LOG_ARG_STR:
+				if (pos >= len)
+					return false;
+				pos += strnlen(args + pos, len - pos) + 1;
+				break;
+			default:
+				return false;
+		}
+	}
+	return pos <= len;
+}
+
+// turns a binary log back into what a text handler without colors would have got
+enum Log_error log_binary_decode(FILE *in, FILE *out)
+{
+	assert(in);
+	assert(out);
+
+	enum Log_error err = NO_LOG_ERR;
+	struct Log_format *formats = NULL;
+	char **fmts = NULL;
+	size_t num_formats = 0;
+	size_t cap_formats = 0;
+	char *args = NULL;
+	char *text = NULL;
+	char prefix[LOG_MAX_PREFIX + 1] = "";
+
+	char magic[sizeof(LOG_BINARY_MAGIC)] = "";
+	if (fread(magic, sizeof(char), sizeof(LOG_BINARY_MAGIC) - 1, in) !=
+		sizeof(LOG_BINARY_MAGIC) - 1 || strcmp(magic, LOG_BINARY_MAGIC) != 0)
+		return ERR_FORMAT;
+	fprintf(out, "\tSTART OF LOG\n-----------------------------\n\n");
+
+	args = (char*) calloc(LOG_MAX_ARGS_SIZE + 1, sizeof(char));
+	text = (char*) calloc(LOG_MAX_MESSAGE, sizeof(char));
+	if (!args || !text) {
+		err = LOG_ERR_MEM;
+		goto finally;
+	}
+
+	int c;
+	while ((c = fgetc(in)) != EOF) {
+		if (c == LOG_BINARY_END) {
+			fprintf(out, "\n-----------------------------\n\tEND OF LOG\n");
+			continue;
+		}
+
+		size_t id = 0;
+		size_t len = 0;
+		if (c == LOG_BINARY_DEFINE) {
+			if (!get_varint(in, &id) || !get_varint(in, &len) || id != num_formats + 1) {
+				err = ERR_FORMAT;
+				goto finally;
+			}
+			char *fmt = (char*) calloc(len + 1, sizeof(char));
+			if (!fmt) {
+				err = LOG_ERR_MEM;
+				goto finally;
+			}
+			if (num_formats == cap_formats) {
+				size_t new_cap = cap_formats ? 2 * cap_formats : 64;
+				struct Log_format *tmp = (struct Log_format*)
+					realloc(formats, new_cap * sizeof(struct Log_format));
+				if (tmp)
+					formats = tmp;
+				char **tmp_fmts = (char**) realloc(fmts, new_cap * sizeof(char*));
+				if (tmp_fmts)
+					fmts = tmp_fmts;
+				if (!tmp || !tmp_fmts) {
+					free(fmt);
+					err = LOG_ERR_MEM;
+					goto finally;
+				}
+				cap_formats = new_cap;
+			}
+			fmts[num_formats] = fmt;
+			formats[num_formats].is_deferrable = false;
+			num_formats++;
+			if (fread(fmt, sizeof(char), len, in) != len) {
+				err = ERR_FORMAT;
+				goto finally;
+			}
+			log_format_parse(fmt, &formats[num_formats - 1]);
+			continue;
+		}
+
+		enum Log_level level = (enum Log_level) (c & LOG_BINARY_LEVEL_MASK);
+		unsigned prefix_kind = (unsigned) c >> LOG_BINARY_PREFIX_SHIFT & 0x03;
+		bool is_truncated = c & LOG_BINARY_TRUNCATED;
+
+		const char *pref = "";
+		if (prefix_kind == LOG_PREFIX_LEVEL) {
+			pref = log_level_prefix(level);
+		} else if (prefix_kind == LOG_PREFIX_CUSTOM) {
+			if (!get_varint(in, &len) || len > LOG_MAX_PREFIX ||
+				fread(prefix, sizeof(char), len, in) != len) {
+				err = ERR_FORMAT;
+				goto finally;
+			}
+			prefix[len] = '\0';
+			pref = prefix;
+		}
+
+		if (!get_varint(in, &id) || id > num_formats) {
+			err = ERR_FORMAT;
+			goto finally;
+		}
+		len = 0;
+		if ((id == 0 || formats[id - 1].num_args > 0) && !get_varint(in, &len)) {
+			err = ERR_FORMAT;
+			goto finally;
+		}
+		if (len > LOG_MAX_ARGS_SIZE || fread(args, sizeof(char), len, in) != len) {
+			err = ERR_FORMAT;
+			goto finally;
+		}
+		args[len] = '\0';
+
+		if (id == 0) {
+			fprintf(out, "%s%s", pref, args);
+		} else {
+			const struct Log_format *format = &formats[id - 1];
+			if (!format->is_deferrable || !args_fit(format, args, len)) {
+				err = ERR_FORMAT;
+				goto finally;
+			}
+			size_t text_len = log_format_args(format->fmt, args, text, LOG_MAX_MESSAGE);
+			fprintf(out, "%s%s", pref, text);
+			is_truncated = is_truncated || text_len > LOG_MAX_MESSAGE - 1;
+		}
+		if (is_truncated)
+			fputs(LOG_TRUNCATED_MSG, out);
+	}
+
+	finally:
+		for (size_t i = 0; i < num_formats; i++)
+			free(fmts[i]);
+		free(fmts);
+		free(formats);
+		free(args);
+		free(text);
+
+	return err;
+}
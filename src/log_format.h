@@ -0,0 +1,79 @@
+#ifndef _LOG_FORMAT_H
+#define _LOG_FORMAT_H
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "logger.h"
+
+/*
+ * Deferred formatting of log messages. The caller only copies the raw arguments
+ * of a printf-style format, and they are formatted later: by the writer thread
+ * for text handlers, or by log_decode from a binary log. The kinds of the
+ * arguments follow from the format itself, so the copy has no type tags.
+ *
+ * A binary log starts with LOG_BINARY_MAGIC and holds records:
+ *	 LOG_BINARY_DEFINE id len <len bytes>	defines the format with the given id
+ *	 LOG_BINARY_END							the logger was destroyed
+ *	 flags [len <prefix>] id [len] <args>	a message, id 0 means the args are text;
+ *											len is left out if the format takes no args
+ * Numbers are varints (7 bits per byte, low bits first). The flags byte holds the
+ * level in LOG_BINARY_LEVEL_MASK, the prefix kind (enum Log_prefix_kind) shifted
+ * by LOG_BINARY_PREFIX_SHIFT, and LOG_BINARY_TRUNCATED.
+ */
+enum Log_arg_kind {
+	LOG_ARG_INT,
+	LOG_ARG_LONG,
+	LOG_ARG_DOUBLE,
+	LOG_ARG_LONG_DOUBLE,
+	LOG_ARG_PTR,
+	LOG_ARG_STR,
+};
+
+enum Log_prefix_kind {
+	LOG_PREFIX_LEVEL	= 0,
+	LOG_PREFIX_NONE		= 1,
+	LOG_PREFIX_CUSTOM	= 2,
+};
+
+const size_t LOG_MAX_ARGS		= 16;
+// the longest conversion specification, like "%-+#012.*llx"
+const size_t LOG_MAX_SPEC		= 32;
+// strings of a message share this many bytes, which is all the text can hold
+const size_t LOG_MAX_STRINGS	= LOG_MAX_MESSAGE;
+const size_t LOG_MAX_ARGS_SIZE	= LOG_MAX_ARGS * sizeof(long double) + LOG_MAX_STRINGS +
+								  LOG_MAX_ARGS;
+const int LOG_PREC_NONE			= -1;
+const int LOG_PREC_STAR			= -2;
+
+const char LOG_BINARY_MAGIC[]			= "AKLOG1\n";
+const unsigned char LOG_BINARY_DEFINE	= 0xFF;
+const unsigned char LOG_BINARY_END		= 0xFE;
+const unsigned char LOG_BINARY_LEVEL_MASK	= 0x03;
+const unsigned LOG_BINARY_PREFIX_SHIFT		= 2;
+const unsigned char LOG_BINARY_TRUNCATED	= 0x10;
+// a varint of size_t takes at most this many bytes
+const size_t LOG_MAX_VARINT				= 10;
+
+const char *const LOG_TRUNCATED_MSG = "...message was truncated\n";
+
+/** The argument kinds of a format, computed once per format */
+struct Log_format {
+	const char *fmt;
+	/** Whether the format can be deferred, %n and positional arguments can't */
+	bool is_deferrable;
+	size_t num_args;
+	enum Log_arg_kind kinds[LOG_MAX_ARGS];
+	/** Precision of a string argument, LOG_PREC_NONE or LOG_PREC_STAR if not literal */
+	int precs[LOG_MAX_ARGS];
+};
+
+void log_format_parse(const char *fmt, struct Log_format *format);
+size_t log_args_capture(const struct Log_format *format, va_list args, char *out,
+						bool *is_truncated);
+size_t log_format_args(const char *fmt, const char *args, char *out, size_t n);
+
+void log_put_varint(char *buf, size_t *len, size_t value);
+enum Log_error log_binary_decode(FILE *in, FILE *out);
+
+#endif /*_LOG_FORMAT_H*/
@@ -1,53 +1,204 @@
 #include <stdlib.h>
+#include <string.h>
 #include <stdarg.h>
 #include <assert.h>
+#include <time.h>
 
 #include "colors.h"
 #include "logger.h"
+#include "log_format.h"
+#include "mem.h"
 
 struct Logger LOGGER;
 
+// the ring of the current thread and the logger_ctor() it belongs to
+static thread_local struct Log_ring *THREAD_RING = NULL;
+static thread_local unsigned long THREAD_RING_GEN = 0;
+
+// the argument kinds of recently used formats, direct-mapped by the pointer
+static const size_t LOG_FORMAT_CACHE_SIZE = 64;
+static thread_local struct Log_format FORMAT_CACHE[LOG_FORMAT_CACHE_SIZE] = {};
+
+static const size_t LOG_MAX_DATA = LOG_MAX_ARGS_SIZE > LOG_MAX_MESSAGE ?
+								   LOG_MAX_ARGS_SIZE : LOG_MAX_MESSAGE;
+static const size_t LOG_MAX_RECORD = (sizeof(struct Log_record) + LOG_MAX_PREFIX +
+									  LOG_MAX_DATA + 7) / 8 * 8;
+static const size_t LOG_RING_RECORDS = LOG_RING_SIZE / sizeof(struct Log_record);
+// a binary message without its data
+static const size_t LOG_MAX_BINARY_HEADER = 1 + 3 * LOG_MAX_VARINT + LOG_MAX_PREFIX;
+static const size_t LOG_INIT_FORMAT_IDS = 256;
+
 enum Log_error do_log(enum Log_level level, const char *prefix, const char *color,
 					  const char *message, va_list args);
+static enum Log_error log_sync(enum Log_level level, const char *prefix, const char *color,
+							   const char *message, va_list args);
+static bool log_enqueue(struct Log_ring *ring, enum Log_level level, const char *prefix,
+						const char *color, const char *message, va_list args, int *written);
+static enum Log_error log_text(enum Log_level level, const char *text, size_t len);
+static size_t log_enqueue_text(struct Log_ring *ring, enum Log_level level, const char *text,
+							   size_t len);
+static bool write_sync(enum Log_level level, const char *prefix, const char *color,
+					   const char *text, size_t len);
+static bool ring_reserve(struct Log_ring *ring, size_t head);
+static void ring_publish(struct Log_ring *ring, size_t head, size_t new_head);
+static bool builder_reserve(struct Log_builder *builder, size_t len);
+static struct Log_ring *get_thread_ring();
+static void release_ring(void *ring);
+static void *log_writer(void *arg);
+static void drain_rings();
+static int record_cmp(const void *a, const void *b);
+static void write_batch(struct Log_handler *handler, const struct Log_record **records,
+						size_t num_records);
+static void write_binary_batch(struct Log_handler *handler, const struct Log_record **records,
+							   size_t num_records);
+static const struct Log_format *get_format(const char *fmt);
+static size_t get_format_id(const char *fmt);
+static size_t encode_message(char *buf, enum Log_level level, const char *prefix,
+							 size_t prefix_len, bool is_truncated, size_t id,
+							 const char *data, size_t data_len);
 
 void logger_ctor()
 {
 	LOGGER.handlers = NULL;
 	LOGGER.num_handlers = 0;
+
+	LOGGER.rings = NULL;
+	LOGGER.drain = NULL;
+	LOGGER.drain_cap = 0;
+	LOGGER.next_seq = 0;
+	LOGGER.flush_requested = 0;
+	LOGGER.flush_done = 0;
+	LOGGER.write_failed = false;
+	LOGGER.min_level = LOG_LEVEL_NONE;
+	LOGGER.stop = false;
+	LOGGER.is_running = false;
+	LOGGER.generation++;
+
+	pthread_mutex_init(&LOGGER.lock, NULL);
+	pthread_cond_init(&LOGGER.wake, NULL);
+	pthread_cond_init(&LOGGER.drained, NULL);
+
+	LOGGER.formats = NULL;
+	LOGGER.num_formats = 0;
+	LOGGER.formats_cap = 0;
+	LOGGER.format_ids = NULL;
+	LOGGER.format_ids_cap = 0;
+
+	LOGGER.batch = (char*) mem_calloc(MEM_LOGGER, LOG_BATCH_SIZE, sizeof(char));
+	LOGGER.text = (char*) mem_calloc(MEM_LOGGER, LOG_MAX_MESSAGE, sizeof(char));
+	if (!LOGGER.batch || !LOGGER.text)
+		return;
+	if (pthread_key_create(&LOGGER.ring_key, release_ring) != 0)
+		return;
+	if (pthread_create(&LOGGER.writer, NULL, log_writer, NULL) != 0) {
+		pthread_key_delete(LOGGER.ring_key);
+		return;
+	}
+	__atomic_store_n(&LOGGER.is_running, true, __ATOMIC_RELEASE);
 }
 
 enum Log_error add_log_handler(struct Log_handler handler)
 {
+	// the messages logged before belong to the old handlers only
+	log_flush();
+	pthread_mutex_lock(&LOGGER.lock);
+
 	if (LOGGER.handlers == NULL) {
-		LOGGER.handlers = (Log_handler*) calloc(3, sizeof(Log_handler));
+		LOGGER.handlers = (Log_handler*) mem_calloc(MEM_LOGGER, 3, sizeof(Log_handler));
 		if (LOGGER.handlers == NULL) {
+			pthread_mutex_unlock(&LOGGER.lock);
 			return LOG_ERR_MEM;
 		}
 		LOGGER.capacity = 3;
 	} else if (LOGGER.capacity <= LOGGER.num_handlers) {
-		LOGGER.capacity += 3;
-		LOGGER.handlers = (Log_handler*) realloc(LOGGER.handlers, LOGGER.capacity *
-												 sizeof(Log_handler));
-		if (LOGGER.handlers == NULL)
+		Log_handler *handlers = (Log_handler*) mem_realloc(MEM_LOGGER, LOGGER.handlers,
+									LOGGER.capacity * sizeof(Log_handler),
+									(LOGGER.capacity + 3) * sizeof(Log_handler));
+		if (handlers == NULL) {
+			pthread_mutex_unlock(&LOGGER.lock);
 			return LOG_ERR_MEM;
+		}
+		LOGGER.handlers = handlers;
+		LOGGER.capacity += 3;
 	}
 
+	handler.num_formats = 0;
 	LOGGER.handlers[LOGGER.num_handlers] = handler;
+	if (handler.level < LOGGER.min_level)
+		__atomic_store_n(&LOGGER.min_level, handler.level, __ATOMIC_RELAXED);
 
-	fprintf(LOGGER.handlers[LOGGER.num_handlers].output,
-			"\tSTART OF LOG\n-----------------------------\n\n");
+	if (handler.is_binary)
+		fputs(LOG_BINARY_MAGIC, handler.output);
+	else
+		fprintf(handler.output, "\tSTART OF LOG\n-----------------------------\n\n");
 	LOGGER.num_handlers++;
 
+	pthread_mutex_unlock(&LOGGER.lock);
 	return NO_LOG_ERR;
 }
 
 void logger_dtor()
 {
-	for (size_t i = 0; i < LOGGER.num_handlers; i++)
-		fprintf(LOGGER.handlers[i].output,
-				"\n-----------------------------\n\tEND OF LOG\n");
-	
-	free(LOGGER.handlers);
+	if (LOGGER.is_running) {
+		__atomic_store_n(&LOGGER.is_running, false, __ATOMIC_RELEASE);
+		pthread_mutex_lock(&LOGGER.lock);
+		LOGGER.stop = true;
+		pthread_cond_signal(&LOGGER.wake);
+		pthread_mutex_unlock(&LOGGER.lock);
+		pthread_join(LOGGER.writer, NULL);
+		pthread_key_delete(LOGGER.ring_key);
+	}
+
+	for (size_t i = 0; i < LOGGER.num_handlers; i++) {
+		if (LOGGER.handlers[i].is_binary)
+			fputc(LOG_BINARY_END, LOGGER.handlers[i].output);
+		else
+			fprintf(LOGGER.handlers[i].output,
+					"\n-----------------------------\n\tEND OF LOG\n");
+	}
+
+	mem_free(MEM_LOGGER, LOGGER.handlers, LOGGER.capacity * sizeof(Log_handler));
+	LOGGER.handlers = NULL;
+	LOGGER.capacity = 0;
+	LOGGER.num_handlers = 0;
+	LOGGER.min_level = LOG_LEVEL_NONE;
+
+	while (LOGGER.rings) {
+		struct Log_ring *next = LOGGER.rings->next;
+		mem_free(MEM_LOGGER, LOGGER.rings->data, LOG_RING_SIZE + LOG_MAX_RECORD);
+		free(LOGGER.rings);
+		LOGGER.rings = next;
+	}
+	mem_free(MEM_LOGGER, LOGGER.drain, LOGGER.drain_cap * sizeof(struct Log_record*));
+	LOGGER.drain = NULL;
+	LOGGER.drain_cap = 0;
+	mem_free(MEM_LOGGER, LOGGER.batch, LOG_BATCH_SIZE);
+	LOGGER.batch = NULL;
+	mem_free(MEM_LOGGER, LOGGER.text, LOG_MAX_MESSAGE);
+	LOGGER.text = NULL;
+	mem_free(MEM_LOGGER, LOGGER.formats, LOGGER.formats_cap * sizeof(char*));
+	LOGGER.formats = NULL;
+	LOGGER.formats_cap = 0;
+	mem_free(MEM_LOGGER, LOGGER.format_ids, LOGGER.format_ids_cap * sizeof(size_t));
+	LOGGER.format_ids = NULL;
+	LOGGER.format_ids_cap = 0;
+
+	pthread_cond_destroy(&LOGGER.drained);
+	pthread_cond_destroy(&LOGGER.wake);
+	pthread_mutex_destroy(&LOGGER.lock);
+}
+
+void log_flush()
+{
+	if (!__atomic_load_n(&LOGGER.is_running, __ATOMIC_ACQUIRE))
+		return;
+
+	pthread_mutex_lock(&LOGGER.lock);
+	unsigned long long target = ++LOGGER.flush_requested;
+	pthread_cond_signal(&LOGGER.wake);
+	while (LOGGER.flush_done < target && !LOGGER.stop)
+		pthread_cond_wait(&LOGGER.drained, &LOGGER.lock);
+	pthread_mutex_unlock(&LOGGER.lock);
 }
 
 enum Log_error do_log(enum Log_level level, const char *prefix, const char *color,
@@ -57,84 +208,795 @@ enum Log_error do_log(enum Log_level level, const char *prefix, const char *colo
 	assert(prefix != NULL);
 	assert(color != NULL);
 
-	const size_t BUFF_SIZE = 1024;
-	char buff[BUFF_SIZE] = "";
-	
-	int written = vsnprintf(buff, BUFF_SIZE, message, args);
-	
-	bool error = 0;
+	// nothing is formatted or copied for a message no handler wants
+	if (!log_is_enabled(level))
+		return NO_LOG_ERR;
+
+	struct Log_ring *ring = get_thread_ring();
+	if (!ring)
+		return log_sync(level, prefix, color, message, args);
+
+	int written = 0;
+	bool is_queued = log_enqueue(ring, level, prefix, color, message, args, &written);
+	if (!is_queued)
+		return log_sync(level, prefix, color, message, args);
+
+	if (written > (int) LOG_MAX_MESSAGE - 1)
+		if (log_string(level, "...message was truncated\n") < 0)
+			return ERR_WRITE;
+
+	if (level >= ERROR)
+		log_flush();
+
+	if (__atomic_load_n(&LOGGER.write_failed, __ATOMIC_RELAXED))
+		return ERR_WRITE;
+	return NO_LOG_ERR;
+}
+
+// copies the arguments into the ring, the writer formats them later; the hot
+// path takes no lock and makes no call into the kernel
+static bool log_enqueue(struct Log_ring *ring, enum Log_level level, const char *prefix,
+						const char *color, const char *message, va_list args, int *written)
+{
+	assert(ring);
+	assert(written);
+
+	size_t head = ring->head;
+	if (!ring_reserve(ring, head))
+		return false;
+
+	struct Log_record *record = (struct Log_record*) (ring->data + head % LOG_RING_SIZE);
+	char *text = (char*) (record + 1);
+
+	size_t prefix_len = strnlen(prefix, LOG_MAX_PREFIX);
+	memcpy(text, prefix, prefix_len);
+
+	const struct Log_format *format = get_format(message);
+	size_t data_len = 0;
+	record->is_truncated = false;
+	*written = 0;
+	if (format->is_deferrable) {
+		record->fmt = message;
+		data_len = log_args_capture(format, args, text + prefix_len, &record->is_truncated);
+	} else {
+		record->fmt = NULL;
+		*written = vsnprintf(text + prefix_len, LOG_MAX_MESSAGE, message, args);
+		// a bad format still leaves what was formatted before it
+		data_len = strnlen(text + prefix_len, LOG_MAX_MESSAGE - 1);
+	}
+	size_t size = (sizeof(struct Log_record) + prefix_len + data_len + 7) / 8 * 8;
+
+	record->seq = __atomic_fetch_add(&LOGGER.next_seq, 1, __ATOMIC_RELAXED);
+	record->color = color;
+	record->level = level;
+	record->prefix_len = (unsigned) prefix_len;
+	record->data_len = (unsigned) data_len;
+	record->size = (unsigned) size;
+	ring_publish(ring, head, head + size);
+
+	return true;
+}
+
+// writes the text as log_string(level, "%s", text) would, the text may be longer
+// than a message
+static enum Log_error log_text(enum Log_level level, const char *text, size_t len)
+{
+	assert(text);
+
+	if (!log_is_enabled(level))
+		return NO_LOG_ERR;
+
+	struct Log_ring *ring = get_thread_ring();
+	size_t queued = ring ? log_enqueue_text(ring, level, text, len) : 0;
+	bool error = false;
+	if (queued < len)
+		error = !write_sync(level, "", RESET_COLOR, text + queued, len - queued);
+
+	if (level >= ERROR)
+		log_flush();
+
+	if (error || __atomic_load_n(&LOGGER.write_failed, __ATOMIC_RELAXED))
+		return ERR_WRITE;
+	return NO_LOG_ERR;
+}
+
+// cuts the text into preformatted records with consecutive seqs and publishes
+// them together, so that the writer can't put a message of another thread between
+// them; returns how much of the text was queued
+static size_t log_enqueue_text(struct Log_ring *ring, enum Log_level level, const char *text,
+							   size_t len)
+{
+	assert(ring);
+	assert(text);
+
+	const size_t part_len = LOG_MAX_MESSAGE - 1;
+	unsigned long long seq = __atomic_fetch_add(&LOGGER.next_seq,
+												(len + part_len - 1) / part_len,
+												__ATOMIC_RELAXED);
+
+	size_t start = ring->head;
+	size_t head = start;
+	size_t pos = 0;
+	while (pos < len) {
+		// a text longer than the ring goes in pieces after all
+		if (head + LOG_MAX_RECORD - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >
+			LOG_RING_SIZE) {
+			ring_publish(ring, start, head);
+			start = head;
+			if (!ring_reserve(ring, head))
+				return pos;
+		}
+
+		size_t data_len = len - pos < part_len ? len - pos : part_len;
+		size_t size = (sizeof(struct Log_record) + data_len + 7) / 8 * 8;
+		struct Log_record *record = (struct Log_record*) (ring->data + head % LOG_RING_SIZE);
+		record->seq = seq++;
+		record->color = RESET_COLOR;
+		record->fmt = NULL;
+		record->level = level;
+		record->prefix_len = 0;
+		record->data_len = (unsigned) data_len;
+		record->size = (unsigned) size;
+		record->is_truncated = false;
+		memcpy(record + 1, text + pos, data_len);
+
+		pos += data_len;
+		head += size;
+	}
+	ring_publish(ring, start, head);
+
+	return len;
+}
+
+// waits until the ring has room for the longest record at head; false if the
+// writer stopped
+static bool ring_reserve(struct Log_ring *ring, size_t head)
+{
+	assert(ring);
+
+	while (head + LOG_MAX_RECORD - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >
+		   LOG_RING_SIZE) {
+		log_flush();
+		if (!__atomic_load_n(&LOGGER.is_running, __ATOMIC_ACQUIRE))
+			return false;
+	}
+	return true;
+}
+
+// hands the records from head to new_head over to the writer
+static void ring_publish(struct Log_ring *ring, size_t head, size_t new_head)
+{
+	assert(ring);
+
+	if (new_head == head)
+		return;
+	__atomic_store_n(&ring->head, new_head, __ATOMIC_RELEASE);
+
+	// the writer drains on its own every interval, wake it early only once the
+	// ring is half full
+	size_t used = new_head - __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	if (used > LOG_RING_SIZE / 2 && used - (new_head - head) <= LOG_RING_SIZE / 2)
+		pthread_cond_signal(&LOGGER.wake);
+}
+
+static const struct Log_format *get_format(const char *fmt)
+{
+	struct Log_format *format = &FORMAT_CACHE[((size_t) fmt >> 3) % LOG_FORMAT_CACHE_SIZE];
+	if (format->fmt != fmt)
+		log_format_parse(fmt, format);
+	return format;
+}
+
+static struct Log_ring *get_thread_ring()
+{
+	if (!__atomic_load_n(&LOGGER.is_running, __ATOMIC_ACQUIRE))
+		return NULL;
+	if (THREAD_RING && THREAD_RING_GEN == LOGGER.generation)
+		return THREAD_RING;
+
+	pthread_mutex_lock(&LOGGER.lock);
+
+	struct Log_ring *ring = LOGGER.rings;
+	while (ring && __atomic_load_n(&ring->is_owned, __ATOMIC_ACQUIRE))
+		ring = ring->next;
+
+	if (!ring) {
+		const struct Log_record **drain = (const struct Log_record**)
+			mem_realloc(MEM_LOGGER, LOGGER.drain, LOGGER.drain_cap * sizeof(struct Log_record*),
+						(LOGGER.drain_cap + LOG_RING_RECORDS) * sizeof(struct Log_record*));
+		if (!drain) {
+			pthread_mutex_unlock(&LOGGER.lock);
+			return NULL;
+		}
+		LOGGER.drain = drain;
+		LOGGER.drain_cap += LOG_RING_RECORDS;
+
+		// head and tail sit on their own cache lines
+		ring = (struct Log_ring*) aligned_alloc(alignof(struct Log_ring),
+												sizeof(struct Log_ring));
+		if (!ring) {
+			pthread_mutex_unlock(&LOGGER.lock);
+			return NULL;
+		}
+		memset((void*) ring, 0, sizeof(struct Log_ring));
+		ring->data = (char*) mem_calloc(MEM_LOGGER, LOG_RING_SIZE + LOG_MAX_RECORD,
+										sizeof(char));
+		if (!ring->data) {
+			free(ring);
+			pthread_mutex_unlock(&LOGGER.lock);
+			return NULL;
+		}
+		ring->next = LOGGER.rings;
+		LOGGER.rings = ring;
+	}
+	__atomic_store_n(&ring->is_owned, true, __ATOMIC_RELAXED);
+
+	pthread_mutex_unlock(&LOGGER.lock);
+
+	pthread_setspecific(LOGGER.ring_key, ring);
+	THREAD_RING = ring;
+	THREAD_RING_GEN = LOGGER.generation;
+	return ring;
+}
+
+// called when a thread exits; what is left in the ring is still written
+static void release_ring(void *ring)
+{
+	assert(ring);
+
+	__atomic_store_n(&((struct Log_ring*) ring)->is_owned, false, __ATOMIC_RELEASE);
+}
+
+static void *log_writer(void *)
+{
+	pthread_mutex_lock(&LOGGER.lock);
+	while (true) {
+		unsigned long long requested = LOGGER.flush_requested;
+		bool stop = LOGGER.stop;
+
+		drain_rings();
+		LOGGER.flush_done = requested;
+		pthread_cond_broadcast(&LOGGER.drained);
+		if (stop)
+			break;
+
+		if (LOGGER.flush_requested == requested && !LOGGER.stop) {
+			struct timespec deadline = {};
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			deadline.tv_nsec += LOG_FLUSH_INTERVAL_MS * 1000000;
+			if (deadline.tv_nsec >= 1000000000) {
+				deadline.tv_sec++;
+				deadline.tv_nsec -= 1000000000;
+			}
+			pthread_cond_timedwait(&LOGGER.wake, &LOGGER.lock, &deadline);
+		}
+	}
+	pthread_mutex_unlock(&LOGGER.lock);
+
+	return NULL;
+}
+
+// must be called with LOGGER.lock held
+static void drain_rings()
+{
+	size_t num_records = 0;
+	for (struct Log_ring *ring = LOGGER.rings; ring; ring = ring->next) {
+		ring->drain_end = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		for (size_t pos = ring->tail; pos < ring->drain_end; ) {
+			const struct Log_record *record = (const struct Log_record*)
+											  (ring->data + pos % LOG_RING_SIZE);
+			LOGGER.drain[num_records++] = record;
+			pos += record->size;
+		}
+	}
+	if (num_records == 0)
+		return;
+
+	qsort(LOGGER.drain, num_records, sizeof(struct Log_record*), record_cmp);
 	for (size_t i = 0; i < LOGGER.num_handlers; i++) {
-		if (level < LOGGER.handlers[i].level)
-			continue;
-		
-		if (LOGGER.handlers[i].use_colors)
-			fprintf(LOGGER.handlers[i].output, "%s%s%s%s",
-					color, prefix, RESET_COLOR, buff);
+		if (LOGGER.handlers[i].is_binary)
+			write_binary_batch(&LOGGER.handlers[i], LOGGER.drain, num_records);
 		else
-			fprintf(LOGGER.handlers[i].output, "%s%s", prefix, buff);
+			write_batch(&LOGGER.handlers[i], LOGGER.drain, num_records);
+	}
+
+	for (struct Log_ring *ring = LOGGER.rings; ring; ring = ring->next)
+		__atomic_store_n(&ring->tail, ring->drain_end, __ATOMIC_RELEASE);
+}
 
-		error = error || ferror(LOGGER.handlers[i].output);
+static int record_cmp(const void *a, const void *b)
+{
+	unsigned long long seq_a = (*(const struct Log_record* const*) a)->seq;
+	unsigned long long seq_b = (*(const struct Log_record* const*) b)->seq;
+	return (seq_a > seq_b) - (seq_a < seq_b);
+}
+
+static void write_batch(struct Log_handler *handler, const struct Log_record **records,
+						size_t num_records)
+{
+	assert(handler);
+	assert(records);
+
+	size_t reset_len = handler->use_colors ? strlen(RESET_COLOR) : 0;
+	size_t truncated_len = strlen(LOG_TRUNCATED_MSG);
+	size_t len = 0;
+
+	for (size_t i = 0; i < num_records; i++) {
+		const struct Log_record *record = records[i];
+		if (record->level < handler->level)
+			continue;
+
+		const char *prefix = (const char*) (record + 1);
+		const char *text = prefix + record->prefix_len;
+		size_t text_len = record->data_len;
+		bool is_truncated = record->is_truncated;
+		if (record->fmt) {
+			text_len = log_format_args(record->fmt, text, LOGGER.text, LOG_MAX_MESSAGE);
+			if (text_len > LOG_MAX_MESSAGE - 1) {
+				text_len = LOG_MAX_MESSAGE - 1;
+				is_truncated = true;
+			}
+			text = LOGGER.text;
+		}
+
+		size_t color_len = handler->use_colors ? strlen(record->color) : 0;
+		size_t record_len = color_len + reset_len + record->prefix_len + text_len +
+							truncated_len;
+		if (len + record_len > LOG_BATCH_SIZE) {
+			fwrite(LOGGER.batch, sizeof(char), len, handler->output);
+			len = 0;
+		}
+
+		memcpy(LOGGER.batch + len, record->color, color_len);
+		len += color_len;
+		memcpy(LOGGER.batch + len, prefix, record->prefix_len);
+		len += record->prefix_len;
+		memcpy(LOGGER.batch + len, RESET_COLOR, reset_len);
+		len += reset_len;
+		memcpy(LOGGER.batch + len, text, text_len);
+		len += text_len;
+		// what log_string() would print after the message
+		if (is_truncated) {
+			memcpy(LOGGER.batch + len, LOG_TRUNCATED_MSG, truncated_len);
+			len += truncated_len;
+		}
 	}
 
-	if (written > (int) BUFF_SIZE - 1)
+	fwrite(LOGGER.batch, sizeof(char), len, handler->output);
+	fflush(handler->output);
+	if (ferror(handler->output))
+		__atomic_store_n(&LOGGER.write_failed, true, __ATOMIC_RELAXED);
+}
+
+static void write_binary_batch(struct Log_handler *handler, const struct Log_record **records,
+							   size_t num_records)
+{
+	assert(handler);
+	assert(records);
+
+	size_t len = 0;
+	for (size_t i = 0; i < num_records; i++) {
+		const struct Log_record *record = records[i];
+		if (record->level < handler->level)
+			continue;
+
+		size_t id = record->fmt ? get_format_id(record->fmt) : 0;
+		if (id > handler->num_formats) {
+			fwrite(LOGGER.batch, sizeof(char), len, handler->output);
+			len = 0;
+			for (; handler->num_formats < id; handler->num_formats++) {
+				const char *fmt = LOGGER.formats[handler->num_formats];
+				char def[1 + 2 * LOG_MAX_VARINT] = {(char) LOG_BINARY_DEFINE};
+				size_t def_len = 1;
+				log_put_varint(def, &def_len, handler->num_formats + 1);
+				log_put_varint(def, &def_len, strlen(fmt));
+				fwrite(def, sizeof(char), def_len, handler->output);
+				fputs(fmt, handler->output);
+			}
+		}
+
+		const char *prefix = (const char*) (record + 1);
+		const char *data = prefix + record->prefix_len;
+		size_t data_len = record->data_len;
+		bool is_truncated = record->is_truncated;
+		// without memory for the id the message goes as text
+		if (record->fmt && id == 0) {
+			data_len = log_format_args(record->fmt, data, LOGGER.text, LOG_MAX_MESSAGE);
+			if (data_len > LOG_MAX_MESSAGE - 1) {
+				data_len = LOG_MAX_MESSAGE - 1;
+				is_truncated = true;
+			}
+			data = LOGGER.text;
+		}
+
+		if (len + LOG_MAX_BINARY_HEADER + data_len > LOG_BATCH_SIZE) {
+			fwrite(LOGGER.batch, sizeof(char), len, handler->output);
+			len = 0;
+		}
+		len += encode_message(LOGGER.batch + len, record->level, prefix, record->prefix_len,
+							  is_truncated, id, data, data_len);
+	}
+
+	fwrite(LOGGER.batch, sizeof(char), len, handler->output);
+	fflush(handler->output);
+	if (ferror(handler->output))
+		__atomic_store_n(&LOGGER.write_failed, true, __ATOMIC_RELAXED);
+}
+
+// ids are global, so every binary handler shares one table
+static size_t get_format_id(const char *fmt)
+{
+	assert(fmt);
+
+	size_t mask = LOGGER.format_ids_cap - 1;
+	size_t slot = ((size_t) fmt >> 3) & mask;
+	if (LOGGER.format_ids) {
+		for (; LOGGER.format_ids[slot]; slot = (slot + 1) & mask)
+			if (LOGGER.formats[LOGGER.format_ids[slot] - 1] == fmt)
+				return LOGGER.format_ids[slot];
+	}
+
+	// keep the table at most half full
+	if (2 * (LOGGER.num_formats + 1) > LOGGER.format_ids_cap) {
+		size_t new_cap = LOGGER.format_ids_cap ? 2 * LOGGER.format_ids_cap :
+												 LOG_INIT_FORMAT_IDS;
+		size_t *ids = (size_t*) mem_calloc(MEM_LOGGER, new_cap, sizeof(size_t));
+		if (!ids)
+			return 0;
+		const char **formats = (const char**) mem_realloc(MEM_LOGGER, LOGGER.formats,
+														  LOGGER.formats_cap * sizeof(char*),
+														  new_cap / 2 * sizeof(char*));
+		if (!formats) {
+			mem_free(MEM_LOGGER, ids, new_cap * sizeof(size_t));
+			return 0;
+		}
+		LOGGER.formats = formats;
+		LOGGER.formats_cap = new_cap / 2;
+
+		for (size_t id = 1; id <= LOGGER.num_formats; id++) {
+			size_t pos = ((size_t) LOGGER.formats[id - 1] >> 3) & (new_cap - 1);
+			while (ids[pos])
+				pos = (pos + 1) & (new_cap - 1);
+			ids[pos] = id;
+		}
+		mem_free(MEM_LOGGER, LOGGER.format_ids, LOGGER.format_ids_cap * sizeof(size_t));
+		LOGGER.format_ids = ids;
+		LOGGER.format_ids_cap = new_cap;
+
+		mask = new_cap - 1;
+		slot = ((size_t) fmt >> 3) & mask;
+		while (LOGGER.format_ids[slot])
+			slot = (slot + 1) & mask;
+	}
+
+	LOGGER.formats[LOGGER.num_formats++] = fmt;
+	LOGGER.format_ids[slot] = LOGGER.num_formats;
+	return LOGGER.num_formats;
+}
+
+// id 0 means the data is text; returns the number of bytes written to buf
+static size_t encode_message(char *buf, enum Log_level level, const char *prefix,
+							 size_t prefix_len, bool is_truncated, size_t id,
+							 const char *data, size_t data_len)
+{
+	assert(buf);
+	assert(prefix);
+	assert(data);
+
+	enum Log_prefix_kind prefix_kind = LOG_PREFIX_CUSTOM;
+	if (level >= DEBUG && level <= ERROR) {
+		const char *level_prefix = log_level_prefix(level);
+		if (prefix_len == 0)
+			prefix_kind = LOG_PREFIX_NONE;
+		else if (prefix_len == strlen(level_prefix) &&
+				 memcmp(prefix, level_prefix, prefix_len) == 0)
+			prefix_kind = LOG_PREFIX_LEVEL;
+	}
+
+	size_t len = 0;
+	buf[len++] = (char) (((unsigned) level & LOG_BINARY_LEVEL_MASK) |
+						 (unsigned) prefix_kind << LOG_BINARY_PREFIX_SHIFT |
+						 (is_truncated ? LOG_BINARY_TRUNCATED : 0));
+	if (prefix_kind == LOG_PREFIX_CUSTOM) {
+		log_put_varint(buf, &len, prefix_len);
+		memcpy(buf + len, prefix, prefix_len);
+		len += prefix_len;
+	}
+	log_put_varint(buf, &len, id);
+	// every argument takes a byte at least, so the length of a format without
+	// arguments is left out
+	if (id == 0 || data_len > 0)
+		log_put_varint(buf, &len, data_len);
+	memcpy(buf + len, data, data_len);
+	return len + data_len;
+}
+
+// the path without the writer thread
+static enum Log_error log_sync(enum Log_level level, const char *prefix, const char *color,
+							   const char *message, va_list args)
+{
+	if (!LOGGER.handlers)
+		return NO_LOG_ERR;
+
+	char buff[LOG_MAX_MESSAGE] = "";
+
+	int written = vsnprintf(buff, LOG_MAX_MESSAGE, message, args);
+
+	bool error = !write_sync(level, prefix, color, buff, strnlen(buff, LOG_MAX_MESSAGE));
+
+	if (written > (int) LOG_MAX_MESSAGE - 1)
 		if (log_string(level, "...message was truncated\n") < 0)
 			return ERR_WRITE;
-	
+
 	if (error)
 		return ERR_WRITE;
 	return NO_LOG_ERR;
 }
 
-enum Log_error log_string(enum Log_level level, const char *message, ...)
+// a binary log gets the text in messages of LOG_MAX_MESSAGE - 1 bytes at most;
+// false if a handler failed
+static bool write_sync(enum Log_level level, const char *prefix, const char *color,
+					   const char *text, size_t len)
+{
+	assert(prefix);
+	assert(color);
+	assert(text);
+
+	size_t prefix_len = strnlen(prefix, LOG_MAX_PREFIX);
+	bool error = false;
+	pthread_mutex_lock(&LOGGER.lock);
+	for (size_t i = 0; i < LOGGER.num_handlers; i++) {
+		struct Log_handler *handler = &LOGGER.handlers[i];
+		if (level < handler->level)
+			continue;
+
+		if (handler->is_binary) {
+			char record[LOG_MAX_BINARY_HEADER + LOG_MAX_MESSAGE] = "";
+			size_t pos = 0;
+			do {
+				size_t data_len = len - pos < LOG_MAX_MESSAGE - 1 ? len - pos :
+																	 LOG_MAX_MESSAGE - 1;
+				size_t record_len = encode_message(record, level, prefix, prefix_len, false,
+												   0, text + pos, data_len);
+				fwrite(record, sizeof(char), record_len, handler->output);
+				pos += data_len;
+			} while (pos < len);
+		} else {
+			if (handler->use_colors)
+				fprintf(handler->output, "%s%.*s%s", color, (int) prefix_len, prefix,
+						RESET_COLOR);
+			else
+				fwrite(prefix, sizeof(char), prefix_len, handler->output);
+			fwrite(text, sizeof(char), len, handler->output);
+		}
+
+		error = error || ferror(handler->output);
+	}
+	pthread_mutex_unlock(&LOGGER.lock);
+
+	return !error;
+}
+
+enum Log_error log_builder_ctor(struct Log_builder *builder, enum Log_level level)
+{
+	assert(builder);
+
+	builder->level = level;
+	builder->buf = NULL;
+	builder->len = 0;
+	builder->cap = 0;
+	builder->is_enabled = log_is_enabled(level);
+	if (!builder->is_enabled)
+		return NO_LOG_ERR;
+
+	builder->buf = (char*) mem_calloc(MEM_LOGGER, LOG_BUILDER_INIT_CAP, sizeof(char));
+	if (!builder->buf) {
+		builder->is_enabled = false;
+		return LOG_ERR_MEM;
+	}
+	builder->cap = LOG_BUILDER_INIT_CAP;
+
+	return NO_LOG_ERR;
+}
+
+enum Log_error log_builder_dtor(struct Log_builder *builder)
+{
+	assert(builder);
+
+	enum Log_error err = log_builder_submit(builder);
+
+	mem_free(MEM_LOGGER, builder->buf, builder->cap);
+	builder->buf = NULL;
+	builder->cap = 0;
+	builder->is_enabled = false;
+
+	return err;
+}
+
+void log_builder_printf(struct Log_builder *builder, const char *format, ...)
+{
+	assert(builder);
+	assert(format);
+
+	if (!builder->is_enabled)
+		return;
+
+	va_list args;
+	va_start(args, format);
+	va_list args_copy;
+	va_copy(args_copy, args);
+
+	int written = vsnprintf(builder->buf + builder->len, builder->cap - builder->len,
+							format, args);
+	if (written >= 0 && (size_t) written >= builder->cap - builder->len) {
+		// vsnprintf needs room for the terminating zero; without memory for it
+		// the text is cut to what fits
+		builder_reserve(builder, (size_t) written + 1);
+		written = vsnprintf(builder->buf + builder->len, builder->cap - builder->len,
+							format, args_copy);
+		if (written >= 0 && (size_t) written >= builder->cap - builder->len)
+			written = (int) (builder->cap - builder->len - 1);
+	}
+	if (written > 0)
+		builder->len += (size_t) written;
+
+	va_end(args_copy);
+	va_end(args);
+
+	if (builder->len > LOG_BUILDER_MAX_LEN)
+		log_builder_submit(builder);
+}
+
+void log_builder_puts(struct Log_builder *builder, const char *str)
+{
+	assert(builder);
+	assert(str);
+
+	if (!builder->is_enabled)
+		return;
+
+	size_t len = strlen(str);
+	while (len > 0) {
+		builder_reserve(builder, len);
+		size_t part = builder->cap - builder->len < len ? builder->cap - builder->len : len;
+		memcpy(builder->buf + builder->len, str, part);
+		builder->len += part;
+		str += part;
+		len -= part;
+		if (builder->len > LOG_BUILDER_MAX_LEN || len > 0)
+			log_builder_submit(builder);
+	}
+}
+
+void log_builder_pad(struct Log_builder *builder, size_t num)
+{
+	assert(builder);
+
+	if (!builder->is_enabled)
+		return;
+
+	while (num > 0) {
+		builder_reserve(builder, num);
+		size_t part = builder->cap - builder->len < num ? builder->cap - builder->len : num;
+		memset(builder->buf + builder->len, ' ', part);
+		builder->len += part;
+		num -= part;
+		if (builder->len > LOG_BUILDER_MAX_LEN || num > 0)
+			log_builder_submit(builder);
+	}
+}
+
+enum Log_error log_builder_submit(struct Log_builder *builder)
+{
+	assert(builder);
+
+	if (!builder->is_enabled || builder->len == 0)
+		return NO_LOG_ERR;
+
+	enum Log_error err = log_text(builder->level, builder->buf, builder->len);
+	builder->len = 0;
+	return err;
+}
+
+// makes room for len more bytes; without memory for them what was built is
+// submitted to free the buffer, false if even that is not enough
+static bool builder_reserve(struct Log_builder *builder, size_t len)
+{
+	assert(builder);
+
+	if (builder->cap - builder->len >= len)
+		return true;
+
+	size_t new_cap = 2 * builder->cap;
+	while (new_cap - builder->len < len)
+		new_cap *= 2;
+	char *buf = (char*) mem_realloc(MEM_LOGGER, builder->buf, builder->cap, new_cap);
+	if (buf) {
+		builder->buf = buf;
+		builder->cap = new_cap;
+		return true;
+	}
+
+	log_builder_submit(builder);
+	return builder->cap >= len;
+}
+
+bool log_is_enabled(enum Log_level level)
+{
+	return (int) level >= LOG_LEVEL_FLOOR &&
+		   level >= __atomic_load_n(&LOGGER.min_level, __ATOMIC_RELAXED);
+}
+
+// the name is in parentheses, so that the macro of the same name isn't expanded
+enum Log_error (log_string)(enum Log_level level, const char *message, ...)
 {
 	assert(message != NULL);
 
 	va_list args;
 	va_start(args, message);
 
-	return do_log(level, "", RESET_COLOR, message, args);
+	enum Log_error status = do_log(level, "", RESET_COLOR, message, args);
+
+	va_end(args);
+
+	return status;
 }
 
-enum Log_error log_message(enum Log_level level, const char *message, ...)
+enum Log_error (log_message)(enum Log_level level, const char *message, ...)
 {
 	assert(message != NULL);
 
 	va_list args;
 	va_start(args, message);
 
-	enum Log_error status = NO_LOG_ERR;
+	enum Log_error status = do_log(level, log_level_prefix(level), log_level_color(level),
+								   message, args);
+
+	va_end(args);
+
+	return status;
+}
 
+const char *log_level_prefix(enum Log_level level)
+{
 	switch (level) {
 		case ERROR:
-			status = do_log(level, "[ERROR] ", RED, message, args);
-			break;
+			return "[ERROR] ";
 		case WARN:
-			status = do_log(level, "[WARNING] ", YELLOW, message, args);
-			break;
+			return "[WARNING] ";
 		case INFO:
-			status = do_log(level, "[INFO] ", BLUE, message, args);
-			break;
+			return "[INFO] ";
 		case DEBUG:
-			status = do_log(level, "[DEBUG] ", GREEN, message, args);
-			break;
+			return "[DEBUG] ";
 		default:
-			status = do_log(level, "[UNKNOWN] ", RED, message, args);
+			return "[UNKNOWN] ";
 	}
+}
 
-	va_end(args);
-
-	return status;
+const char *log_level_color(enum Log_level level)
+{
+	switch (level) {
+		case ERROR:
+			return RED;
+		case WARN:
+			return YELLOW;
+		case INFO:
+			return BLUE;
+		case DEBUG:
+			return GREEN;
+		default:
+			return RED;
+	}
 }
 
 enum Log_error log_test(bool is_succesful, int num_test, const char *message, ...) {
 	assert(message != NULL);
-	
+
 	va_list args;
 	va_start(args, message);
 
 	enum Log_error status = NO_LOG_ERR;
-	const size_t PREF_SIZE = 256;
-	char prefix[PREF_SIZE] = "";
+	char prefix[LOG_MAX_PREFIX] = "";
 
 	if (is_succesful) {
 		sprintf(prefix, "test %d OK", num_test);
@@ -144,5 +1006,7 @@ enum Log_error log_test(bool is_succesful, int num_test, const char *message, ..
 		status = do_log(ERROR, prefix, RED, message, args);
 	}
 
+	va_end(args);
+
 	return status;
 }
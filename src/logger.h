@@ -2,6 +2,7 @@
 #define LOGGER_MODULE
 
 #include <stdio.h>
+#include <pthread.h>
 
 /** An enum representing a logging level (DEBUG is least important, ERROR is most) */
 enum Log_level {
@@ -15,6 +16,22 @@ enum Log_level {
 	ERROR	=	3
 };
 
+/**
+* Call sites of log_message() and log_string() with a constant level below this
+* one are compiled out, arguments included. It is a number, 0 (DEBUG) to 3 (ERROR),
+* defaulting to DEBUG in debug builds (_DEBUG) and to INFO in release builds.
+*/
+#ifndef LOG_LEVEL_FLOOR
+#ifdef _DEBUG
+#define LOG_LEVEL_FLOOR 0
+#else
+#define LOG_LEVEL_FLOOR 1
+#endif
+#endif
+
+/** A level above every message, the minimum level of a logger without handlers */
+const unsigned LOG_LEVEL_NONE = ERROR + 1;
+
 /** An enum representing errors that may occur during logging */
 enum Log_error {
 	/** No error occured */
@@ -22,10 +39,73 @@ enum Log_error {
 	/** A handler couldn't be added to the logger because of a memory error */
 	LOG_ERR_MEM		=	-1,
 	/** An error happened while writing to a handler */
-	ERR_WRITE	=	-2
+	ERR_WRITE	=	-2,
+	/** A binary log is malformed */
+	ERR_FORMAT	=	-3
 };
 
-/** A struct representing the logger */
+/** Bytes in each thread's ring of pending records */
+const size_t LOG_RING_SIZE		= 1 << 16;
+/** The longest message, the rest is cut off */
+const size_t LOG_MAX_MESSAGE	= 1024;
+/** The longest prefix, the rest is cut off */
+const size_t LOG_MAX_PREFIX		= 256;
+/** Bytes the writer collects for a handler before writing them at once */
+const size_t LOG_BATCH_SIZE		= 1 << 16;
+/** How often the writer drains the rings when nobody asks it to */
+const long LOG_FLUSH_INTERVAL_MS = 10;
+
+/**
+* A pending message: the header is followed by prefix_len bytes of the prefix
+* and data_len bytes of data. The data is the raw arguments of fmt (see
+* log_format.h), or the formatted text without a terminating zero if fmt is NULL.
+*/
+struct Log_record {
+	/** The global order of the message, rings are merged by it */
+	unsigned long long seq;
+	/** The color of the prefix */
+	const char *color;
+	/** The format of the message, NULL if it was formatted by the caller */
+	const char *fmt;
+	/** The level of the message */
+	enum Log_level level;
+	/** Length of the prefix */
+	unsigned prefix_len;
+	/** Length of the data */
+	unsigned data_len;
+	/** Bytes from this record to the next one */
+	unsigned size;
+	/** Whether a string argument was cut off when it was copied */
+	bool is_truncated;
+};
+
+/**
+* A single-producer single-consumer ring of records. Only its thread moves head
+* and only the writer moves tail, so neither side takes a lock. Both count bytes
+* from the start and never wrap; a record is never split, the data has room for
+* one record past LOG_RING_SIZE instead.
+*/
+struct Log_ring {
+	/** LOG_RING_SIZE bytes and room for the longest record */
+	char *data;
+	/** Bytes ever written, moved by the owning thread */
+	alignas(64) size_t head;
+	/** Bytes ever drained, moved by the writer */
+	alignas(64) size_t tail;
+	/** Where the current drain ends, used by the writer only */
+	size_t drain_end;
+	/** Whether some thread is writing to this ring, a released ring is reused */
+	bool is_owned;
+	/** The next ring in the logger's list */
+	struct Log_ring *next;
+};
+
+/**
+* A struct representing the logger. Messages are formatted on the calling
+* thread into its ring, and a writer thread moves them to the handlers in
+* batches, so that logging doesn't wait for the files. ERROR messages wait
+* until they are written, so the last words before an abort are not lost.
+*/
 struct Logger {
 	/** A number of handlers (files with configuration) currently in the logger */
 	size_t num_handlers;
@@ -33,6 +113,56 @@ struct Logger {
 	size_t capacity;
 	/** A pointer to an arrat of handlers */
 	struct Log_handler *handlers;
+
+	/** Guards the handlers, the list of rings and the writer's state */
+	pthread_mutex_t lock;
+	/** Wakes the writer before its interval passes */
+	pthread_cond_t wake;
+	/** Broadcast by the writer after every drain */
+	pthread_cond_t drained;
+	/** The writer thread */
+	pthread_t writer;
+	/** Whether the writer runs, otherwise messages are written synchronously */
+	bool is_running;
+	/** Asks the writer to drain for the last time and exit */
+	bool stop;
+	/** Tells the rings of one logger_ctor() from those of an earlier one */
+	unsigned long generation;
+	/** Gives a thread's ring back when the thread exits */
+	pthread_key_t ring_key;
+
+	/** The seq of the next message */
+	unsigned long long next_seq;
+	/** Number of flushes asked for */
+	unsigned long long flush_requested;
+	/** Number of flushes done, every request up to it is written */
+	unsigned long long flush_done;
+	/** Whether a handler failed to write since the start */
+	bool write_failed;
+	/** The lowest level any handler wants, messages below it are dropped at once */
+	unsigned min_level;
+
+	/** The list of rings */
+	struct Log_ring *rings;
+	/** Records of one drain sorted by seq, room for every ring being full */
+	const struct Log_record **drain;
+	/** Amount of records drain has memory for */
+	size_t drain_cap;
+	/** The batch being written to a handler */
+	char *batch;
+	/** Where the writer formats a message for text handlers */
+	char *text;
+
+	/** Formats of binary logs by id - 1, ids are given in the order of first use */
+	const char **formats;
+	/** Number of formats with an id */
+	size_t num_formats;
+	/** Amount of formats the array has memory for */
+	size_t formats_cap;
+	/** Open addressing table from a format pointer to its id, 0 is an empty slot */
+	size_t *format_ids;
+	/** Size of format_ids, a power of two */
+	size_t format_ids_cap;
 };
 
 /** A struct representing log handler - a file that will receive logs */
@@ -43,16 +173,45 @@ struct Log_handler {
 	enum Log_level level;
 	/** Whether to write escape codes with foreground colors to this handler */ 
 	bool use_colors;
+	/** Whether to write the compact binary log that log_decode turns into text */
+	bool is_binary;
+	/** Number of format ids this binary handler got definitions for */
+	size_t num_formats;
 };
 
+/**
+* A message of many lines built piece by piece and submitted at once, so that
+* it costs one record per LOG_MAX_MESSAGE bytes instead of one per piece, and
+* messages of other threads don't get in between its lines
+*/
+struct Log_builder {
+	/** The level the message is logged with */
+	enum Log_level level;
+	/** The text built so far, without a terminating zero */
+	char *buf;
+	/** Length of the text */
+	size_t len;
+	/** Amount of bytes buf has memory for */
+	size_t cap;
+	/** Whether the level is logged at all, otherwise nothing is built */
+	bool is_enabled;
+};
+
+/** The initial capacity of a builder */
+const size_t LOG_BUILDER_INIT_CAP	= 4096;
+/** A longer text is submitted in parts, each part fits into a ring at once */
+const size_t LOG_BUILDER_MAX_LEN	= LOG_RING_SIZE / 4;
+
 /** 
-* Logger constructot - must be called before any use of the logger
+* Logger constructot - must be called before any use of the logger. Starts the
+* writer thread; if that fails the logger writes synchronously.
 */
 void logger_ctor();
 
 /** 
-* Logger destructor - must be called after logger is no longer needed. Doesn't close
-* the logger's handlers' files, they must be closed separately.
+* Logger destructor - must be called after logger is no longer needed, when no
+* other thread logs anymore. Writes everything pending. Doesn't close the logger's
+* handlers' files, they must be closed separately.
 */
 void logger_dtor();
 
@@ -65,15 +224,23 @@ void logger_dtor();
 */
 enum Log_error add_log_handler(struct Log_handler handler);
 
+/**
+* Waits until every message logged before the call is written to the handlers
+*/
+void log_flush();
+
 /**
 * Logs a message with a specified log level, adding a prefix and a color according
-* to this level
+* to this level. The message is written later by the writer thread, unless the
+* level is ERROR. Only the arguments are copied, so the format must stay alive
+* and unchanged while the logger runs (a string literal). Formats with %n or
+* positional arguments are formatted on the calling thread.
 *
 * @param [in] level a log level of this message (from DEBUG to ERROR)
 * @param [in] message a pointer to the message format string, composed as for printf
 * @param [in] ... values to print according to the message string (as in printf)
 *
-* @return error in case writing failed in one of the handlers, NO_LOG_ERROR otherwise
+* @return error in case writing failed in one of the handlers so far, NO_LOG_ERROR otherwise
 */
 enum Log_error log_message(enum Log_level level, const char *message, ...);
 
@@ -89,4 +256,42 @@ enum Log_error log_test(bool is_succesful, int num_test, const char *message, ..
 
 enum Log_error log_string(enum Log_level level, const char *message, ...);
 
+/**
+* Whether a message of the level would reach any handler, for callers that do
+* work to build a message
+*/
+bool log_is_enabled(enum Log_level level);
+
+/**
+* Starts building a message of the level; if the level isn't logged the builder
+* does nothing
+*
+* @return error if there is no memory for the text, NO_LOG_ERROR otherwise
+*/
+enum Log_error log_builder_ctor(struct Log_builder *builder, enum Log_level level);
+/** Submits what is left and frees the builder */
+enum Log_error log_builder_dtor(struct Log_builder *builder);
+/** Appends text composed as for printf, nothing is added before it */
+void log_builder_printf(struct Log_builder *builder, const char *format, ...);
+/** Appends a string */
+void log_builder_puts(struct Log_builder *builder, const char *str);
+/** Appends num spaces */
+void log_builder_pad(struct Log_builder *builder, size_t num);
+/**
+* Logs the text built so far as log_string() would and empties the builder
+*
+* @return error in case writing failed in one of the handlers so far, NO_LOG_ERROR otherwise
+*/
+enum Log_error log_builder_submit(struct Log_builder *builder);
+
+/** The prefix log_message() puts before messages of the level */
+const char *log_level_prefix(enum Log_level level);
+/** The color of the prefix of the level */
+const char *log_level_color(enum Log_level level);
+
+#define log_message(level, ...)														\
+	((int) (level) >= LOG_LEVEL_FLOOR ? (log_message)((level), __VA_ARGS__) : NO_LOG_ERR)
+#define log_string(level, ...)															\
+	((int) (level) >= LOG_LEVEL_FLOOR ? (log_string)((level), __VA_ARGS__) : NO_LOG_ERR)
+
 #endif
\ No newline at end of file
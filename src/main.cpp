@@ -1,5 +1,6 @@
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 
 #include "tree.h"
@@ -9,8 +10,23 @@
 #include "buffer.h"
 #include "cmd_args.h"
 #include "akinator.h"
+#include "tree_export.h"
+#include "similarity.h"
+#include "thread_pool.h"
+#include "name_index.h"
+#include "batch.h"
+#include "speech.h"
+#include "render.h"
+#include "selfplay.h"
+#include "trace.h"
+#include "metrics.h"
+#include "mem.h"
+#include "analyze.h"
+#include "bulk_import.h"
+#include "induce.h"
 
 enum Error {
+	RENDER_ERR = -6,
 	AK_ERR	 = -5,
 	FILE_ERR = -4,
 	ARG_ERR  = -3,
@@ -19,31 +35,98 @@ enum Error {
 	NO_ERR   =  0,
 };
 
+enum ProgramMode {
+	MODE_NONE		 = 0,
+	MODE_GUESS		 = 1,
+	MODE_COMPARISON	 = 2,
+	MODE_DESCRIPTION = 3,
+	MODE_EXPORT		 = 4,
+	MODE_SIMILARITY	 = 5,
+	MODE_QUERIES	 = 6,
+	MODE_SIMULATE	 = 7,
+	MODE_ANALYZE	 = 8,
+	MODE_IMPORT		 = 9,
+	MODE_INDUCE		 = 10,
+};
+
 struct CmdArgs {
 	const char *input_filename;
 	const char *output_filename;
 	const char *dump_filename;
 	const char *log_filename;
-	bool guess_mode; // enum
-	bool comparison_mode;
-	bool description_mode;
+	const char *export_filename;
+	const char *similarity_filename;
+	const char *matrix_filename;
+	const char *queries_filename;
+	const char *import_filename;
+	const char *table_filename;
+	const char *speak_cmd;
+	const char *render_cmd;
+	const char *trace_filename;
+	const char *metrics_filename;
+	enum ProgramMode mode;
+	enum ExportFormat export_format;
+	struct DumpOptions dump_opts;
+	size_t num_neighbors;
+	size_t num_threads;
+	size_t num_render_jobs;
+	size_t metrics_interval;
 	bool do_speak;
+	bool binary_log;
+	bool wait_renders;
+	bool use_dot;
+	bool print_stats;
+	bool print_mem;
+	bool assert_no_alloc;
 };
 
 enum ArgError handle_input_filename(const char *arg_str, void *processed_args);
 enum ArgError handle_output_filename(const char *arg_str, void *processed_args);
 enum ArgError handle_dump_filename(const char *arg_str, void *processed_args);
 enum ArgError handle_log_filename(const char *arg_str, void *processed_args);
+enum ArgError handle_binary_log(const char *arg_str, void *processed_args);
 enum ArgError handle_guess_mode(const char *arg_str, void *processed_args);
 enum ArgError handle_comparison_mode(const char *arg_str, void *processed_args);
 enum ArgError handle_description_mode(const char *arg_str, void *processed_args);
 enum ArgError handle_speaking_mode(const char *arg_str, void *processed_args);
-
+enum ArgError handle_export_mode(const char *arg_str, void *processed_args);
+enum ArgError handle_export_format(const char *arg_str, void *processed_args);
+enum ArgError handle_similarity_mode(const char *arg_str, void *processed_args);
+enum ArgError handle_matrix_filename(const char *arg_str, void *processed_args);
+enum ArgError handle_num_neighbors(const char *arg_str, void *processed_args);
+enum ArgError handle_num_threads(const char *arg_str, void *processed_args);
+enum ArgError handle_queries_mode(const char *arg_str, void *processed_args);
+enum ArgError handle_simulate_mode(const char *arg_str, void *processed_args);
+enum ArgError handle_analyze_mode(const char *arg_str, void *processed_args);
+enum ArgError handle_import_mode(const char *arg_str, void *processed_args);
+enum ArgError handle_induce_mode(const char *arg_str, void *processed_args);
+enum ArgError handle_trace_filename(const char *arg_str, void *processed_args);
+enum ArgError handle_stats(const char *arg_str, void *processed_args);
+enum ArgError handle_mem_report(const char *arg_str, void *processed_args);
+enum ArgError handle_assert_no_alloc(const char *arg_str, void *processed_args);
+enum ArgError handle_metrics_filename(const char *arg_str, void *processed_args);
+enum ArgError handle_metrics_interval(const char *arg_str, void *processed_args);
+enum ArgError handle_speak_cmd(const char *arg_str, void *processed_args);
+enum ArgError handle_render_cmd(const char *arg_str, void *processed_args);
+enum ArgError handle_render_jobs(const char *arg_str, void *processed_args);
+enum ArgError handle_wait_renders(const char *arg_str, void *processed_args);
+enum ArgError handle_dump_engine(const char *arg_str, void *processed_args);
+enum ArgError handle_dump_root(const char *arg_str, void *processed_args);
+enum ArgError handle_dump_depth(const char *arg_str, void *processed_args);
+enum ArgError handle_dump_max_nodes(const char *arg_str, void *processed_args);
+enum ArgError parse_count(const char *arg_str, size_t *count);
+
+enum Error load_tree(struct Node **tr, struct Buffer *buf, const char *filename);
+enum Error run_similarity(const struct Node *tr, const struct CmdArgs *args);
+enum Error run_simulation(const struct NameIndex *idx, const struct CmdArgs *args);
+enum Error run_analysis(const struct Node *tr);
+enum Error run_import(struct Node *tr, struct Buffer *records, const char *filename);
+enum Error run_induction(struct Node **tr, struct Buffer *table, const struct CmdArgs *args);
 void print_str(char *buf, const char *data, size_t n);
 
 const struct ArgDef arg_defs[] = {
-	{"input", 'i', "Name of the input database's file",
-	 false, false, handle_input_filename},
+	{"input", 'i', "Name of the input database's file. Required unless the tree is built with --induce",
+	 true, false, handle_input_filename},
 
 	{"output", 'o', "Name of the output database's file. Optional: if not specified, database won't be saved",
 	 true, false, handle_output_filename},
@@ -51,9 +134,51 @@ const struct ArgDef arg_defs[] = {
 	{"dump", 'p', "Name of the html dump file. Optional: if not specified, dump won't be generated",
 	 true, false, handle_dump_filename},
 
+	{"dump-engine", '\0', "How the dump is drawn: svg (default, in process) or dot (Graphviz, see --render-cmd)",
+	 true, false, handle_dump_engine},
+
+	{"render-cmd", '\0', "Command that turns the dump's DOT from stdin into an image on stdout (default \"dot -Tpng\")",
+	 true, false, handle_render_cmd},
+
+	{"render-jobs", '\0', "Number of dump images rendered at once. Optional: defaults to the number of CPUs",
+	 true, false, handle_render_jobs},
+
+	{"wait-renders", '\0', "Wait for the dump images at exit instead of leaving them to finish in the background",
+	 true, true, handle_wait_renders},
+
+	{"dump-root", '\0', "Draw only the subtree of the given object or question in the dump",
+	 true, false, handle_dump_root},
+
+	{"dump-depth", '\0', "Draw the dump only this many levels deep, deeper subtrees become their leaf counts",
+	 true, false, handle_dump_depth},
+
+	{"dump-max-nodes", '\0', "Draw at most this many nodes in the dump, breadth first; the rest become leaf counts",
+	 true, false, handle_dump_max_nodes},
+
 	{"log", 'l', "Name of the log file. Optional",
 	 true, false, handle_log_filename},
 
+	{"binary-log", '\0', "Write the log file in the compact binary format, log_decode turns it into text",
+	 true, true, handle_binary_log},
+
+	{"trace", '\0', "Write the time spent in each phase and worker task as Chrome trace events (chrome://tracing) to the given file",
+	 true, false, handle_trace_filename},
+
+	{"stats", '\0', "Print latency percentiles of load, save, guess steps, describe and compare at exit",
+	 true, true, handle_stats},
+
+	{"mem-report", '\0', "Print current and peak memory and allocation counts of nodes, node texts, buffers, stacks, paths, the logger and the name index at exit",
+	 true, true, handle_mem_report},
+
+	{"assert-no-alloc", '\0', "Abort if a describe or compare query allocates while answering, for testing",
+	 true, true, handle_assert_no_alloc},
+
+	{"metrics-file", '\0', "Keep latency metrics in the Prometheus text format in the given file, rewritten periodically",
+	 true, false, handle_metrics_filename},
+
+	{"metrics-interval", '\0', "Seconds between rewrites of the metrics file (default 10)",
+	 true, false, handle_metrics_interval},
+
 	{"guess", '\0', "Enable guessing mode",
 	 true, true, handle_guess_mode},
 
@@ -65,6 +190,42 @@ const struct ArgDef arg_defs[] = {
 
 	{"speak", 's', "Enable speaking",
 	 true, true, handle_speaking_mode},
+
+	{"speak-cmd", '\0', "Speech backend command, reads one utterance per line from stdin (default \"festival --tts\")",
+	 true, false, handle_speak_cmd},
+
+	{"export-definitions", '\0', "Export definitions of all objects to the given file",
+	 true, false, handle_export_mode},
+
+	{"export-format", '\0', "Format of the exported definitions: jsonl (default) or tsv",
+	 true, false, handle_export_format},
+
+	{"similarity", '\0', "Write the nearest neighbors of every object by shared path depth to the given file",
+	 true, false, handle_similarity_mode},
+
+	{"similarity-matrix", '\0', "Also write the pairwise shared depth matrix to the given file. Optional",
+	 true, false, handle_matrix_filename},
+
+	{"neighbors", 'k', "Number of nearest neighbors per object in similarity mode (default 5)",
+	 true, false, handle_num_neighbors},
+
+	{"queries", '\0', "Answer describe/compare queries from the given file, one per line: describe<TAB>name or compare<TAB>name<TAB>name",
+	 true, false, handle_queries_mode},
+
+	{"simulate", '\0', "Play a guessing game for every object with perfect answers, report unreachable objects and question counts",
+	 true, true, handle_simulate_mode},
+
+	{"analyze", '\0', "Print node counts, the depth histogram, mean leaf depths, the longest spine, duplicate names and memory use of the tree",
+	 true, true, handle_analyze_mode},
+
+	{"import", '\0', "Learn many objects at once from the given file, one per line: path of y/n answers<TAB>object<TAB>question",
+	 true, false, handle_import_mode},
+
+	{"induce", '\0', "Build the tree from the given CSV of objects and their answers instead of the input database: a header name,question,... and a row object,1/0,... per object",
+	 true, false, handle_induce_mode},
+
+	{"threads", 'j', "Number of worker threads. Optional: defaults to the number of CPUs",
+	 true, false, handle_num_threads},
 };
 const size_t ARG_DEFS_SIZE = sizeof(arg_defs) / sizeof(arg_defs[0]);
 const size_t ERR_BUF_SIZE = 1024;
@@ -76,15 +237,37 @@ int main(int argc, const char *argv[])
 
 	int ret_val = NO_ERR;
 
-	struct CmdArgs args = { NULL, NULL, NULL, NULL, false, false, false };
-	struct Buffer buf = {};
-	struct Buffer ans_buf = {};
+	struct CmdArgs args = {};
+	args.num_neighbors = SIM_DEFAULT_NEIGHBORS;
+	args.num_threads = pool_default_threads();
+	args.speak_cmd = SPEECH_DEFAULT_CMD;
+	args.render_cmd = RENDER_DEFAULT_CMD;
+	args.num_render_jobs = pool_default_threads();
+	args.metrics_interval = METRICS_DEFAULT_INTERVAL_MS / 1000;
+	struct Buffer buf = {NULL, NULL, 0, MEM_TEXT};
+	struct Buffer ans_buf = {NULL, NULL, 0, MEM_TEXT};
+	// the imported texts, which the tree points into
+	struct Buffer import_buf = {NULL, NULL, 0, MEM_TEXT};
 	struct Node *tr = NULL;
+	struct NameIndex name_idx = {};
+	struct Speech speech = {};
+	struct Speech *speaker = NULL;
+	struct Renderer renderer = {};
+	struct Renderer *dump_renderer = NULL;
 
 	char err_buf[ERR_BUF_SIZE] = {};
 	enum ArgError arg_err = ARG_NO_ERR;
 	enum BufferError buf_err = BUF_NO_ERR;
 	enum TreeIOError trio_err = TRIO_NO_ERR;
+	enum TreeExportError texp_err = TEXP_NO_ERR;
+	enum NameIndexError nidx_err = NIDX_NO_ERR;
+	enum BatchError batch_err = BATCH_NO_ERR;
+	enum SpeechError speech_err = SPEECH_NO_ERR;
+	enum RenderError render_err = RENDER_NO_ERR;
+	enum TraceError trace_err = TRACE_NO_ERR;
+	enum MetricsError metrics_err = METRICS_NO_ERR;
+	struct TraceSpan span = {};
+	uint64_t save_start = 0;
 	struct AkError ak_err = compose_err(AK_NO_ERR, "");
 
 	FILE *save_file = NULL;
@@ -100,30 +283,54 @@ int main(int argc, const char *argv[])
 	} else if (arg_err == ARG_HELP_CALLED) {
 		goto finally;
 	}
+	if (!args.input_filename == (args.mode != MODE_INDUCE)) {
+		log_message(ERROR, "The tree is either read with --input or built with --induce\n");
+		arg_show_usage(arg_defs, ARG_DEFS_SIZE, argv[0]);
+		ret_val = ARG_ERR;
+		goto finally;
+	}
 
 	if (args.log_filename) {
-		log_file = fopen(args.log_filename, "w");
+		log_file = fopen(args.log_filename, args.binary_log ? "wb" : "w");
 		if (!log_file) {
 			log_message(ERROR, "Couldn't read file %s\n", args.log_filename);
 			ret_val = FILE_ERR;
 			goto finally;
 		}
-		add_log_handler({log_file, DEBUG, false});
+		add_log_handler({log_file, DEBUG, false, args.binary_log});
 	}
 
-	buf_err = buffer_ctor(&buf);
-	if (buf_err < 0) {
-		log_message(ERROR, "Buffer error: %s\n", buffer_err_to_str(buf_err));
-		ret_val = BUF_ERR;
-		goto finally;
+	if (args.assert_no_alloc)
+		mem_assert_no_alloc(true);
+	if (args.print_stats || args.metrics_filename)
+		metrics_enable();
+	if (args.metrics_filename) {
+		metrics_err = metrics_start_export(args.metrics_filename,
+										   (long) args.metrics_interval * 1000);
+		if (metrics_err < 0) {
+			log_message(ERROR, "Couldn't export metrics to %s: %s\n", args.metrics_filename,
+						metrics_err_to_str(metrics_err));
+			ret_val = FILE_ERR;
+			goto finally;
+		}
 	}
-	buf_err = buffer_load_from_file(&buf, args.input_filename);
-	if (buf_err < 0) {
-		log_message(ERROR, "Couldn't read file %s: %s\n", args.input_filename,
-					buffer_err_to_str(buf_err));
-		ret_val = FILE_ERR;
-		goto finally;
+
+	if (args.trace_filename) {
+		trace_err = trace_start(args.trace_filename);
+		if (trace_err < 0) {
+			log_message(ERROR, "Couldn't start tracing to %s: %s\n", args.trace_filename,
+						trace_err_to_str(trace_err));
+			ret_val = FILE_ERR;
+			goto finally;
+		}
 	}
+
+	if (args.mode == MODE_INDUCE)
+		ret_val = run_induction(&tr, &import_buf, &args);
+	else
+		ret_val = load_tree(&tr, &buf, args.input_filename);
+	if (ret_val < 0)
+		goto finally;
 	buf_err = buffer_ctor(&ans_buf);
 	if (buf_err < 0) {
 		log_message(ERROR, "Buffer error: %s\n", buffer_err_to_str(buf_err));
@@ -131,14 +338,6 @@ int main(int argc, const char *argv[])
 		goto finally;
 	}
 
-	trio_err = tree_load_from_buf(&tr, &buf);
-	if (trio_err < 0) {
-		log_message(ERROR, "Tree input error: %s\n",
-					tree_io_err_to_str(trio_err));
-		ret_val = TRIO_ERR;
-		goto finally;
-	}
-
 	if (args.dump_filename) {
 		dump_html = tree_start_html_dump(args.dump_filename);
 		if (!dump_html) {
@@ -146,21 +345,111 @@ int main(int argc, const char *argv[])
 			ret_val = FILE_ERR;
 			goto finally;
 		}
-		TREE_DUMP_GUI(tr, dump_html, print_str);
+		if (args.use_dot) {
+			render_err = render_ctor(&renderer, args.render_cmd, args.num_render_jobs);
+			if (render_err < 0) {
+				log_message(ERROR, "Render error: %s\n", render_err_to_str(render_err));
+				ret_val = RENDER_ERR;
+				goto finally;
+			}
+			dump_renderer = &renderer;
+		}
+		TREE_DUMP_GUI(tr, dump_html, dump_renderer, &args.dump_opts, print_str);
 	}
 
-	if (args.guess_mode) {
-		ak_err = guess(&tr, &ans_buf, args.do_speak);
-	} else if (args.description_mode) {
-		ak_err = describe(tr, args.do_speak);
-	} else if (args.comparison_mode) {
-		ak_err = compare(tr, args.do_speak);
-	} else {
-		log_message(ERROR, "Program mode wasn't specified\n");
-		arg_show_usage(arg_defs, ARG_DEFS_SIZE, argv[0]);
-		ret_val = ARG_ERR;
-		goto finally;
+	if (args.mode == MODE_DESCRIPTION || args.mode == MODE_COMPARISON ||
+		args.mode == MODE_QUERIES || args.mode == MODE_SIMULATE) {
+		span = trace_begin("index");
+		nidx_err = name_index_ctor(&name_idx, tr);
+		trace_end(&span);
+		if (nidx_err < 0) {
+			log_message(ERROR, "Name index error: %s\n",
+						name_index_err_to_str(nidx_err));
+			ret_val = AK_ERR;
+			goto finally;
+		}
+	}
+
+	if (args.do_speak) {
+		speech_err = speech_ctor(&speech, args.speak_cmd);
+		if (speech_err < 0) {
+			log_message(ERROR, "Speech error: %s\n", speech_err_to_str(speech_err));
+			ret_val = AK_ERR;
+			goto finally;
+		}
+		speaker = &speech;
+	}
+
+	switch (args.mode) {
+		case MODE_GUESS:
+			span = trace_begin("guess");
+			ak_err = guess(&tr, &ans_buf, speaker);
+			break;
+		case MODE_DESCRIPTION:
+			span = trace_begin("describe");
+			ak_err = describe(tr, &name_idx, speaker);
+			break;
+		case MODE_COMPARISON:
+			span = trace_begin("compare");
+			ak_err = compare(tr, &name_idx, speaker);
+			break;
+		case MODE_EXPORT:
+			span = trace_begin("export");
+			texp_err = tree_export_definitions(tr, args.export_filename,
+											   args.export_format);
+			if (texp_err < 0) {
+				log_message(ERROR, "Couldn't export definitions to %s: %s\n",
+							args.export_filename, tree_export_err_to_str(texp_err));
+				ret_val = FILE_ERR;
+				goto finally;
+			}
+			break;
+		case MODE_SIMILARITY:
+			span = trace_begin("similarity");
+			ret_val = run_similarity(tr, &args);
+			if (ret_val < 0)
+				goto finally;
+			break;
+		case MODE_QUERIES:
+			span = trace_begin("queries");
+			batch_err = batch_run_queries(&name_idx, args.queries_filename, stdout,
+										  args.num_threads);
+			if (batch_err < 0) {
+				log_message(ERROR, "Couldn't answer queries from %s: %s\n",
+							args.queries_filename, batch_err_to_str(batch_err));
+				ret_val = batch_err == BATCH_FILE_ERR ? FILE_ERR : AK_ERR;
+				goto finally;
+			}
+			break;
+		case MODE_SIMULATE:
+			span = trace_begin("simulate");
+			ret_val = run_simulation(&name_idx, &args);
+			if (ret_val < 0)
+				goto finally;
+			break;
+		case MODE_ANALYZE:
+			span = trace_begin("analyze");
+			ret_val = run_analysis(tr);
+			if (ret_val < 0)
+				goto finally;
+			break;
+		case MODE_IMPORT:
+			span = trace_begin("import");
+			ret_val = run_import(tr, &import_buf, args.import_filename);
+			if (ret_val < 0)
+				goto finally;
+			break;
+		case MODE_INDUCE:
+			// the tree was built in place of loading it
+			break;
+		case MODE_NONE:
+		default:
+			log_message(ERROR, "Program mode wasn't specified\n");
+			arg_show_usage(arg_defs, ARG_DEFS_SIZE, argv[0]);
+			ret_val = ARG_ERR;
+			goto finally;
 	}
+	trace_end(&span);
 
 	if (ak_err.code < 0) {
 		ak_err_to_str(err_buf, ak_err, ERR_BUF_SIZE);
@@ -171,7 +460,7 @@ int main(int argc, const char *argv[])
 
 	if (dump_html) //{
 		//        +xx
-		TREE_DUMP_GUI(tr, dump_html, print_str);
+		TREE_DUMP_GUI(tr, dump_html, dump_renderer, &args.dump_opts, print_str);
 
 	if (args.output_filename) {
 		save_file = fopen(args.output_filename, "w");
@@ -180,15 +469,46 @@ int main(int argc, const char *argv[])
 			ret_val = FILE_ERR;
 			goto finally;
 		}
-		// maybe some errors?
-		tree_save(tr, save_file);
+		save_start = metrics_start();
+		span = trace_begin("save");
+		trio_err = tree_save(tr, save_file);
+		fflush(save_file);
+		trace_end(&span);
+		metrics_stop(METRIC_SAVE, save_start);
+		if (trio_err < 0) {
+			log_message(ERROR, "Tree output error: %s\n", tree_io_err_to_str(trio_err));
+			ret_val = TRIO_ERR;
+			goto finally;
+		}
 	}
 
 	finally:
+		speech_dtor(&speech);
+		render_dtor(&renderer, args.wait_renders);
+		metrics_err = metrics_stop_export();
+		if (metrics_err < 0) {
+			log_message(ERROR, "Couldn't write metrics to %s: %s\n", args.metrics_filename,
+						metrics_err_to_str(metrics_err));
+			ret_val = FILE_ERR;
+		}
+		// every thread that traced is joined by now
+		trace_err = trace_stop();
+		if (trace_err < 0) {
+			log_message(ERROR, "Couldn't write the trace to %s: %s\n", args.trace_filename,
+						trace_err_to_str(trace_err));
+			ret_val = FILE_ERR;
+		}
+		name_index_dtor(&name_idx);
 		node_op_delete(tr);
 		buffer_dtor(&buf);
 		buffer_dtor(&ans_buf);
+		buffer_dtor(&import_buf);
 		logger_dtor();
+		// after the logger, so that its last messages don't cut into the table
+		if (args.print_stats)
+			metrics_print_summary(stderr);
+		if (args.print_mem)
+			mem_print_report(stderr);
 		if (save_file)
 			fclose(save_file);
 		if (dump_html)
@@ -199,6 +519,149 @@ int main(int argc, const char *argv[])
 	return ret_val;
 }
 
+enum Error load_tree(struct Node **tr, struct Buffer *buf, const char *filename)
+{
+	assert(tr);
+	assert(buf);
+	assert(filename);
+
+	enum BufferError buf_err = buffer_ctor(buf);
+	if (buf_err < 0) {
+		log_message(ERROR, "Buffer error: %s\n", buffer_err_to_str(buf_err));
+		return BUF_ERR;
+	}
+	uint64_t load_start = metrics_start();
+	struct TraceSpan span = trace_begin("load_file");
+	buf_err = buffer_load_from_file(buf, filename);
+	trace_end(&span);
+	if (buf_err < 0) {
+		log_message(ERROR, "Couldn't read file %s: %s\n", filename, buffer_err_to_str(buf_err));
+		return FILE_ERR;
+	}
+
+	span = trace_begin("parse");
+	enum TreeIOError trio_err = tree_load_from_buf(tr, buf);
+	trace_end(&span);
+	metrics_stop(METRIC_LOAD, load_start);
+	if (trio_err < 0) {
+		log_message(ERROR, "Tree input error: %s\n", tree_io_err_to_str(trio_err));
+		return TRIO_ERR;
+	}
+	return NO_ERR;
+}
+
+enum Error run_similarity(const struct Node *tr, const struct CmdArgs *args)
+{
+	assert(args);
+
+	struct LeafIndex idx = {};
+	enum SimilarityError sim_err = leaf_index_ctor(&idx, tr);
+	if (sim_err < 0) {
+		log_message(ERROR, "Similarity error: %s\n", similarity_err_to_str(sim_err));
+		return AK_ERR;
+	}
+
+	sim_err = similarity_report(&idx, args->similarity_filename, args->matrix_filename,
+								args->num_neighbors, args->num_threads);
+	leaf_index_dtor(&idx);
+	if (sim_err < 0) {
+		log_message(ERROR, "Similarity error: %s\n", similarity_err_to_str(sim_err));
+		return sim_err == SIM_FILE_ERR ? FILE_ERR : AK_ERR;
+	}
+	return NO_ERR;
+}
+
+enum Error run_simulation(const struct NameIndex *idx, const struct CmdArgs *args)
+{
+	assert(idx);
+	assert(args);
+
+	struct SelfPlayReport report = {};
+	enum SelfPlayError play_err = selfplay_run(idx, args->num_threads, &report);
+	if (play_err < 0) {
+		log_message(ERROR, "Self-play error: %s\n", selfplay_err_to_str(play_err));
+		return AK_ERR;
+	}
+
+	selfplay_report_print(&report, stdout);
+	size_t num_unreachable = report.num_unreachable;
+	selfplay_report_dtor(&report);
+	if (num_unreachable > 0) {
+		log_message(ERROR, "%zu objects can't be guessed\n", num_unreachable);
+		return AK_ERR;
+	}
+	return NO_ERR;
+}
+
+enum Error run_analysis(const struct Node *tr)
+{
+	struct TreeStats stats = {};
+	enum AnalyzeError analyze_err = tree_analyze(tr, &stats);
+	if (analyze_err < 0) {
+		log_message(ERROR, "Analysis error: %s\n", analyze_err_to_str(analyze_err));
+		return AK_ERR;
+	}
+
+	tree_stats_print(&stats, stdout);
+	tree_stats_dtor(&stats);
+	return NO_ERR;
+}
+
+enum Error run_import(struct Node *tr, struct Buffer *records, const char *filename)
+{
+	assert(records);
+	assert(filename);
+
+	enum BufferError buf_err = buffer_load_from_file(records, filename);
+	if (buf_err < 0) {
+		log_message(ERROR, "Couldn't read file %s: %s\n", filename, buffer_err_to_str(buf_err));
+		return FILE_ERR;
+	}
+
+	struct ImportReport report = {};
+	enum BulkImportError import_err = bulk_import(tr, records, &report);
+	if (import_err < 0) {
+		log_message(ERROR, "Import error: %s\n", bulk_import_err_to_str(import_err));
+		return AK_ERR;
+	}
+
+	import_report_print(&report, stdout);
+	if (report.num_conflicts > 0 || report.num_invalid > 0) {
+		log_message(ERROR, "%zu of %zu records were rejected, nothing was imported\n",
+					report.num_conflicts + report.num_invalid, report.num_records);
+		return AK_ERR;
+	}
+	return NO_ERR;
+}
+
+enum Error run_induction(struct Node **tr, struct Buffer *table, const struct CmdArgs *args)
+{
+	assert(tr);
+	assert(table);
+	assert(args);
+
+	struct TraceSpan span = trace_begin("load_table");
+	enum BufferError buf_err = buffer_load_from_file(table, args->table_filename);
+	trace_end(&span);
+	if (buf_err < 0) {
+		log_message(ERROR, "Couldn't read file %s: %s\n", args->table_filename,
+					buffer_err_to_str(buf_err));
+		return FILE_ERR;
+	}
+
+	struct InduceReport report = {};
+	span = trace_begin("induce");
+	enum InduceError induce_err = tree_induce(tr, table, args->num_threads, &report);
+	trace_end(&span);
+	if (induce_err < 0) {
+		log_message(ERROR, "Induction error: %s\n", induce_err_to_str(induce_err));
+		return induce_err == INDUCE_FORMAT_ERR ? FILE_ERR : AK_ERR;
+	}
+
+	induce_report_print(&report, stdout);
+	return NO_ERR;
+}
+
 void print_str(char *buf, const char *data, size_t n)
 {
 	snprintf(buf, n, "%s", data);
@@ -235,27 +698,75 @@ enum ArgError handle_log_filename(const char *arg_str, void *processed_args)
 enum ArgError handle_guess_mode(const char */*arg_str*/, void *processed_args)
 {
 	struct CmdArgs *args = (struct CmdArgs*) processed_args;
-	if (args->comparison_mode || args->description_mode)
+	if (args->mode != MODE_NONE)
 		return ARG_WRONG_ARGS_ERR;
-	args->guess_mode = true;
+	args->mode = MODE_GUESS;
 	return ARG_NO_ERR;
 }
 
 enum ArgError handle_comparison_mode(const char */*arg_str*/, void *processed_args)
 {
 	struct CmdArgs *args = (struct CmdArgs*) processed_args;
-	if (args->guess_mode || args->description_mode)
+	if (args->mode != MODE_NONE)
 		return ARG_WRONG_ARGS_ERR;
-	args->comparison_mode = true;
+	args->mode = MODE_COMPARISON;
 	return ARG_NO_ERR;
 }
 
 enum ArgError handle_description_mode(const char */*arg_str*/, void *processed_args)
 {
 	struct CmdArgs *args = (struct CmdArgs*) processed_args;
-	if (args->guess_mode || args->comparison_mode)
+	if (args->mode != MODE_NONE)
 		return ARG_WRONG_ARGS_ERR;
-	args->description_mode = true;
+	args->mode = MODE_DESCRIPTION;
+	return ARG_NO_ERR;
+}
+
+enum ArgError handle_trace_filename(const char *arg_str, void *processed_args)
+{
+	struct CmdArgs *args = (struct CmdArgs*) processed_args;
+	args->trace_filename = arg_str;
+	return ARG_NO_ERR;
+}
+
+enum ArgError handle_stats(const char */*arg_str*/, void *processed_args)
+{
+	struct CmdArgs *args = (struct CmdArgs*) processed_args;
+	args->print_stats = true;
+	return ARG_NO_ERR;
+}
+
+enum ArgError handle_mem_report(const char */*arg_str*/, void *processed_args)
+{
+	struct CmdArgs *args = (struct CmdArgs*) processed_args;
+	args->print_mem = true;
+	return ARG_NO_ERR;
+}
+
+enum ArgError handle_assert_no_alloc(const char */*arg_str*/, void *processed_args)
+{
+	struct CmdArgs *args = (struct CmdArgs*) processed_args;
+	args->assert_no_alloc = true;
+	return ARG_NO_ERR;
+}
+
+enum ArgError handle_metrics_filename(const char *arg_str, void *processed_args)
+{
+	struct CmdArgs *args = (struct CmdArgs*) processed_args;
+	args->metrics_filename = arg_str;
+	return ARG_NO_ERR;
+}
+
+enum ArgError handle_metrics_interval(const char *arg_str, void *processed_args)
+{
+	struct CmdArgs *args = (struct CmdArgs*) processed_args;
+	return parse_count(arg_str, &args->metrics_interval);
+}
+
+enum ArgError handle_binary_log(const char */*arg_str*/, void *processed_args)
+{
+	struct CmdArgs *args = (struct CmdArgs*) processed_args;
+	args->binary_log = true;
 	return ARG_NO_ERR;
 }
 
@@ -265,3 +776,172 @@ enum ArgError handle_speaking_mode(const char */*arg_str*/, void *processed_args
 	args->do_speak = true;
 	return ARG_NO_ERR;
 }
+
+enum ArgError handle_speak_cmd(const char *arg_str, void *processed_args)
+{
+	struct CmdArgs *args = (struct CmdArgs*) processed_args;
+	args->speak_cmd = arg_str;
+	return ARG_NO_ERR;
+}
+
+enum ArgError handle_dump_engine(const char *arg_str, void *processed_args)
+{
+	struct CmdArgs *args = (struct CmdArgs*) processed_args;
+	if (strcmp(arg_str, "svg") == 0)
+		args->use_dot = false;
+	else if (strcmp(arg_str, "dot") == 0)
+		args->use_dot = true;
+	else
+		return ARG_WRONG_ARGS_ERR;
+	return ARG_NO_ERR;
+}
+
+enum ArgError handle_render_cmd(const char *arg_str, void *processed_args)
+{
+	struct CmdArgs *args = (struct CmdArgs*) processed_args;
+	args->render_cmd = arg_str;
+	return ARG_NO_ERR;
+}
+
+enum ArgError handle_render_jobs(const char *arg_str, void *processed_args)
+{
+	struct CmdArgs *args = (struct CmdArgs*) processed_args;
+	return parse_count(arg_str, &args->num_render_jobs);
+}
+
+enum ArgError handle_wait_renders(const char */*arg_str*/, void *processed_args)
+{
+	struct CmdArgs *args = (struct CmdArgs*) processed_args;
+	args->wait_renders = true;
+	return ARG_NO_ERR;
+}
+
+enum ArgError handle_dump_root(const char *arg_str, void *processed_args)
+{
+	struct CmdArgs *args = (struct CmdArgs*) processed_args;
+	args->dump_opts.root_name = arg_str;
+	return ARG_NO_ERR;
+}
+
+enum ArgError handle_dump_depth(const char *arg_str, void *processed_args)
+{
+	struct CmdArgs *args = (struct CmdArgs*) processed_args;
+	return parse_count(arg_str, &args->dump_opts.max_depth);
+}
+
+enum ArgError handle_dump_max_nodes(const char *arg_str, void *processed_args)
+{
+	struct CmdArgs *args = (struct CmdArgs*) processed_args;
+	return parse_count(arg_str, &args->dump_opts.max_nodes);
+}
+
+enum ArgError handle_export_mode(const char *arg_str, void *processed_args)
+{
+	struct CmdArgs *args = (struct CmdArgs*) processed_args;
+	if (args->mode != MODE_NONE)
+		return ARG_WRONG_ARGS_ERR;
+	args->mode = MODE_EXPORT;
+	args->export_filename = arg_str;
+	return ARG_NO_ERR;
+}
+
+enum ArgError handle_export_format(const char *arg_str, void *processed_args)
+{
+	struct CmdArgs *args = (struct CmdArgs*) processed_args;
+	if (strcmp(arg_str, "jsonl") == 0)
+		args->export_format = EXPORT_JSONL;
+	else if (strcmp(arg_str, "tsv") == 0)
+		args->export_format = EXPORT_TSV;
+	else
+		return ARG_WRONG_ARGS_ERR;
+	return ARG_NO_ERR;
+}
+
+enum ArgError handle_similarity_mode(const char *arg_str, void *processed_args)
+{
+	struct CmdArgs *args = (struct CmdArgs*) processed_args;
+	if (args->mode != MODE_NONE)
+		return ARG_WRONG_ARGS_ERR;
+	args->mode = MODE_SIMILARITY;
+	args->similarity_filename = arg_str;
+	return ARG_NO_ERR;
+}
+
+enum ArgError handle_matrix_filename(const char *arg_str, void *processed_args)
+{
+	struct CmdArgs *args = (struct CmdArgs*) processed_args;
+	args->matrix_filename = arg_str;
+	return ARG_NO_ERR;
+}
+
+enum ArgError handle_num_neighbors(const char *arg_str, void *processed_args)
+{
+	struct CmdArgs *args = (struct CmdArgs*) processed_args;
+	return parse_count(arg_str, &args->num_neighbors);
+}
+
+enum ArgError handle_num_threads(const char *arg_str, void *processed_args)
+{
+	struct CmdArgs *args = (struct CmdArgs*) processed_args;
+	return parse_count(arg_str, &args->num_threads);
+}
+
+enum ArgError handle_queries_mode(const char *arg_str, void *processed_args)
+{
+	struct CmdArgs *args = (struct CmdArgs*) processed_args;
+	if (args->mode != MODE_NONE)
+		return ARG_WRONG_ARGS_ERR;
+	args->mode = MODE_QUERIES;
+	args->queries_filename = arg_str;
+	return ARG_NO_ERR;
+}
+
+enum ArgError parse_count(const char *arg_str, size_t *count)
+{
+	assert(count);
+
+	char *end = NULL;
+	unsigned long val = strtoul(arg_str, &end, 10);
+	if (end == arg_str || *end != '\0' || val == 0)
+		return ARG_WRONG_ARGS_ERR;
+	*count = val;
+	return ARG_NO_ERR;
+}
+
+enum ArgError handle_simulate_mode(const char */*arg_str*/, void *processed_args)
+{
+	struct CmdArgs *args = (struct CmdArgs*) processed_args;
+	if (args->mode != MODE_NONE)
+		return ARG_WRONG_ARGS_ERR;
+	args->mode = MODE_SIMULATE;
+	return ARG_NO_ERR;
+}
+
+enum ArgError handle_analyze_mode(const char */*arg_str*/, void *processed_args)
+{
+	struct CmdArgs *args = (struct CmdArgs*) processed_args;
+	if (args->mode != MODE_NONE)
+		return ARG_WRONG_ARGS_ERR;
+	args->mode = MODE_ANALYZE;
+	return ARG_NO_ERR;
+}
+
+enum ArgError handle_import_mode(const char *arg_str, void *processed_args)
+{
+	struct CmdArgs *args = (struct CmdArgs*) processed_args;
+	if (args->mode != MODE_NONE)
+		return ARG_WRONG_ARGS_ERR;
+	args->mode = MODE_IMPORT;
+	args->import_filename = arg_str;
+	return ARG_NO_ERR;
+}
+
+enum ArgError handle_induce_mode(const char *arg_str, void *processed_args)
+{
+	struct CmdArgs *args = (struct CmdArgs*) processed_args;
+	if (args->mode != MODE_NONE)
+		return ARG_WRONG_ARGS_ERR;
+	args->mode = MODE_INDUCE;
+	args->table_filename = arg_str;
+	return ARG_NO_ERR;
+}
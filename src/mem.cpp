@@ -0,0 +1,150 @@
+#include <stdlib.h>
+#include <assert.h>
+
+#include "mem.h"
+
+static struct MemCounter MEM_COUNTERS[NUM_MEM_TAGS] = {};
+static struct MemCounter MEM_TOTAL = {};
+static bool MEM_ASSERT_NO_ALLOC = false;
+
+// how many no-alloc sections the current thread is in
+static thread_local int NO_ALLOC_DEPTH = 0;
+
+static const char *MEM_TAG_NAMES[NUM_MEM_TAGS] = {
+	"buffers",
+	"node_texts",
+	"nodes",
+	"stacks",
+	"paths",
+	"logger",
+	"name_index",
+};
+
+static void check_no_alloc(enum MemTag tag, size_t size);
+static void count_bytes(struct MemCounter *counter, size_t add, size_t sub);
+
+void *mem_calloc(enum MemTag tag, size_t num, size_t size)
+{
+	assert(tag < NUM_MEM_TAGS);
+
+	check_no_alloc(tag, num * size);
+	void *mem = calloc(num, size);
+	if (!mem)
+		return NULL;
+
+	count_bytes(&MEM_COUNTERS[tag], num * size, 0);
+	count_bytes(&MEM_TOTAL, num * size, 0);
+	__atomic_fetch_add(&MEM_COUNTERS[tag].num_allocs, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&MEM_TOTAL.num_allocs, 1, __ATOMIC_RELAXED);
+	return mem;
+}
+
+// old_size must be 0 for NULL, as the block is new then
+void *mem_realloc(enum MemTag tag, void *ptr, size_t old_size, size_t new_size)
+{
+	assert(tag < NUM_MEM_TAGS);
+	assert(ptr || old_size == 0);
+
+	check_no_alloc(tag, new_size);
+	void *mem = realloc(ptr, new_size);
+	if (!mem)
+		return NULL;
+
+	count_bytes(&MEM_COUNTERS[tag], new_size, old_size);
+	count_bytes(&MEM_TOTAL, new_size, old_size);
+	size_t *num = ptr ? &MEM_COUNTERS[tag].num_reallocs : &MEM_COUNTERS[tag].num_allocs;
+	size_t *total = ptr ? &MEM_TOTAL.num_reallocs : &MEM_TOTAL.num_allocs;
+	__atomic_fetch_add(num, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(total, 1, __ATOMIC_RELAXED);
+	return mem;
+}
+
+void mem_free(enum MemTag tag, void *ptr, size_t size)
+{
+	assert(tag < NUM_MEM_TAGS);
+
+	if (!ptr)
+		return;
+	free(ptr);
+
+	count_bytes(&MEM_COUNTERS[tag], 0, size);
+	count_bytes(&MEM_TOTAL, 0, size);
+	__atomic_fetch_add(&MEM_COUNTERS[tag].num_frees, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&MEM_TOTAL.num_frees, 1, __ATOMIC_RELAXED);
+}
+
+static void count_bytes(struct MemCounter *counter, size_t add, size_t sub)
+{
+	assert(counter);
+
+	if (add < sub) {
+		__atomic_fetch_sub(&counter->cur_bytes, sub - add, __ATOMIC_RELAXED);
+		return;
+	}
+	size_t cur = __atomic_add_fetch(&counter->cur_bytes, add - sub, __ATOMIC_RELAXED);
+	size_t peak = __atomic_load_n(&counter->peak_bytes, __ATOMIC_RELAXED);
+	while (cur > peak && !__atomic_compare_exchange_n(&counter->peak_bytes, &peak, cur, true,
+													  __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+struct MemCounter mem_counter(enum MemTag tag)
+{
+	assert(tag < NUM_MEM_TAGS);
+
+	const struct MemCounter *counter = &MEM_COUNTERS[tag];
+	return {__atomic_load_n(&counter->cur_bytes, __ATOMIC_RELAXED),
+			__atomic_load_n(&counter->peak_bytes, __ATOMIC_RELAXED),
+			__atomic_load_n(&counter->num_allocs, __ATOMIC_RELAXED),
+			__atomic_load_n(&counter->num_reallocs, __ATOMIC_RELAXED),
+			__atomic_load_n(&counter->num_frees, __ATOMIC_RELAXED)};
+}
+
+// bytes still allocated at exit are leaks or blocks freed with a wrong size
+void mem_print_report(FILE *out)
+{
+	assert(out);
+
+	fputs("subsystem\tcur_bytes\tpeak_bytes\tallocs\treallocs\tfrees\n", out);
+	for (size_t tag = 0; tag < NUM_MEM_TAGS; tag++) {
+		struct MemCounter counter = mem_counter((enum MemTag) tag);
+		fprintf(out, "%s\t%zu\t%zu\t%zu\t%zu\t%zu\n", MEM_TAG_NAMES[tag], counter.cur_bytes,
+				counter.peak_bytes, counter.num_allocs, counter.num_reallocs,
+				counter.num_frees);
+	}
+	fprintf(out, "total\t%zu\t%zu\t%zu\t%zu\t%zu\n",
+			__atomic_load_n(&MEM_TOTAL.cur_bytes, __ATOMIC_RELAXED),
+			__atomic_load_n(&MEM_TOTAL.peak_bytes, __ATOMIC_RELAXED),
+			__atomic_load_n(&MEM_TOTAL.num_allocs, __ATOMIC_RELAXED),
+			__atomic_load_n(&MEM_TOTAL.num_reallocs, __ATOMIC_RELAXED),
+			__atomic_load_n(&MEM_TOTAL.num_frees, __ATOMIC_RELAXED));
+}
+
+void mem_assert_no_alloc(bool is_on)
+{
+	__atomic_store_n(&MEM_ASSERT_NO_ALLOC, is_on, __ATOMIC_RELAXED);
+}
+
+void mem_no_alloc_begin()
+{
+	NO_ALLOC_DEPTH++;
+}
+
+void mem_no_alloc_end()
+{
+	assert(NO_ALLOC_DEPTH > 0);
+
+	NO_ALLOC_DEPTH--;
+}
+
+// written to stderr rather than logged: the logger allocates as well, and may
+// be the one allocating while holding its lock
+static void check_no_alloc(enum MemTag tag, size_t size)
+{
+	if (NO_ALLOC_DEPTH == 0 || !__atomic_load_n(&MEM_ASSERT_NO_ALLOC, __ATOMIC_RELAXED))
+		return;
+
+	fprintf(stderr, "A %zu byte allocation of %s in code that must not allocate\n", size,
+			MEM_TAG_NAMES[tag]);
+	abort();
+}
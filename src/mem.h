@@ -0,0 +1,48 @@
+#ifndef _MEM_H
+#define _MEM_H
+
+#include <stdio.h>
+
+/*
+ * Tagged allocation of the project's own memory, for attributing it to
+ * subsystems. Every mem_calloc(), mem_realloc() and mem_free() names the
+ * subsystem and the size of the block, the way sized deallocation does, so
+ * blocks carry no header; the caller already knows the sizes. Current and
+ * peak bytes and the counts of allocations, reallocations and frees are kept
+ * per tag with relaxed atomics and printed by mem_print_report().
+ *
+ * mem_no_alloc_begin() and mem_no_alloc_end() mark code of the calling thread
+ * that must not allocate. After mem_assert_no_alloc(true) an allocation in
+ * such code is reported and aborts; otherwise the marks cost a thread local
+ * increment each.
+ */
+enum MemTag {
+	// 0, so that a zeroed struct Buffer is a plain buffer
+	MEM_BUFFER,
+	MEM_TEXT,
+	MEM_NODE,
+	MEM_STACK,
+	MEM_PATH,
+	MEM_LOGGER,
+	MEM_INDEX,
+	NUM_MEM_TAGS,
+};
+
+struct MemCounter {
+	size_t cur_bytes;
+	size_t peak_bytes;
+	size_t num_allocs;
+	size_t num_reallocs;
+	size_t num_frees;
+};
+
+void *mem_calloc(enum MemTag tag, size_t num, size_t size);
+void *mem_realloc(enum MemTag tag, void *ptr, size_t old_size, size_t new_size);
+void mem_free(enum MemTag tag, void *ptr, size_t size);
+struct MemCounter mem_counter(enum MemTag tag);
+void mem_print_report(FILE *out);
+void mem_assert_no_alloc(bool is_on);
+void mem_no_alloc_begin();
+void mem_no_alloc_end();
+
+#endif /*_MEM_H*/
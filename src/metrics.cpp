@@ -0,0 +1,247 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include "metrics.h"
+#include "logger.h"
+
+static struct Metrics METRICS = {};
+
+struct MetricInfo {
+	const char *name;
+	const char *help;
+};
+
+static const struct MetricInfo METRIC_INFO[NUM_METRICS] = {
+	{"load",		"Time to read and parse the database"},
+	{"save",		"Time to write the database"},
+	{"guess_step",	"Time from an answer in guess to the next prompt"},
+	{"describe",	"Time to answer a describe request"},
+	{"compare",		"Time to answer a compare request"},
+};
+
+static const double SUMMARY_QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+
+static size_t bucket_of(uint64_t ns);
+static uint64_t bucket_top(size_t bucket);
+static uint64_t now_ns();
+static void *export_loop(void *arg);
+
+void metrics_enable()
+{
+	__atomic_store_n(&METRICS.is_on, true, __ATOMIC_RELAXED);
+}
+
+// the start of a timed operation, 0 if nothing is recorded
+uint64_t metrics_start()
+{
+	if (!__atomic_load_n(&METRICS.is_on, __ATOMIC_RELAXED))
+		return 0;
+	return now_ns();
+}
+
+void metrics_stop(enum MetricId id, uint64_t start_ns)
+{
+	if (start_ns)
+		metrics_record(id, now_ns() - start_ns);
+}
+
+void metrics_record(enum MetricId id, uint64_t ns)
+{
+	assert(id < NUM_METRICS);
+
+	struct Histogram *hist = &METRICS.hists[id];
+	__atomic_fetch_add(&hist->counts[bucket_of(ns)], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&hist->count, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&hist->sum_ns, ns, __ATOMIC_RELAXED);
+
+	uint64_t max_ns = __atomic_load_n(&hist->max_ns, __ATOMIC_RELAXED);
+	while (ns > max_ns && !__atomic_compare_exchange_n(&hist->max_ns, &max_ns, ns, true,
+													   __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+// the smallest recorded value that quantile of the values don't exceed, to
+// within a bucket
+uint64_t histogram_percentile(const struct Histogram *hist, double quantile)
+{
+	assert(hist);
+
+	uint64_t count = __atomic_load_n(&hist->count, __ATOMIC_RELAXED);
+	if (count == 0)
+		return 0;
+	uint64_t rank = (uint64_t) (quantile * (double) count + 0.5);
+	if (rank == 0)
+		rank = 1;
+
+	uint64_t max_ns = __atomic_load_n(&hist->max_ns, __ATOMIC_RELAXED);
+	uint64_t seen = 0;
+	for (size_t bucket = 0; bucket < METRICS_BUCKETS; bucket++) {
+		seen += __atomic_load_n(&hist->counts[bucket], __ATOMIC_RELAXED);
+		if (seen >= rank) {
+			uint64_t top = bucket_top(bucket);
+			return top < max_ns ? top : max_ns;
+		}
+	}
+	return max_ns;
+}
+
+void metrics_print_summary(FILE *out)
+{
+	assert(out);
+
+	fputs("operation\tcount\tmean_us\tp50_us\tp90_us\tp99_us\tp99.9_us\tmax_us\n", out);
+	for (size_t id = 0; id < NUM_METRICS; id++) {
+		const struct Histogram *hist = &METRICS.hists[id];
+		uint64_t count = __atomic_load_n(&hist->count, __ATOMIC_RELAXED);
+		double mean = count ? (double) __atomic_load_n(&hist->sum_ns, __ATOMIC_RELAXED) /
+							  (double) count : 0;
+
+		fprintf(out, "%s\t%" PRIu64 "\t%.1f", METRIC_INFO[id].name, count, mean / 1e3);
+		for (size_t i = 0; i < sizeof(SUMMARY_QUANTILES) / sizeof(SUMMARY_QUANTILES[0]); i++)
+			fprintf(out, "\t%.1f", (double) histogram_percentile(hist, SUMMARY_QUANTILES[i]) / 1e3);
+		fprintf(out, "\t%.1f\n", (double) __atomic_load_n(&hist->max_ns, __ATOMIC_RELAXED) / 1e3);
+	}
+}
+
+enum MetricsError metrics_write_prometheus(const char *filename)
+{
+	assert(filename);
+
+	char tmp_name[METRICS_NAME_SIZE + sizeof(".tmp")] = {};
+	snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", filename);
+	FILE *out = fopen(tmp_name, "w");
+	if (!out)
+		return METRICS_FILE_ERR;
+
+	for (size_t id = 0; id < NUM_METRICS; id++) {
+		const struct Histogram *hist = &METRICS.hists[id];
+		const char *name = METRIC_INFO[id].name;
+
+		fprintf(out, "# HELP akinator_%s_seconds %s\n", name, METRIC_INFO[id].help);
+		fprintf(out, "# TYPE akinator_%s_seconds summary\n", name);
+		for (size_t i = 0; i < sizeof(SUMMARY_QUANTILES) / sizeof(SUMMARY_QUANTILES[0]); i++)
+			fprintf(out, "akinator_%s_seconds{quantile=\"%g\"} %.9f\n", name,
+					SUMMARY_QUANTILES[i],
+					(double) histogram_percentile(hist, SUMMARY_QUANTILES[i]) / 1e9);
+		fprintf(out, "akinator_%s_seconds_sum %.9f\n", name,
+				(double) __atomic_load_n(&hist->sum_ns, __ATOMIC_RELAXED) / 1e9);
+		fprintf(out, "akinator_%s_seconds_count %" PRIu64 "\n", name,
+				__atomic_load_n(&hist->count, __ATOMIC_RELAXED));
+	}
+
+	bool is_ok = !ferror(out);
+	if (fclose(out) != 0 || !is_ok || rename(tmp_name, filename) != 0) {
+		remove(tmp_name);
+		return METRICS_FILE_ERR;
+	}
+	return METRICS_NO_ERR;
+}
+
+enum MetricsError metrics_start_export(const char *filename, long interval_ms)
+{
+	assert(filename);
+	assert(interval_ms > 0);
+
+	if (strlen(filename) >= METRICS_NAME_SIZE)
+		return METRICS_FILE_ERR;
+	strcpy(METRICS.export_name, filename);
+	METRICS.interval_ms = interval_ms;
+	METRICS.stop = false;
+	pthread_mutex_init(&METRICS.lock, NULL);
+	pthread_cond_init(&METRICS.wake, NULL);
+
+	if (pthread_create(&METRICS.exporter, NULL, export_loop, NULL) != 0) {
+		pthread_mutex_destroy(&METRICS.lock);
+		pthread_cond_destroy(&METRICS.wake);
+		return METRICS_THREAD_ERR;
+	}
+	METRICS.is_exporting = true;
+	return METRICS_NO_ERR;
+}
+
+// stops the periodic export and writes the file once more, with everything
+enum MetricsError metrics_stop_export()
+{
+	if (!METRICS.is_exporting)
+		return METRICS_NO_ERR;
+
+	pthread_mutex_lock(&METRICS.lock);
+	METRICS.stop = true;
+	pthread_cond_signal(&METRICS.wake);
+	pthread_mutex_unlock(&METRICS.lock);
+	pthread_join(METRICS.exporter, NULL);
+
+	pthread_mutex_destroy(&METRICS.lock);
+	pthread_cond_destroy(&METRICS.wake);
+	METRICS.is_exporting = false;
+	return metrics_write_prometheus(METRICS.export_name);
+}
+
+static void *export_loop(void */*arg*/)
+{
+	pthread_mutex_lock(&METRICS.lock);
+	while (!METRICS.stop) {
+		struct timespec deadline = {};
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += METRICS.interval_ms / 1000;
+		deadline.tv_nsec += METRICS.interval_ms % 1000 * 1000000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+		if (pthread_cond_timedwait(&METRICS.wake, &METRICS.lock, &deadline) == 0 ||
+			METRICS.stop)
+			continue;
+
+		pthread_mutex_unlock(&METRICS.lock);
+		if (metrics_write_prometheus(METRICS.export_name) < 0)
+			log_message(WARN, "Couldn't write metrics to %s\n", METRICS.export_name);
+		pthread_mutex_lock(&METRICS.lock);
+	}
+	pthread_mutex_unlock(&METRICS.lock);
+
+	return NULL;
+}
+
+static size_t bucket_of(uint64_t ns)
+{
+	if (ns < METRICS_SUB_BUCKETS)
+		return ns;
+	unsigned top_bit = 63u - (unsigned) __builtin_clzll(ns);
+	unsigned shift = top_bit - METRICS_SUB_BITS;
+	return (shift + 1) * METRICS_SUB_BUCKETS + (ns >> shift) - METRICS_SUB_BUCKETS;
+}
+
+// the largest value that falls into the bucket
+static uint64_t bucket_top(size_t bucket)
+{
+	if (bucket < METRICS_SUB_BUCKETS)
+		return bucket;
+	size_t shift = bucket / METRICS_SUB_BUCKETS - 1;
+	uint64_t sub = bucket % METRICS_SUB_BUCKETS + METRICS_SUB_BUCKETS;
+	return ((sub + 1) << shift) - 1;
+}
+
+static uint64_t now_ns()
+{
+	struct timespec ts = {};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+const char *metrics_err_to_str(enum MetricsError err)
+{
+	switch (err) {
+		case METRICS_THREAD_ERR:
+			return "Couldn't start the metrics thread";
+		case METRICS_FILE_ERR:
+			return "Couldn't write the metrics file";
+		case METRICS_NO_ERR:
+			return "No error occured";
+		default:
+			return "An unknown error occured";
+	}
+}
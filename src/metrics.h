@@ -0,0 +1,76 @@
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+ * Latency histograms of engine operations, for percentiles rather than means.
+ * A histogram is HDR-style: values below METRICS_SUB_BUCKETS nanoseconds have
+ * a bucket each, and every power of two above that is split into
+ * METRICS_SUB_BUCKETS linear buckets, so any value is kept to within 1/32 of
+ * itself in a fixed array. Recording is a few relaxed atomic adds and works
+ * from any thread. Until metrics_enable(), metrics_start() returns 0 and
+ * nothing is recorded.
+ *
+ * The histograms are printed as a table by metrics_print_summary() and
+ * written in the Prometheus text exposition format, as summaries in seconds,
+ * by metrics_write_prometheus(). metrics_start_export() rewrites such a file
+ * periodically from a background thread, through a temporary file and a
+ * rename, so a scraper never reads half of it.
+ */
+enum MetricId {
+	METRIC_LOAD,
+	METRIC_SAVE,
+	METRIC_GUESS_STEP,
+	METRIC_DESCRIBE,
+	METRIC_COMPARE,
+	NUM_METRICS,
+};
+
+const unsigned METRICS_SUB_BITS		= 5;
+const size_t METRICS_SUB_BUCKETS	= 1 << METRICS_SUB_BITS;
+const size_t METRICS_BUCKETS		= (64 - METRICS_SUB_BITS + 1) * METRICS_SUB_BUCKETS;
+const long METRICS_DEFAULT_INTERVAL_MS = 10000;
+const size_t METRICS_NAME_SIZE		= 512;
+
+struct Histogram {
+	uint64_t counts[METRICS_BUCKETS];
+	uint64_t count;
+	uint64_t sum_ns;
+	uint64_t max_ns;
+};
+
+struct Metrics {
+	struct Histogram hists[NUM_METRICS];
+	bool is_on;
+
+	// the periodic export
+	char export_name[METRICS_NAME_SIZE];
+	long interval_ms;
+	bool is_exporting;
+	bool stop;
+	pthread_t exporter;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+};
+
+enum MetricsError {
+	METRICS_THREAD_ERR	= -2,
+	METRICS_FILE_ERR	= -1,
+	METRICS_NO_ERR		= 0,
+};
+
+void metrics_enable();
+uint64_t metrics_start();
+void metrics_stop(enum MetricId id, uint64_t start_ns);
+void metrics_record(enum MetricId id, uint64_t ns);
+uint64_t histogram_percentile(const struct Histogram *hist, double quantile);
+void metrics_print_summary(FILE *out);
+enum MetricsError metrics_write_prometheus(const char *filename);
+enum MetricsError metrics_start_export(const char *filename, long interval_ms);
+enum MetricsError metrics_stop_export();
+const char *metrics_err_to_str(enum MetricsError err);
+
+#endif /*_METRICS_H*/
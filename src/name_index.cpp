@@ -0,0 +1,706 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "name_index.h"
+#include "small_stack.h"
+#include "mem.h"
+
+const size_t PEQ_TABLE_SIZE = 128;
+const size_t INIT_NODES = 256;
+
+struct NameFrame {
+	const struct Node *node;
+	size_t parent;
+	size_t depth;
+	bool is_no;
+};
+
+struct PeqSlot {
+	uint32_t code_point;
+	uint64_t mask;
+};
+
+struct GramCursor {
+	const uint32_t *cur;
+	const uint32_t *end;
+};
+
+struct GramCandidate {
+	uint32_t rank;
+	uint32_t lower;
+};
+
+struct SuggestState {
+	const struct NameIndex *idx;
+	const uint32_t *pattern;
+	size_t len;
+	uint64_t signature;
+	const struct PeqSlot *peq;
+	struct NameMatch *matches;
+	size_t max_matches;
+	size_t found;
+	size_t max_dist;
+};
+
+static size_t decode_utf8(const char *str, uint32_t *code_point);
+static uint32_t fold_code_point(uint32_t cp);
+static size_t fold_name(const char *name, uint32_t *out, size_t max_len);
+static uint64_t hash_code_points(const uint32_t *cps, size_t len);
+static uint64_t make_signature(const uint32_t *cps, size_t len);
+static enum NameIndexError add_entry(struct NameIndex *idx, const struct NameFrame *frame);
+static enum NameIndexError build_tables(struct NameIndex *idx);
+static enum NameIndexError build_postings(struct NameIndex *idx);
+static size_t distinct_grams(const uint32_t *cps, size_t len, uint32_t *grams);
+static int compare_grams(const void *a, const void *b);
+static size_t gram_bound(size_t num_grams, size_t shared);
+static size_t rank_length(const struct NameIndex *idx, size_t rank,
+						  size_t min_len, size_t max_len);
+static const uint32_t *lower_rank(const uint32_t *first, const uint32_t *last,
+								  size_t rank);
+static void try_match(struct SuggestState *state, const struct NameEntry *entry);
+static void free_scan(struct GramCandidate *cands, size_t cands_cap, uint8_t *shared,
+					  uint16_t *touched);
+static void peq_build(struct PeqSlot *peq, const uint32_t *pattern, size_t len);
+static uint64_t peq_lookup(const struct PeqSlot *peq, uint32_t cp);
+static size_t myers_distance(const struct PeqSlot *peq, size_t pattern_len,
+							 const uint32_t *text, size_t text_len);
+static size_t dp_distance(const uint32_t *pattern, size_t pattern_len,
+						  const uint32_t *text, size_t text_len);
+
+enum NameIndexError name_index_ctor(struct NameIndex *idx, const struct Node *tree)
+{
+	assert(idx);
+
+	memset(idx, 0, sizeof(struct NameIndex));
+	idx->root = tree;
+
+	SmallStack<struct NameFrame, NAME_INIT_DEPTH> stack = {};
+	small_stack_ctor(&stack);
+	if (tree)
+		small_stack_push(&stack, {tree, NAME_NO_PARENT, 0, false});
+
+	// preorder, so that the first of equal names is the one strcmp search finds
+	struct NameFrame frame = {};
+	while (small_stack_pop(&stack, &frame) == STACK_NO_ERR) {
+		const struct Node *node = frame.node;
+		size_t self = idx->num_entries;
+		if (add_entry(idx, &frame) < 0 ||
+			(node->right &&
+			 small_stack_push(&stack, {node->right, self, frame.depth + 1, true}) < 0) ||
+			(node->left &&
+			 small_stack_push(&stack, {node->left, self, frame.depth + 1, false}) < 0)) {
+			small_stack_dtor(&stack);
+			name_index_dtor(idx);
+			return NIDX_NO_MEM_ERR;
+		}
+	}
+	small_stack_dtor(&stack);
+
+	enum NameIndexError err = build_tables(idx);
+	if (err < 0)
+		name_index_dtor(idx);
+	return err;
+}
+
+static enum NameIndexError add_entry(struct NameIndex *idx, const struct NameFrame *frame)
+{
+	assert(idx);
+	assert(frame);
+
+	const struct Node *node = frame->node;
+
+	if (idx->num_entries == idx->entries_cap) {
+		size_t new_cap = idx->entries_cap ? 2 * idx->entries_cap : INIT_NODES;
+		struct NameEntry *tmp = (struct NameEntry*) mem_realloc(MEM_INDEX, idx->entries,
+										idx->entries_cap * sizeof(struct NameEntry),
+										new_cap * sizeof(struct NameEntry));
+		if (!tmp)
+			return NIDX_NO_MEM_ERR;
+		idx->entries = tmp;
+		idx->entries_cap = new_cap;
+	}
+
+	// a name never has more code points than bytes
+	size_t max_len = strlen(node->data);
+	if (idx->num_code_points + max_len > idx->code_points_cap) {
+		size_t new_cap = idx->code_points_cap ? idx->code_points_cap : INIT_NODES;
+		while (new_cap < idx->num_code_points + max_len)
+			new_cap *= 2;
+		uint32_t *tmp = (uint32_t*) mem_realloc(MEM_INDEX, idx->code_points,
+												idx->code_points_cap * sizeof(uint32_t),
+												new_cap * sizeof(uint32_t));
+		if (!tmp)
+			return NIDX_NO_MEM_ERR;
+		idx->code_points = tmp;
+		idx->code_points_cap = new_cap;
+	}
+
+	uint32_t *folded = idx->code_points + idx->num_code_points;
+	size_t len = fold_name(node->data, folded, max_len);
+
+	struct NameEntry *entry = &idx->entries[idx->num_entries++];
+	entry->node = node;
+	entry->parent = frame->parent;
+	entry->is_no = frame->is_no;
+	entry->start = idx->num_code_points;
+	entry->len = (uint32_t) len;
+	entry->hash = hash_code_points(folded, len);
+	entry->signature = make_signature(folded, len);
+
+	idx->num_code_points += len;
+	if (len > idx->max_len)
+		idx->max_len = len;
+	if (frame->depth > idx->max_depth)
+		idx->max_depth = frame->depth;
+
+	return NIDX_NO_ERR;
+}
+
+static enum NameIndexError build_tables(struct NameIndex *idx)
+{
+	assert(idx);
+
+	idx->table_cap = 16;
+	while (idx->table_cap < 2 * idx->num_entries)
+		idx->table_cap *= 2;
+	idx->table = (size_t*) mem_calloc(MEM_INDEX, idx->table_cap, sizeof(size_t));
+	idx->by_length_start = (size_t*) mem_calloc(MEM_INDEX, idx->max_len + 2, sizeof(size_t));
+	struct NameEntry *sorted = (struct NameEntry*) mem_calloc(MEM_INDEX, idx->num_entries + 1,
+															   sizeof(struct NameEntry));
+	size_t *new_pos = (size_t*) mem_calloc(MEM_INDEX, idx->num_entries + 1, sizeof(size_t));
+	if (!idx->table || !idx->by_length_start || !sorted || !new_pos) {
+		mem_free(MEM_INDEX, sorted, (idx->num_entries + 1) * sizeof(struct NameEntry));
+		mem_free(MEM_INDEX, new_pos, (idx->num_entries + 1) * sizeof(size_t));
+		return NIDX_NO_MEM_ERR;
+	}
+
+	// entries are stably sorted by folded length, so an entry index is also its
+	// rank and the candidates of one length are adjacent in memory
+	for (size_t i = 0; i < idx->num_entries; i++)
+		idx->by_length_start[idx->entries[i].len + 1]++;
+	for (size_t len = 1; len <= idx->max_len + 1; len++)
+		idx->by_length_start[len] += idx->by_length_start[len - 1];
+	for (size_t i = 0; i < idx->num_entries; i++) {
+		size_t len = idx->entries[i].len;
+		new_pos[i] = idx->by_length_start[len]++;
+		sorted[new_pos[i]] = idx->entries[i];
+	}
+	for (size_t i = 0; i < idx->num_entries; i++)
+		if (sorted[i].parent != NAME_NO_PARENT)
+			sorted[i].parent = new_pos[sorted[i].parent];
+	mem_free(MEM_INDEX, new_pos, (idx->num_entries + 1) * sizeof(size_t));
+	for (size_t len = idx->max_len + 1; len > 0; len--)
+		idx->by_length_start[len] = idx->by_length_start[len - 1];
+	idx->by_length_start[0] = 0;
+	mem_free(MEM_INDEX, idx->entries, idx->entries_cap * sizeof(struct NameEntry));
+	idx->entries = sorted;
+	idx->entries_cap = idx->num_entries + 1;
+
+	// slots hold entry index + 1, zero marks an empty slot; equal names have
+	// equal lengths, so the first one in tree order still becomes primary
+	for (size_t i = 0; i < idx->num_entries; i++) {
+		const struct NameEntry *entry = &idx->entries[i];
+		size_t slot = entry->hash & (idx->table_cap - 1);
+		bool duplicate = false;
+		while (idx->table[slot]) {
+			const struct NameEntry *other = &idx->entries[idx->table[slot] - 1];
+			if (other->hash == entry->hash && other->len == entry->len &&
+				memcmp(idx->code_points + other->start, idx->code_points + entry->start,
+					   entry->len * sizeof(uint32_t)) == 0) {
+				duplicate = true;
+				break;
+			}
+			slot = (slot + 1) & (idx->table_cap - 1);
+		}
+		idx->entries[i].is_primary = !duplicate;
+		if (!duplicate)
+			idx->table[slot] = i + 1;
+	}
+
+	return build_postings(idx);
+}
+
+static enum NameIndexError build_postings(struct NameIndex *idx)
+{
+	assert(idx);
+
+	idx->postings_start = (size_t*) mem_calloc(MEM_INDEX, NAME_GRAM_BUCKETS + 1, sizeof(size_t));
+	uint32_t *grams = (uint32_t*) mem_calloc(MEM_INDEX, idx->max_len + 1, sizeof(uint32_t));
+	if (!idx->postings_start || !grams) {
+		mem_free(MEM_INDEX, grams, (idx->max_len + 1) * sizeof(uint32_t));
+		return NIDX_NO_MEM_ERR;
+	}
+
+	for (size_t rank = 0; rank < idx->num_entries; rank++) {
+		const struct NameEntry *entry = &idx->entries[rank];
+		if (!entry->is_primary)
+			continue;
+		size_t num_grams = distinct_grams(idx->code_points + entry->start,
+										  entry->len, grams);
+		for (size_t g = 0; g < num_grams; g++)
+			idx->postings_start[grams[g] + 1]++;
+	}
+	for (size_t g = 1; g <= NAME_GRAM_BUCKETS; g++)
+		idx->postings_start[g] += idx->postings_start[g - 1];
+
+	idx->postings = (uint32_t*) mem_calloc(MEM_INDEX, idx->postings_start[NAME_GRAM_BUCKETS] + 1,
+										   sizeof(uint32_t));
+	size_t *fill = (size_t*) mem_calloc(MEM_INDEX, NAME_GRAM_BUCKETS, sizeof(size_t));
+	if (!idx->postings || !fill) {
+		mem_free(MEM_INDEX, grams, (idx->max_len + 1) * sizeof(uint32_t));
+		mem_free(MEM_INDEX, fill, NAME_GRAM_BUCKETS * sizeof(size_t));
+		return NIDX_NO_MEM_ERR;
+	}
+	memcpy(fill, idx->postings_start, NAME_GRAM_BUCKETS * sizeof(size_t));
+
+	// filled in rank order, so every list is sorted by name length
+	for (size_t rank = 0; rank < idx->num_entries; rank++) {
+		const struct NameEntry *entry = &idx->entries[rank];
+		if (!entry->is_primary)
+			continue;
+		size_t num_grams = distinct_grams(idx->code_points + entry->start,
+										  entry->len, grams);
+		for (size_t g = 0; g < num_grams; g++)
+			idx->postings[fill[grams[g]]++] = (uint32_t) rank;
+	}
+
+	mem_free(MEM_INDEX, grams, (idx->max_len + 1) * sizeof(uint32_t));
+	mem_free(MEM_INDEX, fill, NAME_GRAM_BUCKETS * sizeof(size_t));
+	return NIDX_NO_ERR;
+}
+
+static size_t distinct_grams(const uint32_t *cps, size_t len, uint32_t *grams)
+{
+	assert(cps);
+	assert(grams);
+
+	if (len < 2)
+		return 0;
+
+	for (size_t i = 0; i + 1 < len; i++)
+		grams[i] = ((cps[i] * 0x9E3779B1u) ^ (cps[i + 1] * 0x85EBCA77u)) >> 16;
+	qsort(grams, len - 1, sizeof(uint32_t), compare_grams);
+
+	size_t num = 1;
+	for (size_t i = 1; i + 1 < len; i++)
+		if (grams[i] != grams[num - 1])
+			grams[num++] = grams[i];
+	return num;
+}
+
+static int compare_grams(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t*) a;
+	uint32_t y = *(const uint32_t*) b;
+	return (x > y) - (x < y);
+}
+
+void name_index_dtor(struct NameIndex *idx)
+{
+	assert(idx);
+
+	size_t num_postings = idx->postings ? idx->postings_start[NAME_GRAM_BUCKETS] + 1 : 0;
+	mem_free(MEM_INDEX, idx->entries, idx->entries_cap * sizeof(struct NameEntry));
+	mem_free(MEM_INDEX, idx->code_points, idx->code_points_cap * sizeof(uint32_t));
+	mem_free(MEM_INDEX, idx->table, idx->table_cap * sizeof(size_t));
+	mem_free(MEM_INDEX, idx->postings, num_postings * sizeof(uint32_t));
+	mem_free(MEM_INDEX, idx->postings_start, (NAME_GRAM_BUCKETS + 1) * sizeof(size_t));
+	mem_free(MEM_INDEX, idx->by_length_start, (idx->max_len + 2) * sizeof(size_t));
+	memset(idx, 0, sizeof(struct NameIndex));
+}
+
+const struct Node *name_index_find(const struct NameIndex *idx, const char *name)
+{
+	const struct NameEntry *entry = name_index_lookup(idx, name);
+	return entry ? entry->node : NULL;
+}
+
+const struct NameEntry *name_index_lookup(const struct NameIndex *idx, const char *name)
+{
+	assert(idx);
+	assert(name);
+
+	if (!idx->table)
+		return NULL;
+
+	uint32_t folded[NAME_MAX_LEN] = {};
+	size_t len = fold_name(name, folded, NAME_MAX_LEN);
+	uint64_t hash = hash_code_points(folded, len);
+
+	size_t slot = hash & (idx->table_cap - 1);
+	while (idx->table[slot]) {
+		const struct NameEntry *entry = &idx->entries[idx->table[slot] - 1];
+		if (entry->hash == hash && entry->len == len &&
+			memcmp(idx->code_points + entry->start, folded,
+				   len * sizeof(uint32_t)) == 0)
+			return entry;
+		slot = (slot + 1) & (idx->table_cap - 1);
+	}
+	return NULL;
+}
+
+size_t name_index_suggest(const struct NameIndex *idx, const char *name,
+						  struct NameMatch *matches, size_t max_matches)
+{
+	assert(idx);
+	assert(name);
+	assert(matches);
+
+	uint32_t pattern[NAME_MAX_LEN] = {};
+	size_t len = fold_name(name, pattern, NAME_MAX_LEN);
+	if (len == 0 || max_matches == 0 || !idx->postings)
+		return 0;
+
+	struct PeqSlot peq[PEQ_TABLE_SIZE] = {};
+	if (len <= 64)
+		peq_build(peq, pattern, len);
+
+	struct SuggestState state = {idx, pattern, len, make_signature(pattern, len), peq,
+								 matches, max_matches, 0, len / NAME_TYPO_RATIO};
+	if (state.max_dist < 1)
+		state.max_dist = 1;
+
+	// only names within max_dist of the query length can qualify; ranks
+	// order entries by length, so the window is one contiguous range
+	size_t min_len = len > state.max_dist ? len - state.max_dist : 0;
+	size_t max_len = len + state.max_dist;
+	if (max_len > idx->max_len)
+		max_len = idx->max_len;
+	if (min_len > max_len)
+		return 0;
+	size_t lo = idx->by_length_start[min_len];
+	size_t hi = idx->by_length_start[max_len + 1];
+	if (lo == hi)
+		return 0;
+
+	uint32_t grams[NAME_MAX_LEN] = {};
+	size_t num_grams = distinct_grams(pattern, len, grams);
+	// shared counts are kept in bytes
+	if (num_grams > UINT8_MAX)
+		num_grams = UINT8_MAX;
+
+	struct GramCursor cursors[NAME_MAX_LEN] = {};
+	size_t num_cursors = 0;
+	size_t total = 0;
+	for (size_t g = 0; g < num_grams; g++) {
+		const uint32_t *first = idx->postings + idx->postings_start[grams[g]];
+		const uint32_t *last = idx->postings + idx->postings_start[grams[g] + 1];
+		cursors[num_cursors].cur = lower_rank(first, last, lo);
+		cursors[num_cursors].end = lower_rank(cursors[num_cursors].cur, last, hi);
+		if (cursors[num_cursors].cur == cursors[num_cursors].end)
+			continue;
+		total += (size_t) (cursors[num_cursors].end - cursors[num_cursors].cur);
+		num_cursors++;
+	}
+
+	// names sharing no bigram at all are only worth a look for short queries
+	size_t untouched_bound = gram_bound(num_grams, 0);
+	bool scan_untouched = untouched_bound <= state.max_dist;
+
+	struct GramCandidate *cands = (struct GramCandidate*) mem_calloc(MEM_INDEX, total + 1,
+											sizeof(struct GramCandidate));
+	uint8_t *shared = (uint8_t*) mem_calloc(MEM_INDEX, NAME_SCAN_BLOCK, sizeof(uint8_t));
+	uint16_t *touched = (uint16_t*) mem_calloc(MEM_INDEX, NAME_SCAN_BLOCK, sizeof(uint16_t));
+	if (!cands || !shared || !touched) {
+		free_scan(cands, total + 1, shared, touched);
+		return 0;
+	}
+
+	// posting lists are sorted by rank, so counting the shared bigrams one
+	// block of ranks at a time keeps the counters in L1
+	size_t num_cands = 0;
+	for (size_t block = lo; block < hi; block += NAME_SCAN_BLOCK) {
+		size_t block_end = block + NAME_SCAN_BLOCK < hi ? block + NAME_SCAN_BLOCK : hi;
+		size_t num_touched = 0;
+		for (size_t c = 0; c < num_cursors; c++) {
+			const uint32_t *cur = cursors[c].cur;
+			for (; cur < cursors[c].end && *cur < block_end; cur++)
+				if (shared[*cur - block]++ == 0)
+					touched[num_touched++] = (uint16_t) (*cur - block);
+			cursors[c].cur = cur;
+		}
+
+		if (scan_untouched && (state.found < max_matches ||
+							   untouched_bound < matches[state.found - 1].distance))
+			for (size_t rank = block; rank < block_end; rank++)
+				if (shared[rank - block] == 0)
+					try_match(&state, &idx->entries[rank]);
+
+		for (size_t t = 0; t < num_touched; t++) {
+			size_t rank = block + touched[t];
+			size_t lower = gram_bound(num_grams, shared[touched[t]]);
+			shared[touched[t]] = 0;
+			if (lower > state.max_dist)
+				continue;
+			size_t cand_len = rank_length(idx, rank, min_len, max_len);
+			size_t diff = cand_len > len ? cand_len - len : len - cand_len;
+			cands[num_cands++] = {(uint32_t) rank, (uint32_t) (lower > diff ? lower : diff)};
+		}
+	}
+
+	// candidates are verified in order of their lower bound, so the search
+	// stops as soon as the top-k can't improve
+	for (size_t bound = 0; bound <= state.max_dist; bound++) {
+		if (state.found == max_matches && bound >= matches[state.found - 1].distance)
+			break;
+		for (size_t c = 0; c < num_cands; c++)
+			if (cands[c].lower == bound)
+				try_match(&state, &idx->entries[cands[c].rank]);
+	}
+
+	free_scan(cands, total + 1, shared, touched);
+	return state.found;
+}
+
+static void free_scan(struct GramCandidate *cands, size_t cands_cap, uint8_t *shared,
+					  uint16_t *touched)
+{
+	mem_free(MEM_INDEX, cands, cands_cap * sizeof(struct GramCandidate));
+	mem_free(MEM_INDEX, shared, NAME_SCAN_BLOCK * sizeof(uint8_t));
+	mem_free(MEM_INDEX, touched, NAME_SCAN_BLOCK * sizeof(uint16_t));
+}
+
+static size_t gram_bound(size_t num_grams, size_t shared)
+{
+	// every edit removes at most two distinct bigrams of the query
+	return (num_grams - shared + 1) / 2;
+}
+
+static const uint32_t *lower_rank(const uint32_t *first, const uint32_t *last,
+								  size_t rank)
+{
+	while (first < last) {
+		const uint32_t *mid = first + (last - first) / 2;
+		if (*mid < rank)
+			first = mid + 1;
+		else
+			last = mid;
+	}
+	return first;
+}
+
+static size_t rank_length(const struct NameIndex *idx, size_t rank,
+						  size_t min_len, size_t max_len)
+{
+	assert(idx);
+
+	while (min_len < max_len) {
+		size_t mid = min_len + (max_len - min_len + 1) / 2;
+		if (idx->by_length_start[mid] <= rank)
+			min_len = mid;
+		else
+			max_len = mid - 1;
+	}
+	return min_len;
+}
+
+static void try_match(struct SuggestState *state, const struct NameEntry *entry)
+{
+	assert(state);
+	assert(entry);
+
+	if (!entry->is_primary)
+		return;
+
+	size_t limit = state->max_dist + 1;
+	if (state->found == state->max_matches &&
+		state->matches[state->found - 1].distance < limit)
+		limit = state->matches[state->found - 1].distance;
+
+	size_t diff = entry->len > state->len ? entry->len - state->len :
+											state->len - entry->len;
+	// each code point missing on one side costs at least one edit
+	size_t missing = (size_t) __builtin_popcountll(state->signature & ~entry->signature);
+	size_t extra = (size_t) __builtin_popcountll(entry->signature & ~state->signature);
+	if (diff >= limit || missing >= limit || extra >= limit)
+		return;
+
+	const uint32_t *text = state->idx->code_points + entry->start;
+	size_t dist = state->len <= 64 ?
+				  myers_distance(state->peq, state->len, text, entry->len) :
+				  dp_distance(state->pattern, state->len, text, entry->len);
+	if (dist >= limit)
+		return;
+
+	size_t ins = state->found < state->max_matches ? state->found++ : state->found - 1;
+	while (ins > 0 && state->matches[ins - 1].distance > dist) {
+		state->matches[ins] = state->matches[ins - 1];
+		ins--;
+	}
+	state->matches[ins] = {entry->node, dist};
+}
+
+static size_t decode_utf8(const char *str, uint32_t *code_point)
+{
+	assert(str);
+	assert(code_point);
+
+	const unsigned char *s = (const unsigned char*) str;
+	if (s[0] < 0x80) {
+		*code_point = s[0];
+		return 1;
+	}
+	if ((s[0] & 0xE0) == 0xC0 && (s[1] & 0xC0) == 0x80) {
+		*code_point = (uint32_t) (s[0] & 0x1F) << 6 | (s[1] & 0x3F);
+		return 2;
+	}
+	if ((s[0] & 0xF0) == 0xE0 && (s[1] & 0xC0) == 0x80 && (s[2] & 0xC0) == 0x80) {
+		*code_point = (uint32_t) (s[0] & 0x0F) << 12 | (uint32_t) (s[1] & 0x3F) << 6 |
+					  (s[2] & 0x3F);
+		return 3;
+	}
+	if ((s[0] & 0xF8) == 0xF0 && (s[1] & 0xC0) == 0x80 && (s[2] & 0xC0) == 0x80 &&
+		(s[3] & 0xC0) == 0x80) {
+		*code_point = (uint32_t) (s[0] & 0x07) << 18 | (uint32_t) (s[1] & 0x3F) << 12 |
+					  (uint32_t) (s[2] & 0x3F) << 6 | (s[3] & 0x3F);
+		return 4;
+	}
+	// invalid sequences are kept byte by byte
+	*code_point = s[0];
+	return 1;
+}
+
+static uint32_t fold_code_point(uint32_t cp)
+{
+	if (cp >= 'A' && cp <= 'Z')
+		return cp + 0x20;
+	// Latin-1 capitals, except the multiplication sign
+	if (cp >= 0xC0 && cp <= 0xDE && cp != 0xD7)
+		return cp + 0x20;
+	// А-Я
+	if (cp >= 0x410 && cp <= 0x42F)
+		return cp + 0x20;
+	// Ѐ-Џ, including Ё
+	if (cp >= 0x400 && cp <= 0x40F)
+		return cp + 0x50;
+	return cp;
+}
+
+static size_t fold_name(const char *name, uint32_t *out, size_t max_len)
+{
+	assert(name);
+	assert(out);
+
+	size_t len = 0;
+	while (*name && len < max_len) {
+		uint32_t cp = 0;
+		name += decode_utf8(name, &cp);
+		out[len++] = fold_code_point(cp);
+	}
+	return len;
+}
+
+static uint64_t hash_code_points(const uint32_t *cps, size_t len)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < len; i++) {
+		hash ^= cps[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static uint64_t make_signature(const uint32_t *cps, size_t len)
+{
+	uint64_t signature = 0;
+	for (size_t i = 0; i < len; i++)
+		signature |= 1ull << ((cps[i] * 0x9E3779B1u) >> 26);
+	return signature;
+}
+
+static void peq_build(struct PeqSlot *peq, const uint32_t *pattern, size_t len)
+{
+	assert(peq);
+	assert(pattern);
+	assert(len <= 64);
+
+	for (size_t i = 0; i < len; i++) {
+		size_t slot = (pattern[i] * 0x9E3779B1u) % PEQ_TABLE_SIZE;
+		while (peq[slot].code_point && peq[slot].code_point != pattern[i])
+			slot = (slot + 1) % PEQ_TABLE_SIZE;
+		peq[slot].code_point = pattern[i];
+		peq[slot].mask |= 1ull << i;
+	}
+}
+
+static uint64_t peq_lookup(const struct PeqSlot *peq, uint32_t cp)
+{
+	size_t slot = (cp * 0x9E3779B1u) % PEQ_TABLE_SIZE;
+	while (peq[slot].code_point) {
+		if (peq[slot].code_point == cp)
+			return peq[slot].mask;
+		slot = (slot + 1) % PEQ_TABLE_SIZE;
+	}
+	return 0;
+}
+
+static size_t myers_distance(const struct PeqSlot *peq, size_t pattern_len,
+							 const uint32_t *text, size_t text_len)
+{
+	assert(peq);
+	assert(pattern_len > 0 && pattern_len <= 64);
+
+	uint64_t pv = ~0ull;
+	uint64_t mv = 0;
+	uint64_t last = 1ull << (pattern_len - 1);
+	size_t score = pattern_len;
+
+	for (size_t j = 0; j < text_len; j++) {
+		uint64_t eq = peq_lookup(peq, text[j]);
+		uint64_t xv = eq | mv;
+		uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+		uint64_t ph = mv | ~(xh | pv);
+		uint64_t mh = pv & xh;
+
+		if (ph & last)
+			score++;
+		else if (mh & last)
+			score--;
+
+		// the first row grows by one per text character
+		ph = (ph << 1) | 1;
+		mh <<= 1;
+		pv = mh | ~(xv | ph);
+		mv = ph & xv;
+	}
+	return score;
+}
+
+static size_t dp_distance(const uint32_t *pattern, size_t pattern_len,
+						  const uint32_t *text, size_t text_len)
+{
+	assert(pattern_len <= NAME_MAX_LEN);
+
+	size_t row[NAME_MAX_LEN + 1] = {};
+	for (size_t i = 0; i <= pattern_len; i++)
+		row[i] = i;
+
+	for (size_t j = 1; j <= text_len; j++) {
+		size_t diag = row[0];
+		row[0] = j;
+		for (size_t i = 1; i <= pattern_len; i++) {
+			size_t up = row[i];
+			size_t best = diag + (pattern[i - 1] != text[j - 1]);
+			if (up + 1 < best)
+				best = up + 1;
+			if (row[i - 1] + 1 < best)
+				best = row[i - 1] + 1;
+			row[i] = best;
+			diag = up;
+		}
+	}
+	return row[pattern_len];
+}
+
+const char *name_index_err_to_str(enum NameIndexError err)
+{
+	switch (err) {
+		case NIDX_NO_MEM_ERR:
+			return "Not enough memory for the name index";
+		case NIDX_NO_ERR:
+			return "No error occured";
+		default:
+			return "An unknown error occured";
+	}
+}
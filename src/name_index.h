@@ -0,0 +1,80 @@
+#ifndef _NAME_INDEX_H
+#define _NAME_INDEX_H
+
+#include <stdint.h>
+
+#include "tree.h"
+
+/*
+ * Case-insensitive lookup of nodes by name. Names are decoded from UTF-8 and
+ * folded (Latin and Cyrillic) into code point strings; exact lookups go
+ * through an open addressing hash table and misses fall back to a top-k
+ * search by edit distance. Candidates are prefiltered with a bigram inverted
+ * index (an edit destroys at most two bigrams) and verified with Myers'
+ * bit-parallel algorithm. Every entry also links to the entry of its parent
+ * question, so the path to a node is known without searching the tree.
+ */
+struct NameEntry {
+	const struct Node *node;
+	size_t start;
+	uint32_t len;
+	uint64_t signature;
+	uint64_t hash;
+	size_t parent;
+	bool is_no;
+	bool is_primary;
+};
+
+struct NameIndex {
+	const struct Node *root;
+	struct NameEntry *entries;
+	size_t num_entries;
+	size_t entries_cap;
+
+	uint32_t *code_points;
+	size_t num_code_points;
+	size_t code_points_cap;
+
+	size_t *table;
+	size_t table_cap;
+
+	// ids of primary entries containing each bigram bucket
+	uint32_t *postings;
+	size_t *postings_start;
+
+	// entries are sorted by folded length, by_length_start[len] is the first one
+	size_t *by_length_start;
+	size_t max_len;
+
+	// answers on the longest path, for sizing paths before a query
+	size_t max_depth;
+};
+
+struct NameMatch {
+	const struct Node *node;
+	size_t distance;
+};
+
+enum NameIndexError {
+	NIDX_NO_MEM_ERR	= -1,
+	NIDX_NO_ERR		= 0,
+};
+
+const size_t NAME_MAX_LEN			= 512;
+const size_t NAME_SUGGESTIONS		= 3;
+const size_t NAME_INIT_DEPTH		= 64;
+const size_t NAME_GRAM_BUCKETS		= 1 << 16;
+const size_t NAME_SCAN_BLOCK		= 1 << 15;
+// one typo is tolerated per this many code points of the query
+const size_t NAME_TYPO_RATIO		= 3;
+const size_t NAME_NO_PARENT			= (size_t) -1;
+
+enum NameIndexError name_index_ctor(struct NameIndex *idx, const struct Node *tree);
+void name_index_dtor(struct NameIndex *idx);
+const struct NameEntry *name_index_lookup(const struct NameIndex *idx, const char *name);
+const struct Node *name_index_find(const struct NameIndex *idx, const char *name);
+size_t name_index_suggest(const struct NameIndex *idx, const char *name,
+						  struct NameMatch *matches, size_t max_matches);
+const char *name_index_err_to_str(enum NameIndexError err);
+
+#endif /*_NAME_INDEX_H*/
@@ -0,0 +1,142 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "path.h"
+#include "mem.h"
+
+static const uint64_t *path_words(const struct Path *path);
+static enum PathError path_grow(struct Path *path, size_t new_cap);
+
+void path_ctor(struct Path *path)
+{
+	assert(path);
+
+	memset(path->inline_bits, 0, sizeof(path->inline_bits));
+	path->heap_bits = NULL;
+	path->cap = PATH_INLINE_WORDS * PATH_WORD_BITS;
+	path->len = 0;
+}
+
+void path_dtor(struct Path *path)
+{
+	assert(path);
+
+	mem_free(MEM_PATH, path->heap_bits, path->cap / PATH_WORD_BITS * sizeof(uint64_t));
+	path->heap_bits = NULL;
+	path->cap = 0;
+	path->len = 0;
+}
+
+void path_clear(struct Path *path)
+{
+	assert(path);
+
+	path->len = 0;
+}
+
+// makes room for len answers, so that paths up to that long don't allocate
+enum PathError path_reserve(struct Path *path, size_t len)
+{
+	assert(path);
+	assert(path->cap > 0);
+
+	size_t new_cap = path->cap;
+	while (new_cap < len)
+		new_cap *= 2;
+	if (new_cap == path->cap)
+		return PATH_NO_ERR;
+	return path_grow(path, new_cap);
+}
+
+static enum PathError path_grow(struct Path *path, size_t new_cap)
+{
+	size_t words = path->cap / PATH_WORD_BITS;
+	size_t old_size = path->heap_bits ? words * sizeof(uint64_t) : 0;
+	uint64_t *tmp = (uint64_t*) mem_realloc(MEM_PATH, path->heap_bits, old_size,
+											new_cap / PATH_WORD_BITS * sizeof(uint64_t));
+	if (!tmp)
+		return PATH_NO_MEM_ERR;
+	if (!path->heap_bits)
+		memcpy(tmp, path->inline_bits, sizeof(path->inline_bits));
+	path->heap_bits = tmp;
+	path->cap = new_cap;
+	return PATH_NO_ERR;
+}
+
+static const uint64_t *path_words(const struct Path *path)
+{
+	return path->heap_bits ? path->heap_bits : path->inline_bits;
+}
+
+enum PathError path_push(struct Path *path, bool is_no)
+{
+	assert(path);
+
+	if (path->len == path->cap) {
+		enum PathError err = path_grow(path, 2 * path->cap);
+		if (err < 0)
+			return err;
+	}
+
+	uint64_t *words = path->heap_bits ? path->heap_bits : path->inline_bits;
+	uint64_t *word = &words[path->len / PATH_WORD_BITS];
+	uint64_t mask = (uint64_t) 1 << (path->len % PATH_WORD_BITS);
+	if (is_no)
+		*word |= mask;
+	else
+		*word &= ~mask;
+	path->len++;
+	return PATH_NO_ERR;
+}
+
+// depth 0 is the answer to the root question
+bool path_answer(const struct Path *path, size_t depth)
+{
+	assert(path);
+	assert(depth < path->len);
+
+	size_t bit = path->len - 1 - depth;
+	return (path_words(path)[bit / PATH_WORD_BITS] >> (bit % PATH_WORD_BITS)) & 1;
+}
+
+enum PathError path_from_entry(struct Path *path, const struct NameIndex *idx,
+							   const struct NameEntry *entry)
+{
+	assert(path);
+	assert(idx);
+	assert(entry);
+
+	path_clear(path);
+	while (entry->parent != NAME_NO_PARENT) {
+		enum PathError err = path_push(path, entry->is_no);
+		if (err < 0)
+			return err;
+		entry = &idx->entries[entry->parent];
+	}
+	return PATH_NO_ERR;
+}
+
+size_t path_common_prefix(const struct Path *path1, const struct Path *path2)
+{
+	assert(path1);
+	assert(path2);
+
+	size_t common = 0;
+	while (common < path1->len && common < path2->len &&
+		   path_answer(path1, common) == path_answer(path2, common))
+		common++;
+	return common;
+}
+
+const char *path_err_to_str(enum PathError err)
+{
+	switch (err) {
+		case PATH_NO_MEM_ERR:
+			return "Not enough memory for the path";
+		case PATH_NO_ERR:
+			return "No error occured";
+		default:
+			return "An unknown error occured";
+	}
+}
@@ -0,0 +1,42 @@
+#ifndef _PATH_H
+#define _PATH_H
+
+#include <stdint.h>
+
+#include "name_index.h"
+
+/*
+ * Answers on the way from the root to a node, one bit per answer (set for
+ * "no"). Typical depths fit into the inline words; deeper paths move to the
+ * heap once and keep that storage, so a path reused across queries stops
+ * allocating. path_reserve() to the index's max_depth makes room for any path
+ * of the tree up front. Answers are pushed from the node upwards and read from
+ * the root.
+ */
+const size_t PATH_INLINE_WORDS = 4;
+const size_t PATH_WORD_BITS	   = 64;
+
+struct Path {
+	uint64_t inline_bits[PATH_INLINE_WORDS];
+	uint64_t *heap_bits;
+	size_t cap;
+	size_t len;
+};
+
+enum PathError {
+	PATH_NO_MEM_ERR = -1,
+	PATH_NO_ERR		= 0,
+};
+
+void path_ctor(struct Path *path);
+void path_dtor(struct Path *path);
+void path_clear(struct Path *path);
+enum PathError path_reserve(struct Path *path, size_t len);
+enum PathError path_push(struct Path *path, bool is_no);
+bool path_answer(const struct Path *path, size_t depth);
+enum PathError path_from_entry(struct Path *path, const struct NameIndex *idx,
+							   const struct NameEntry *entry);
+size_t path_common_prefix(const struct Path *path1, const struct Path *path2);
+const char *path_err_to_str(enum PathError err);
+
+#endif /*_PATH_H*/
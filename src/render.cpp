@@ -0,0 +1,359 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "render.h"
+#include "logger.h"
+#include "trace.h"
+
+extern char **environ;
+
+// follows the command; the names come as arguments, so they need no quoting
+static const char RENDER_SCRIPT_TAIL[] = " <\"$0\" >\"$1.part\" && mv -f \"$1.part\" \"$1\""
+										 " || { rm -f \"$1.part\"; exit 1; }";
+
+struct RenderJob {
+	struct Renderer *renderer;
+	char *dot_name;
+	char *image_name;
+};
+
+static void render_job(void *arg);
+static pid_t spawn_render(char *script, char *dot_name, char *image_name);
+static bool wait_render(struct Renderer *renderer, pid_t pid, int *status);
+static void free_job(struct RenderJob *job);
+static bool is_queued(const struct Renderer *renderer, const char *image_name);
+static void forget_queued(struct Renderer *renderer, const char *image_name);
+static uint64_t hash_bytes(uint64_t hash, const char *data, size_t len);
+
+enum RenderError render_ctor(struct Renderer *renderer, const char *cmd, size_t num_jobs)
+{
+	assert(renderer);
+	assert(cmd);
+	assert(num_jobs > 0);
+
+	renderer->script = (char*) calloc(strlen(cmd) + sizeof(RENDER_SCRIPT_TAIL), sizeof(char));
+	if (!renderer->script)
+		return RENDER_NO_MEM_ERR;
+	strcpy(renderer->script, cmd);
+	strcat(renderer->script, RENDER_SCRIPT_TAIL);
+
+	renderer->queued = (char**) calloc(RENDER_INIT_QUEUED, sizeof(char*));
+	if (!renderer->queued) {
+		free(renderer->script);
+		renderer->script = NULL;
+		return RENDER_NO_MEM_ERR;
+	}
+	renderer->num_queued = 0;
+	renderer->queued_cap = RENDER_INIT_QUEUED;
+
+	renderer->detach = false;
+	pthread_mutex_init(&renderer->lock, NULL);
+	pthread_cond_init(&renderer->detached, NULL);
+
+	enum PoolError pool_err = pool_ctor(&renderer->pool, num_jobs);
+	if (pool_err < 0) {
+		pthread_mutex_destroy(&renderer->lock);
+		pthread_cond_destroy(&renderer->detached);
+		free(renderer->queued);
+		renderer->queued = NULL;
+		free(renderer->script);
+		renderer->script = NULL;
+		return pool_err == POOL_NO_MEM_ERR ? RENDER_NO_MEM_ERR : RENDER_THREAD_ERR;
+	}
+
+	return RENDER_NO_ERR;
+}
+
+void render_dtor(struct Renderer *renderer, bool wait)
+{
+	assert(renderer);
+
+	if (!renderer->script)
+		return;
+
+	if (!wait) {
+		pthread_mutex_lock(&renderer->lock);
+		renderer->detach = true;
+		pthread_cond_broadcast(&renderer->detached);
+		pthread_mutex_unlock(&renderer->lock);
+	}
+	// the pool still runs the queued jobs, detached ones only start their process
+	pool_dtor(&renderer->pool);
+
+	pthread_mutex_destroy(&renderer->lock);
+	pthread_cond_destroy(&renderer->detached);
+	for (size_t i = 0; i < renderer->num_queued; i++)
+		free(renderer->queued[i]);
+	free(renderer->queued);
+	renderer->queued = NULL;
+	renderer->num_queued = 0;
+	renderer->queued_cap = 0;
+	free(renderer->script);
+	renderer->script = NULL;
+}
+
+enum RenderError render_submit(struct Renderer *renderer, const char *dot_name,
+							   const char *image_name)
+{
+	assert(renderer);
+	assert(dot_name);
+	assert(image_name);
+
+	struct RenderJob *job = (struct RenderJob*) calloc(1, sizeof(struct RenderJob));
+	if (!job)
+		return RENDER_NO_MEM_ERR;
+	job->renderer = renderer;
+	job->dot_name = strdup(dot_name);
+	job->image_name = strdup(image_name);
+	if (!job->dot_name || !job->image_name) {
+		free_job(job);
+		return RENDER_NO_MEM_ERR;
+	}
+
+	if (pool_submit(&renderer->pool, render_job, job) < 0) {
+		free_job(job);
+		return RENDER_NO_MEM_ERR;
+	}
+	return RENDER_NO_ERR;
+}
+
+// writes "<cache_dir>/cache-<hash>.dot" and renders it into the .png next to it,
+// unless that image is cached; the name of the image goes to image_name
+enum RenderError render_dot(struct Renderer *renderer, const char *cache_dir, const char *dot,
+							size_t dot_len, char *image_name, size_t image_name_size)
+{
+	assert(renderer);
+	assert(cache_dir);
+	assert(dot);
+	assert(image_name);
+
+	// another command makes another image of the same text
+	uint64_t hash = 14695981039346656037ull;
+	hash = hash_bytes(hash, renderer->script, strlen(renderer->script));
+	hash = hash_bytes(hash, dot, dot_len);
+
+	int name_len = snprintf(image_name, image_name_size, "%s/cache-%016" PRIx64 ".png",
+							cache_dir, hash);
+	if (name_len < 0 || (size_t) name_len >= image_name_size)
+		return RENDER_NO_MEM_ERR;
+
+	pthread_mutex_lock(&renderer->lock);
+	if (is_queued(renderer, image_name) || access(image_name, F_OK) == 0) {
+		pthread_mutex_unlock(&renderer->lock);
+		log_message(DEBUG, "Reusing cached %s\n", image_name);
+		return RENDER_NO_ERR;
+	}
+	if (renderer->num_queued == renderer->queued_cap) {
+		char **queued = (char**) realloc(renderer->queued,
+										 2 * renderer->queued_cap * sizeof(char*));
+		if (!queued) {
+			pthread_mutex_unlock(&renderer->lock);
+			return RENDER_NO_MEM_ERR;
+		}
+		renderer->queued = queued;
+		renderer->queued_cap *= 2;
+	}
+	char *queued_name = strdup(image_name);
+	if (!queued_name) {
+		pthread_mutex_unlock(&renderer->lock);
+		return RENDER_NO_MEM_ERR;
+	}
+	renderer->queued[renderer->num_queued++] = queued_name;
+	pthread_mutex_unlock(&renderer->lock);
+
+	// the same name with .dot, which is no longer than .png
+	char *dot_name = strdup(image_name);
+	if (!dot_name) {
+		forget_queued(renderer, image_name);
+		return RENDER_NO_MEM_ERR;
+	}
+	strcpy(dot_name + name_len - strlen(".png"), ".dot");
+
+	enum RenderError err = RENDER_NO_ERR;
+	FILE *dot_file = fopen(dot_name, "w");
+	if (!dot_file) {
+		err = RENDER_FILE_ERR;
+		goto finally;
+	}
+	fwrite(dot, sizeof(char), dot_len, dot_file);
+	if (fclose(dot_file) != 0) {
+		err = RENDER_FILE_ERR;
+		goto finally;
+	}
+
+	err = render_submit(renderer, dot_name, image_name);
+
+finally:
+	free(dot_name);
+	// an image that won't be rendered must not be reused
+	if (err < 0)
+		forget_queued(renderer, image_name);
+	return err;
+}
+
+void render_wait(struct Renderer *renderer)
+{
+	assert(renderer);
+
+	pool_wait(&renderer->pool);
+}
+
+static void render_job(void *arg)
+{
+	struct RenderJob *job = (struct RenderJob*) arg;
+	struct Renderer *renderer = job->renderer;
+	TRACE_SCOPE("render");
+
+	struct timespec start = {};
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	pid_t pid = spawn_render(renderer->script, job->dot_name, job->image_name);
+	int status = 0;
+	if (pid > 0 && wait_render(renderer, pid, &status)) {
+		struct timespec end = {};
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		double ms = (double) (end.tv_sec - start.tv_sec) * 1e3 +
+					(double) (end.tv_nsec - start.tv_nsec) / 1e6;
+
+		if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+			log_message(DEBUG, "Rendered %s in %.0f ms\n", job->image_name, ms);
+		else
+			log_message(WARN, "Rendering %s failed\n", job->dot_name);
+	}
+
+	// the image is on disk by now, or it failed and a later dump renders it
+	// again; a detached render is still running, but nothing is dumped then
+	forget_queued(renderer, job->image_name);
+	free_job(job);
+}
+
+static pid_t spawn_render(char *script, char *dot_name, char *image_name)
+{
+	assert(script);
+	assert(dot_name);
+	assert(image_name);
+
+	// its own process group keeps a detached render alive after Ctrl+C
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setpgroup(&attr, 0);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+
+	// posix_spawn takes a non-const argv
+	char sh_name[] = "sh";
+	char sh_flag[] = "-c";
+	char *argv[] = {sh_name, sh_flag, script, dot_name, image_name, NULL};
+	pid_t pid = 0;
+	int err = posix_spawn(&pid, "/bin/sh", NULL, &attr, argv, environ);
+	posix_spawnattr_destroy(&attr);
+	if (err != 0) {
+		log_message(WARN, "Couldn't start rendering %s: %s\n", dot_name, strerror(err));
+		return -1;
+	}
+
+	return pid;
+}
+
+// false if the renderer was detached before the process ended
+static bool wait_render(struct Renderer *renderer, pid_t pid, int *status)
+{
+	assert(renderer);
+	assert(status);
+
+	pthread_mutex_lock(&renderer->lock);
+	while (true) {
+		pid_t done = waitpid(pid, status, WNOHANG);
+		if (done == pid || (done < 0 && errno != EINTR))
+			break;
+		if (renderer->detach) {
+			pthread_mutex_unlock(&renderer->lock);
+			return false;
+		}
+
+		struct timespec deadline = {};
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += RENDER_POLL_MS * 1000000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&renderer->detached, &renderer->lock, &deadline);
+	}
+	pthread_mutex_unlock(&renderer->lock);
+
+	return true;
+}
+
+// must be called with renderer->lock held
+static bool is_queued(const struct Renderer *renderer, const char *image_name)
+{
+	assert(renderer);
+	assert(image_name);
+
+	for (size_t i = 0; i < renderer->num_queued; i++)
+		if (strcmp(renderer->queued[i], image_name) == 0)
+			return true;
+	return false;
+}
+
+// the order of the names doesn't matter, so the last one takes the place
+static void forget_queued(struct Renderer *renderer, const char *image_name)
+{
+	assert(renderer);
+	assert(image_name);
+
+	pthread_mutex_lock(&renderer->lock);
+	for (size_t i = 0; i < renderer->num_queued; i++) {
+		if (strcmp(renderer->queued[i], image_name) != 0)
+			continue;
+		free(renderer->queued[i]);
+		renderer->queued[i] = renderer->queued[--renderer->num_queued];
+		break;
+	}
+	pthread_mutex_unlock(&renderer->lock);
+}
+
+static uint64_t hash_bytes(uint64_t hash, const char *data, size_t len)
+{
+	assert(data);
+
+	for (size_t i = 0; i < len; i++) {
+		hash ^= (unsigned char) data[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static void free_job(struct RenderJob *job)
+{
+	assert(job);
+
+	free(job->dot_name);
+	free(job->image_name);
+	free(job);
+}
+
+const char *render_err_to_str(enum RenderError err)
+{
+	switch (err) {
+		case RENDER_FILE_ERR:
+			return "Couldn't write the DOT file";
+		case RENDER_THREAD_ERR:
+			return "Couldn't start a render thread";
+		case RENDER_NO_MEM_ERR:
+			return "Not enough memory for the render queue";
+		case RENDER_NO_ERR:
+			return "No error occured";
+		default:
+			return "An unknown error occured";
+	}
+}
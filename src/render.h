@@ -0,0 +1,59 @@
+#ifndef _RENDER_H
+#define _RENDER_H
+
+#include <pthread.h>
+
+#include "thread_pool.h"
+
+/*
+ * Renders DOT files into images in the background, several at a time. The
+ * renderer is any shell command that reads DOT from stdin and writes the image
+ * to stdout. It writes into "<image>.part", which is renamed to the image once
+ * the command succeeds, so a page never shows half an image. Unless the
+ * renderer is told to wait, renders still running at render_dtor() are left
+ * to finish after the program exits, and queued ones are started without
+ * waiting for them.
+ *
+ * render_dot() keeps a cache of images named by an FNV-1a hash of the DOT text
+ * and the command. An image that is already on disk, or queued by this renderer,
+ * is reused instead of being rendered again. A name stays queued until its
+ * render ends and is forgotten if the image can't be made, so the next dump
+ * tries it again.
+ */
+struct Renderer {
+	// sh -c script with the DOT file in $0 and the image in $1
+	char *script;
+	struct ThreadPool pool;
+
+	bool detach;
+	pthread_mutex_t lock;
+	pthread_cond_t detached;
+
+	// images queued by render_dot() whose renders haven't ended yet
+	char **queued;
+	size_t num_queued;
+	size_t queued_cap;
+};
+
+enum RenderError {
+	RENDER_FILE_ERR		= -3,
+	RENDER_THREAD_ERR	= -2,
+	RENDER_NO_MEM_ERR	= -1,
+	RENDER_NO_ERR		= 0,
+};
+
+const char *const RENDER_DEFAULT_CMD = "dot -Tpng";
+// how often a job looks whether the renderer was detached while it waits
+const long RENDER_POLL_MS			 = 20;
+const size_t RENDER_INIT_QUEUED		 = 16;
+
+enum RenderError render_ctor(struct Renderer *renderer, const char *cmd, size_t num_jobs);
+void render_dtor(struct Renderer *renderer, bool wait);
+enum RenderError render_submit(struct Renderer *renderer, const char *dot_name,
+							   const char *image_name);
+enum RenderError render_dot(struct Renderer *renderer, const char *cache_dir, const char *dot,
+							size_t dot_len, char *image_name, size_t image_name_size);
+void render_wait(struct Renderer *renderer);
+const char *render_err_to_str(enum RenderError err);
+
+#endif /*_RENDER_H*/
@@ -0,0 +1,246 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include "selfplay.h"
+#include "akinator.h"
+#include "path.h"
+#include "thread_pool.h"
+#include "logger.h"
+#include "trace.h"
+
+struct PlayTask {
+	const struct NameIndex *idx;
+	size_t begin;
+	size_t end;
+	struct Path path;
+
+	size_t *games;
+	size_t games_cap;
+	size_t num_games;
+	size_t num_unreachable;
+	size_t total_questions;
+	bool is_no_mem;
+};
+
+static void play_task(void *arg);
+static size_t play_game(const struct NameIndex *idx, const struct NameEntry *entry,
+						const struct Path *path, bool *is_won);
+static bool count_game(struct PlayTask *task, size_t questions);
+static enum SelfPlayError merge_tasks(struct PlayTask *tasks, size_t num_tasks,
+									  struct SelfPlayReport *report);
+
+enum SelfPlayError selfplay_run(const struct NameIndex *idx, size_t num_threads,
+								struct SelfPlayReport *report)
+{
+	assert(idx);
+	assert(num_threads > 0);
+	assert(report);
+
+	memset(report, 0, sizeof(struct SelfPlayReport));
+
+	enum SelfPlayError err = PLAY_NO_ERR;
+	struct ThreadPool pool = {};
+	size_t num_tasks = PLAY_TASKS_PER_THREAD * num_threads;
+	size_t per_task = idx->num_entries / num_tasks + 1;
+	struct timespec start = {};
+	struct timespec end = {};
+
+	struct PlayTask *tasks = (struct PlayTask*) calloc(num_tasks, sizeof(struct PlayTask));
+	if (!tasks)
+		return PLAY_NO_MEM_ERR;
+	for (size_t i = 0; i < num_tasks; i++) {
+		tasks[i].idx = idx;
+		tasks[i].begin = i * per_task < idx->num_entries ? i * per_task : idx->num_entries;
+		tasks[i].end = tasks[i].begin + per_task < idx->num_entries ?
+					   tasks[i].begin + per_task : idx->num_entries;
+		path_ctor(&tasks[i].path);
+	}
+
+	if (pool_ctor(&pool, num_threads) < 0) {
+		err = PLAY_THREAD_ERR;
+		goto finally;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (size_t i = 0; i < num_tasks; i++) {
+		if (pool_submit(&pool, play_task, &tasks[i]) < 0) {
+			err = PLAY_NO_MEM_ERR;
+			break;
+		}
+	}
+	pool_wait(&pool);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	report->seconds = (double) (end.tv_sec - start.tv_sec) +
+					  (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	if (err == PLAY_NO_ERR)
+		err = merge_tasks(tasks, num_tasks, report);
+
+	finally:
+		if (pool.threads)
+			pool_dtor(&pool);
+		for (size_t i = 0; i < num_tasks; i++) {
+			path_dtor(&tasks[i].path);
+			free(tasks[i].games);
+		}
+		free(tasks);
+
+	if (err < 0)
+		selfplay_report_dtor(report);
+	return err;
+}
+
+static void play_task(void *arg)
+{
+	struct PlayTask *task = (struct PlayTask*) arg;
+	const struct NameIndex *idx = task->idx;
+	TRACE_SCOPE("selfplay_chunk");
+
+	for (size_t i = task->begin; i < task->end && !task->is_no_mem; i++) {
+		const struct NameEntry *entry = &idx->entries[i];
+		if (entry->node->left || entry->node->right)
+			continue;
+
+		if (path_from_entry(&task->path, idx, entry) < 0) {
+			task->is_no_mem = true;
+			break;
+		}
+		bool is_won = false;
+		size_t questions = play_game(idx, entry, &task->path, &is_won);
+		if (!is_won) {
+			log_message(WARN, "%s can't be guessed\n", entry->node->data);
+			task->num_unreachable++;
+		}
+		if (!count_game(task, questions))
+			task->is_no_mem = true;
+	}
+}
+
+// the number of questions asked until the game ended
+static size_t play_game(const struct NameIndex *idx, const struct NameEntry *entry,
+						const struct Path *path, bool *is_won)
+{
+	assert(idx);
+	assert(entry);
+	assert(path);
+	assert(is_won);
+
+	const struct Node *node = idx->root;
+	for (size_t questions = 1; ; questions++) {
+		bool is_leaf = !node->left && !node->right;
+		bool is_yes = is_leaf || questions > path->len ? node == entry->node :
+						  !path_answer(path, questions - 1);
+
+		switch (guess_next(node, is_yes)) {
+			case GUESS_GO_YES:
+				node = node->left;
+				break;
+			case GUESS_GO_NO:
+				node = node->right;
+				break;
+			case GUESS_WON:
+				*is_won = true;
+				return questions;
+			case GUESS_LOST:
+			default:
+				*is_won = false;
+				return questions;
+		}
+	}
+}
+
+static bool count_game(struct PlayTask *task, size_t questions)
+{
+	assert(task);
+
+	if (questions >= task->games_cap) {
+		size_t new_cap = task->games_cap ? task->games_cap : PLAY_INIT_QUESTIONS;
+		while (new_cap <= questions)
+			new_cap *= 2;
+		size_t *games = (size_t*) realloc(task->games, new_cap * sizeof(size_t));
+		if (!games)
+			return false;
+		memset(games + task->games_cap, 0, (new_cap - task->games_cap) * sizeof(size_t));
+		task->games = games;
+		task->games_cap = new_cap;
+	}
+
+	task->games[questions]++;
+	task->num_games++;
+	task->total_questions += questions;
+	return true;
+}
+
+static enum SelfPlayError merge_tasks(struct PlayTask *tasks, size_t num_tasks,
+									  struct SelfPlayReport *report)
+{
+	assert(tasks);
+	assert(report);
+
+	size_t games_len = 0;
+	for (size_t i = 0; i < num_tasks; i++) {
+		if (tasks[i].is_no_mem)
+			return PLAY_NO_MEM_ERR;
+		if (tasks[i].games_cap > games_len)
+			games_len = tasks[i].games_cap;
+	}
+
+	report->games = (size_t*) calloc(games_len + 1, sizeof(size_t));
+	if (!report->games)
+		return PLAY_NO_MEM_ERR;
+	for (size_t i = 0; i < num_tasks; i++) {
+		for (size_t k = 0; k < tasks[i].games_cap; k++) {
+			report->games[k] += tasks[i].games[k];
+			if (tasks[i].games[k] && k > report->max_questions)
+				report->max_questions = k;
+		}
+		report->num_games += tasks[i].num_games;
+		report->num_unreachable += tasks[i].num_unreachable;
+		report->total_questions += tasks[i].total_questions;
+	}
+
+	return PLAY_NO_ERR;
+}
+
+void selfplay_report_dtor(struct SelfPlayReport *report)
+{
+	assert(report);
+
+	free(report->games);
+	report->games = NULL;
+	report->max_questions = 0;
+}
+
+void selfplay_report_print(const struct SelfPlayReport *report, FILE *out)
+{
+	assert(report);
+	assert(out);
+
+	double mean = report->num_games ?
+				  (double) report->total_questions / (double) report->num_games : 0;
+	fprintf(out, "games\t%zu\nunreachable\t%zu\nmean_questions\t%.2f\nmax_questions\t%zu\n"
+			"seconds\t%.3f\ngames_per_second\t%.0f\n", report->num_games,
+			report->num_unreachable, mean, report->max_questions, report->seconds,
+			report->seconds > 0 ? (double) report->num_games / report->seconds : 0);
+
+	fputs("\nquestions\tgames\n", out);
+	for (size_t k = 0; report->games && k <= report->max_questions; k++)
+		if (report->games[k])
+			fprintf(out, "%zu\t%zu\n", k, report->games[k]);
+}
+
+const char *selfplay_err_to_str(enum SelfPlayError err)
+{
+	switch (err) {
+		case PLAY_THREAD_ERR:
+			return "Couldn't start the game threads";
+		case PLAY_NO_MEM_ERR:
+			return "Not enough memory for the games";
+		case PLAY_NO_ERR:
+			return "No error occured";
+		default:
+			return "An unknown error occured";
+	}
+}
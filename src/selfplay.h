@@ -0,0 +1,42 @@
+#ifndef _SELFPLAY_H
+#define _SELFPLAY_H
+
+#include <stdio.h>
+
+#include "name_index.h"
+
+/*
+ * Plays a guess() game for every object in the tree, without stdin. The
+ * player thinks of the object and answers by its path from the name index:
+ * the questions on the path as the path goes, and the guesses "yes" only for
+ * the object itself. The games step with guess_next() as guess() does, so an
+ * object whose game isn't won is one the guesser can't reach. Objects are
+ * split into chunks played in parallel, each counting its games by the number
+ * of questions asked, and the counts are summed at the end.
+ */
+struct SelfPlayReport {
+	size_t num_games;
+	size_t num_unreachable;
+	size_t total_questions;
+	// games[k] games took k questions, k <= max_questions
+	size_t *games;
+	size_t max_questions;
+	double seconds;
+};
+
+enum SelfPlayError {
+	PLAY_THREAD_ERR	= -2,
+	PLAY_NO_MEM_ERR	= -1,
+	PLAY_NO_ERR		= 0,
+};
+
+const size_t PLAY_TASKS_PER_THREAD	= 4;
+const size_t PLAY_INIT_QUESTIONS	= 64;
+
+enum SelfPlayError selfplay_run(const struct NameIndex *idx, size_t num_threads,
+								struct SelfPlayReport *report);
+void selfplay_report_dtor(struct SelfPlayReport *report);
+void selfplay_report_print(const struct SelfPlayReport *report, FILE *out);
+const char *selfplay_err_to_str(enum SelfPlayError err);
+
+#endif /*_SELFPLAY_H*/
@@ -0,0 +1,377 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "similarity.h"
+#include "thread_pool.h"
+#include "buffer.h"
+#include "small_stack.h"
+#include "trace.h"
+
+struct LeafFrame {
+	const struct Node *node;
+	int state;
+};
+
+struct SimTask {
+	const struct LeafIndex *idx;
+	size_t begin;
+	size_t end;
+	size_t num_neighbors;
+	struct Buffer out;
+	enum BufferError err;
+};
+
+static enum SimilarityError leaf_index_grow(struct LeafIndex *idx, size_t new_cap);
+static enum SimilarityError build_sparse_table(struct LeafIndex *idx);
+static void neighbors_task(void *arg);
+static void matrix_task(void *arg);
+static enum SimilarityError run_tasks(struct ThreadPool *pool, struct SimTask *tasks,
+									  size_t num_tasks, size_t rows_per_task,
+									  pool_task_func func, FILE *out);
+
+enum SimilarityError leaf_index_ctor(struct LeafIndex *idx, const struct Node *tree)
+{
+	assert(idx);
+
+	idx->leaves = NULL;
+	idx->depths = NULL;
+	idx->lcp = NULL;
+	idx->num_leaves = 0;
+	idx->sparse = NULL;
+	idx->levels = 0;
+	if (!tree)
+		return SIM_NO_ERR;
+
+	size_t cap = 0;
+	SmallStack<struct LeafFrame, SIM_INIT_DEPTH> frames = {};
+	small_stack_ctor(&frames);
+	small_stack_push(&frames, {tree, 0});
+
+	uint32_t min_since_leaf = UINT32_MAX;
+	while (frames.size > 0) {
+		struct LeafFrame *top = small_stack_top(&frames);
+		const struct Node *node = top->node;
+		struct LeafFrame done = {};
+
+		if (!node->left && !node->right) {
+			if (idx->num_leaves == cap) {
+				cap = cap ? 2 * cap : SIM_CHUNK_SIZE;
+				if (leaf_index_grow(idx, cap) < 0) {
+					small_stack_dtor(&frames);
+					leaf_index_dtor(idx);
+					return SIM_NO_MEM_ERR;
+				}
+			}
+			if (idx->num_leaves > 0)
+				idx->lcp[idx->num_leaves - 1] = min_since_leaf;
+			idx->leaves[idx->num_leaves] = node;
+			idx->depths[idx->num_leaves] = (uint32_t) (frames.size - 1);
+			idx->num_leaves++;
+			min_since_leaf = UINT32_MAX;
+			small_stack_pop(&frames, &done);
+			continue;
+		}
+		if (top->state == 2) {
+			small_stack_pop(&frames, &done);
+			continue;
+		}
+
+		const struct Node *next = top->state == 0 ? node->left : node->right;
+		top->state++;
+		if (!next)
+			continue;
+
+		// the shallowest node we descend from between two leaves is their LCA
+		if (frames.size - 1 < min_since_leaf)
+			min_since_leaf = (uint32_t) (frames.size - 1);
+
+		if (small_stack_push(&frames, {next, 0}) < 0) {
+			small_stack_dtor(&frames);
+			leaf_index_dtor(idx);
+			return SIM_NO_MEM_ERR;
+		}
+	}
+	small_stack_dtor(&frames);
+
+	enum SimilarityError err = build_sparse_table(idx);
+	if (err < 0)
+		leaf_index_dtor(idx);
+	return err;
+}
+
+static enum SimilarityError leaf_index_grow(struct LeafIndex *idx, size_t new_cap)
+{
+	assert(idx);
+
+	const struct Node **leaves = (const struct Node**) realloc(idx->leaves,
+										new_cap * sizeof(const struct Node*));
+	if (!leaves)
+		return SIM_NO_MEM_ERR;
+	idx->leaves = leaves;
+
+	uint32_t *depths = (uint32_t*) realloc(idx->depths, new_cap * sizeof(uint32_t));
+	if (!depths)
+		return SIM_NO_MEM_ERR;
+	idx->depths = depths;
+
+	uint32_t *lcp = (uint32_t*) realloc(idx->lcp, new_cap * sizeof(uint32_t));
+	if (!lcp)
+		return SIM_NO_MEM_ERR;
+	idx->lcp = lcp;
+
+	return SIM_NO_ERR;
+}
+
+static enum SimilarityError build_sparse_table(struct LeafIndex *idx)
+{
+	assert(idx);
+
+	if (idx->num_leaves < 2)
+		return SIM_NO_ERR;
+
+	size_t len = idx->num_leaves - 1;
+	size_t levels = 1;
+	while (((size_t) 1 << levels) <= len)
+		levels++;
+
+	idx->sparse = (uint32_t**) calloc(levels, sizeof(uint32_t*));
+	if (!idx->sparse)
+		return SIM_NO_MEM_ERR;
+	idx->levels = levels;
+	idx->sparse[0] = idx->lcp;
+
+	for (size_t k = 1; k < levels; k++) {
+		size_t half = (size_t) 1 << (k - 1);
+		size_t count = len - 2 * half + 1;
+		idx->sparse[k] = (uint32_t*) calloc(count, sizeof(uint32_t));
+		if (!idx->sparse[k])
+			return SIM_NO_MEM_ERR;
+
+		const uint32_t *prev = idx->sparse[k - 1];
+		for (size_t i = 0; i < count; i++)
+			idx->sparse[k][i] = prev[i] < prev[i + half] ? prev[i] : prev[i + half];
+	}
+
+	return SIM_NO_ERR;
+}
+
+void leaf_index_dtor(struct LeafIndex *idx)
+{
+	assert(idx);
+
+	// sparse[0] is lcp itself
+	for (size_t k = 1; idx->sparse && k < idx->levels; k++)
+		free(idx->sparse[k]);
+	free(idx->sparse);
+	free(idx->leaves);
+	free(idx->depths);
+	free(idx->lcp);
+
+	idx->sparse = NULL;
+	idx->leaves = NULL;
+	idx->depths = NULL;
+	idx->lcp = NULL;
+	idx->levels = 0;
+	idx->num_leaves = 0;
+}
+
+uint32_t leaf_index_shared_depth(const struct LeafIndex *idx, size_t i, size_t j)
+{
+	assert(idx);
+	assert(i < idx->num_leaves);
+	assert(j < idx->num_leaves);
+
+	if (i == j)
+		return idx->depths[i];
+
+	size_t left = i < j ? i : j;
+	size_t right = (i < j ? j : i) - 1;
+	size_t k = (size_t) (63 - __builtin_clzll(right - left + 1));
+
+	uint32_t a = idx->sparse[k][left];
+	uint32_t b = idx->sparse[k][right + 1 - ((size_t) 1 << k)];
+	return a < b ? a : b;
+}
+
+enum SimilarityError similarity_report(const struct LeafIndex *idx,
+									   const char *neighbors_filename,
+									   const char *matrix_filename,
+									   size_t num_neighbors, size_t num_threads)
+{
+	assert(idx);
+	assert(neighbors_filename);
+
+	enum SimilarityError err = SIM_NO_ERR;
+	struct ThreadPool pool = {};
+	size_t num_tasks = 2 * num_threads;
+	FILE *out = NULL;
+
+	struct SimTask *tasks = (struct SimTask*) calloc(num_tasks, sizeof(struct SimTask));
+	if (!tasks)
+		return SIM_NO_MEM_ERR;
+	for (size_t i = 0; i < num_tasks; i++) {
+		tasks[i].idx = idx;
+		tasks[i].num_neighbors = num_neighbors;
+		if (buffer_ctor(&tasks[i].out) < 0) {
+			err = SIM_NO_MEM_ERR;
+			goto finally;
+		}
+	}
+
+	if (pool_ctor(&pool, num_threads) < 0) {
+		err = SIM_THREAD_ERR;
+		goto finally;
+	}
+
+	out = fopen(neighbors_filename, "w");
+	if (!out) {
+		err = SIM_FILE_ERR;
+		goto finally;
+	}
+	fputs("object\trank\tneighbor\tshared_depth\n", out);
+	err = run_tasks(&pool, tasks, num_tasks, SIM_CHUNK_SIZE, neighbors_task, out);
+	if (fclose(out) != 0 && err == SIM_NO_ERR)
+		err = SIM_FILE_ERR;
+	out = NULL;
+	if (err < 0 || !matrix_filename)
+		goto finally;
+
+	out = fopen(matrix_filename, "w");
+	if (!out) {
+		err = SIM_FILE_ERR;
+		goto finally;
+	}
+	for (size_t i = 0; i < idx->num_leaves; i++)
+		fprintf(out, "\t%s", idx->leaves[i]->data);
+	fputc('\n', out);
+	err = run_tasks(&pool, tasks, num_tasks,
+					SIM_CHUNK_SIZE * SIM_CHUNK_SIZE / (idx->num_leaves + 1) + 1,
+					matrix_task, out);
+	if (fclose(out) != 0 && err == SIM_NO_ERR)
+		err = SIM_FILE_ERR;
+	out = NULL;
+
+	finally:
+		if (pool.threads)
+			pool_dtor(&pool);
+		for (size_t i = 0; i < num_tasks; i++)
+			buffer_dtor(&tasks[i].out);
+		free(tasks);
+
+	return err;
+}
+
+static enum SimilarityError run_tasks(struct ThreadPool *pool, struct SimTask *tasks,
+									  size_t num_tasks, size_t rows_per_task,
+									  pool_task_func func, FILE *out)
+{
+	assert(pool);
+	assert(tasks);
+	assert(func);
+	assert(out);
+
+	size_t num_leaves = tasks[0].idx->num_leaves;
+	size_t next_row = 0;
+	while (next_row < num_leaves) {
+		size_t wave = 0;
+		for (; wave < num_tasks && next_row < num_leaves; wave++) {
+			tasks[wave].begin = next_row;
+			next_row += rows_per_task;
+			tasks[wave].end = next_row < num_leaves ? next_row : num_leaves;
+			tasks[wave].err = BUF_NO_ERR;
+			buffer_reset(&tasks[wave].out);
+
+			if (pool_submit(pool, func, &tasks[wave]) < 0) {
+				pool_wait(pool);
+				return SIM_NO_MEM_ERR;
+			}
+		}
+		pool_wait(pool);
+
+		// chunks are written in leaf order regardless of completion order
+		for (size_t i = 0; i < wave; i++) {
+			if (tasks[i].err < 0)
+				return SIM_NO_MEM_ERR;
+			fwrite(tasks[i].out.data, sizeof(char), buffer_size(&tasks[i].out), out);
+		}
+		if (ferror(out))
+			return SIM_FILE_ERR;
+	}
+
+	return SIM_NO_ERR;
+}
+
+static void neighbors_task(void *arg)
+{
+	struct SimTask *task = (struct SimTask*) arg;
+	const struct LeafIndex *idx = task->idx;
+	TRACE_SCOPE("similarity_neighbors");
+
+	for (size_t i = task->begin; i < task->end && task->err == BUF_NO_ERR; i++) {
+		// the deepest shared prefixes are the closest leaves in DFS order
+		size_t left = i;
+		size_t right = i;
+		uint32_t left_depth = i > 0 ? idx->lcp[i - 1] : 0;
+		uint32_t right_depth = i + 1 < idx->num_leaves ? idx->lcp[i] : 0;
+
+		for (size_t rank = 1; rank <= task->num_neighbors; rank++) {
+			bool has_left = left > 0;
+			bool has_right = right + 1 < idx->num_leaves;
+			if (!has_left && !has_right)
+				break;
+
+			size_t neighbor = 0;
+			uint32_t depth = 0;
+			if (has_left && (!has_right || left_depth >= right_depth)) {
+				neighbor = --left;
+				depth = left_depth;
+				if (left > 0 && idx->lcp[left - 1] < left_depth)
+					left_depth = idx->lcp[left - 1];
+			} else {
+				neighbor = ++right;
+				depth = right_depth;
+				if (right + 1 < idx->num_leaves && idx->lcp[right] < right_depth)
+					right_depth = idx->lcp[right];
+			}
+
+			task->err = buffer_printf(&task->out, "%s\t%zu\t%s\t%u\n",
+									  idx->leaves[i]->data, rank,
+									  idx->leaves[neighbor]->data, depth);
+			if (task->err < 0)
+				break;
+		}
+	}
+}
+
+static void matrix_task(void *arg)
+{
+	struct SimTask *task = (struct SimTask*) arg;
+	const struct LeafIndex *idx = task->idx;
+	TRACE_SCOPE("similarity_matrix");
+
+	for (size_t i = task->begin; i < task->end && task->err == BUF_NO_ERR; i++) {
+		task->err = buffer_printf(&task->out, "%s", idx->leaves[i]->data);
+		for (size_t j = 0; j < idx->num_leaves && task->err == BUF_NO_ERR; j++)
+			task->err = buffer_printf(&task->out, "\t%u",
+									  leaf_index_shared_depth(idx, i, j));
+		if (task->err == BUF_NO_ERR)
+			task->err = buffer_append(&task->out, "\n", 1);
+	}
+}
+
+const char *similarity_err_to_str(enum SimilarityError err)
+{
+	switch (err) {
+		case SIM_THREAD_ERR:
+			return "Couldn't start the thread pool";
+		case SIM_FILE_ERR:
+			return "Error writing the similarity report";
+		case SIM_NO_MEM_ERR:
+			return "Not enough memory for the similarity index";
+		case SIM_NO_ERR:
+			return "No error occured";
+		default:
+			return "An unknown error occured";
+	}
+}
@@ -0,0 +1,45 @@
+#ifndef _SIMILARITY_H
+#define _SIMILARITY_H
+
+#include <stdint.h>
+
+#include "tree.h"
+
+/*
+ * Leaves are numbered in DFS order. lcp[i] is the depth of the lowest common
+ * ancestor of leaves i and i + 1, i.e. the number of answers they share. This
+ * is the Euler tour of the tree restricted to leaves, so the shared depth of
+ * any two leaves i < j is the minimum of lcp[i..j-1], answered in O(1) by a
+ * sparse table.
+ */
+struct LeafIndex {
+	const struct Node **leaves;
+	uint32_t *depths;
+	uint32_t *lcp;
+	size_t num_leaves;
+
+	uint32_t **sparse;
+	size_t levels;
+};
+
+enum SimilarityError {
+	SIM_THREAD_ERR	= -3,
+	SIM_FILE_ERR	= -2,
+	SIM_NO_MEM_ERR	= -1,
+	SIM_NO_ERR		= 0,
+};
+
+const size_t SIM_CHUNK_SIZE		 = 4096;
+const size_t SIM_DEFAULT_NEIGHBORS = 5;
+const size_t SIM_INIT_DEPTH		 = 64;
+
+enum SimilarityError leaf_index_ctor(struct LeafIndex *idx, const struct Node *tree);
+void leaf_index_dtor(struct LeafIndex *idx);
+uint32_t leaf_index_shared_depth(const struct LeafIndex *idx, size_t i, size_t j);
+enum SimilarityError similarity_report(const struct LeafIndex *idx,
+									   const char *neighbors_filename,
+									   const char *matrix_filename,
+									   size_t num_neighbors, size_t num_threads);
+const char *similarity_err_to_str(enum SimilarityError err);
+
+#endif /*_SIMILARITY_H*/
@@ -0,0 +1,198 @@
+#ifndef _SMALL_STACK_H
+#define _SMALL_STACK_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <type_traits>
+
+#include "stack.h"
+#include "logger.h"
+#include "mem.h"
+
+/*
+ * A stack of any trivially copyable T. The first INLINE_CAP elements live in
+ * the struct itself; the storage moves to the heap only when it overflows.
+ * The heap part doubles when full and halves only once it is a quarter full,
+ * so alternating pushes and pops around a boundary never reallocate.
+ *
+ * The debug features of struct Stack are policies: canaries around the struct
+ * and poisoning of free slots (a push checks that the slot it writes is still
+ * poisoned). Both are O(1) per operation, and a policy that disables them
+ * costs nothing because the checks are compile-time constants. A failed check
+ * is reported and aborts, as VALIDATE_STACK does. The data pointer may point
+ * into the struct, so a SmallStack must not be copied by value.
+ */
+struct StackChecksOff {
+	static const bool CANARIES = false;
+	static const bool POISON = false;
+};
+
+struct StackChecksCanary {
+	static const bool CANARIES = true;
+	static const bool POISON = false;
+};
+
+struct StackChecksFull {
+	static const bool CANARIES = true;
+	static const bool POISON = true;
+};
+
+#if STACK_PROTECTION_LEVEL >= STACK_PROTECT_SAMPLED
+typedef StackChecksFull StackChecksDefault;
+#elif STACK_PROTECTION_LEVEL == STACK_PROTECT_CANARY
+typedef StackChecksCanary StackChecksDefault;
+#else
+typedef StackChecksOff StackChecksDefault;
+#endif
+
+const unsigned long long SMALL_STACK_CANARY = 0xDECAFBADDECAFBAD;
+const size_t SMALL_STACK_SHRINK_COEF = 4;
+
+template <typename T, size_t INLINE_CAP, typename Checks = StackChecksDefault>
+struct SmallStack {
+	static_assert(std::is_trivially_copyable<T>::value,
+				  "SmallStack elements are moved with memcpy");
+	static_assert(INLINE_CAP > 0, "SmallStack needs inline storage");
+
+	unsigned long long left_canary;
+	T *data;
+	size_t size;
+	size_t capacity;
+	T inline_data[INLINE_CAP];
+	unsigned long long right_canary;
+};
+
+template <typename T, size_t INLINE_CAP, typename Checks>
+void small_stack_fail(const SmallStack<T, INLINE_CAP, Checks> *stk, const char *reason)
+{
+	log_message(ERROR, "SmallStack [%p] (size %zu, capacity %zu): %s\n",
+				(const void*) stk, stk->size, stk->capacity, reason);
+	abort();
+}
+
+template <typename T, size_t INLINE_CAP, typename Checks>
+void small_stack_poison(T *elems, size_t count)
+{
+	if (Checks::POISON)
+		memset((void*) elems, POISON, count * sizeof(T));
+}
+
+template <typename T>
+bool small_stack_is_poisoned(const T *elem)
+{
+	const unsigned char *bytes = (const unsigned char*) elem;
+	for (size_t i = 0; i < sizeof(T); i++)
+		if (bytes[i] != (unsigned char) POISON)
+			return false;
+	return true;
+}
+
+template <typename T, size_t INLINE_CAP, typename Checks>
+void small_stack_check(const SmallStack<T, INLINE_CAP, Checks> *stk)
+{
+	if (Checks::CANARIES && (stk->left_canary != SMALL_STACK_CANARY ||
+							 stk->right_canary != SMALL_STACK_CANARY))
+		small_stack_fail(stk, "a canary is bad");
+	if ((Checks::CANARIES || Checks::POISON) && stk->size > stk->capacity)
+		small_stack_fail(stk, "size is greater than capacity");
+}
+
+template <typename T, size_t INLINE_CAP, typename Checks>
+void small_stack_ctor(SmallStack<T, INLINE_CAP, Checks> *stk)
+{
+	stk->data = stk->inline_data;
+	stk->size = 0;
+	stk->capacity = INLINE_CAP;
+	if (Checks::CANARIES) {
+		stk->left_canary = SMALL_STACK_CANARY;
+		stk->right_canary = SMALL_STACK_CANARY;
+	}
+	small_stack_poison<T, INLINE_CAP, Checks>(stk->inline_data, INLINE_CAP);
+}
+
+template <typename T, size_t INLINE_CAP, typename Checks>
+void small_stack_dtor(SmallStack<T, INLINE_CAP, Checks> *stk)
+{
+	small_stack_check(stk);
+
+	if (stk->data != stk->inline_data)
+		mem_free(MEM_STACK, stk->data, stk->capacity * sizeof(T));
+	stk->data = stk->inline_data;
+	stk->size = 0;
+	stk->capacity = INLINE_CAP;
+}
+
+template <typename T, size_t INLINE_CAP, typename Checks>
+enum StackError small_stack_resize(SmallStack<T, INLINE_CAP, Checks> *stk, size_t new_cap)
+{
+	T *mem = NULL;
+	if (new_cap <= INLINE_CAP) {
+		new_cap = INLINE_CAP;
+		mem = stk->inline_data;
+		memcpy((void*) mem, stk->data, stk->size * sizeof(T));
+		mem_free(MEM_STACK, stk->data, stk->capacity * sizeof(T));
+	} else if (stk->data == stk->inline_data) {
+		mem = (T*) mem_calloc(MEM_STACK, new_cap, sizeof(T));
+		if (!mem)
+			return ERR_NO_MEM;
+		memcpy((void*) mem, stk->inline_data, stk->size * sizeof(T));
+	} else {
+		mem = (T*) mem_realloc(MEM_STACK, (void*) stk->data, stk->capacity * sizeof(T),
+							   new_cap * sizeof(T));
+		if (!mem)
+			return ERR_NO_MEM;
+	}
+
+	stk->data = mem;
+	stk->capacity = new_cap;
+	small_stack_poison<T, INLINE_CAP, Checks>(stk->data + stk->size,
+											  stk->capacity - stk->size);
+	return STACK_NO_ERR;
+}
+
+template <typename T, size_t INLINE_CAP, typename Checks>
+enum StackError small_stack_push(SmallStack<T, INLINE_CAP, Checks> *stk, T value)
+{
+	small_stack_check(stk);
+
+	if (stk->size == stk->capacity) {
+		enum StackError err = small_stack_resize(stk, stk->capacity * MULTIPLIER);
+		if (err < 0)
+			return err;
+	}
+
+	if (Checks::POISON && !small_stack_is_poisoned(&stk->data[stk->size]))
+		small_stack_fail(stk, "a free slot was written to");
+	stk->data[stk->size++] = value;
+	return STACK_NO_ERR;
+}
+
+template <typename T, size_t INLINE_CAP, typename Checks>
+enum StackError small_stack_pop(SmallStack<T, INLINE_CAP, Checks> *stk, T *value)
+{
+	small_stack_check(stk);
+
+	if (stk->size == 0)
+		return ERR_STACK_EMPTY;
+
+	*value = stk->data[--stk->size];
+	small_stack_poison<T, INLINE_CAP, Checks>(&stk->data[stk->size], 1);
+
+	// a failed shrink just keeps the larger storage
+	if (stk->capacity > INLINE_CAP && stk->size * SMALL_STACK_SHRINK_COEF <= stk->capacity)
+		small_stack_resize(stk, stk->capacity / MULTIPLIER);
+	return STACK_NO_ERR;
+}
+
+// the top element, valid until the next push or pop
+template <typename T, size_t INLINE_CAP, typename Checks>
+T *small_stack_top(SmallStack<T, INLINE_CAP, Checks> *stk)
+{
+	small_stack_check(stk);
+
+	if (stk->size == 0)
+		return NULL;
+	return &stk->data[stk->size - 1];
+}
+
+#endif /*_SMALL_STACK_H*/
@@ -0,0 +1,314 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#include "speech.h"
+#include "logger.h"
+
+extern char **environ;
+
+static void *speech_worker(void *arg);
+static bool spawn_backend(struct Speech *speech);
+static void reap_backend(struct Speech *speech);
+static bool write_line(int fd, const char *text);
+static bool is_speaking(const struct Speech *speech);
+static uint64_t now_ms();
+
+enum SpeechError speech_ctor(struct Speech *speech, const char *cmd)
+{
+	assert(speech);
+	assert(cmd);
+
+	speech->queue = (char**) calloc(SPEECH_INIT_QUEUE, sizeof(char*));
+	if (!speech->queue)
+		return SPEECH_NO_MEM_ERR;
+
+	speech->cmd = cmd;
+	speech->pid = 0;
+	speech->fd = -1;
+	speech->head = 0;
+	speech->count = 0;
+	speech->cap = SPEECH_INIT_QUEUE;
+	speech->busy_until_ms = 0;
+	speech->restart = false;
+	speech->stop = false;
+
+	// a backend that exits must not kill the game on the next write
+	signal(SIGPIPE, SIG_IGN);
+
+	pthread_mutex_init(&speech->lock, NULL);
+	pthread_cond_init(&speech->has_work, NULL);
+	if (pthread_create(&speech->worker, NULL, speech_worker, speech) != 0) {
+		pthread_mutex_destroy(&speech->lock);
+		pthread_cond_destroy(&speech->has_work);
+		free(speech->queue);
+		speech->queue = NULL;
+		return SPEECH_THREAD_ERR;
+	}
+
+	return SPEECH_NO_ERR;
+}
+
+// speaks what is still queued and waits for the backend to finish
+void speech_dtor(struct Speech *speech)
+{
+	assert(speech);
+
+	if (!speech->queue)
+		return;
+
+	pthread_mutex_lock(&speech->lock);
+	speech->stop = true;
+	pthread_cond_signal(&speech->has_work);
+	pthread_mutex_unlock(&speech->lock);
+	pthread_join(speech->worker, NULL);
+
+	pthread_mutex_destroy(&speech->lock);
+	pthread_cond_destroy(&speech->has_work);
+	free(speech->queue);
+	speech->queue = NULL;
+	speech->count = 0;
+	speech->cap = 0;
+}
+
+enum SpeechError speech_say(struct Speech *speech, const char *text)
+{
+	assert(speech);
+	assert(text);
+
+	char *line = strdup(text);
+	if (!line)
+		return SPEECH_NO_MEM_ERR;
+	// the backend reads one utterance per line
+	for (char *c = line; *c; c++)
+		if (*c == '\n' || *c == '\r')
+			*c = ' ';
+
+	pthread_mutex_lock(&speech->lock);
+	if (speech->count == speech->cap) {
+		char **tmp = (char**) calloc(2 * speech->cap, sizeof(char*));
+		if (!tmp) {
+			pthread_mutex_unlock(&speech->lock);
+			free(line);
+			return SPEECH_NO_MEM_ERR;
+		}
+		for (size_t i = 0; i < speech->count; i++)
+			tmp[i] = speech->queue[(speech->head + i) % speech->cap];
+		free(speech->queue);
+		speech->queue = tmp;
+		speech->head = 0;
+		speech->cap *= 2;
+	}
+	speech->queue[(speech->head + speech->count) % speech->cap] = line;
+	speech->count++;
+	pthread_cond_signal(&speech->has_work);
+	pthread_mutex_unlock(&speech->lock);
+
+	return SPEECH_NO_ERR;
+}
+
+void speech_cancel(struct Speech *speech)
+{
+	assert(speech);
+
+	pthread_mutex_lock(&speech->lock);
+	for (size_t i = 0; i < speech->count; i++)
+		free(speech->queue[(speech->head + i) % speech->cap]);
+	speech->head = 0;
+	speech->count = 0;
+
+	// an idle backend is kept for the next line; the pipe may still hold
+	// lines, only a new process drops them; the worker owns the process, so
+	// it reaps it and closes the pipe itself
+	if (is_speaking(speech)) {
+		kill(-speech->pid, SIGTERM);
+		speech->restart = true;
+		speech->busy_until_ms = 0;
+		pthread_cond_signal(&speech->has_work);
+	}
+	pthread_mutex_unlock(&speech->lock);
+}
+
+static void *speech_worker(void *arg)
+{
+	struct Speech *speech = (struct Speech*) arg;
+
+	pthread_mutex_lock(&speech->lock);
+	while (true) {
+		while (speech->count == 0 && !speech->stop && !speech->restart)
+			pthread_cond_wait(&speech->has_work, &speech->lock);
+
+		if (speech->restart) {
+			speech->restart = false;
+			pthread_mutex_unlock(&speech->lock);
+			reap_backend(speech);
+			pthread_mutex_lock(&speech->lock);
+			continue;
+		}
+		if (speech->count == 0)
+			break;
+
+		char *line = speech->queue[speech->head];
+		speech->head = (speech->head + 1) % speech->cap;
+		speech->count--;
+		// the line is said after the ones before it
+		uint64_t now = now_ms();
+		uint64_t start = speech->busy_until_ms > now ? speech->busy_until_ms : now;
+		speech->busy_until_ms = start + SPEECH_LINE_MS +
+								1000 * strlen(line) / SPEECH_BYTES_PER_SEC;
+		pthread_mutex_unlock(&speech->lock);
+
+		if (speech->fd >= 0 || spawn_backend(speech)) {
+			if (!write_line(speech->fd, line)) {
+				pthread_mutex_lock(&speech->lock);
+				bool is_cancelled = speech->restart;
+				pthread_mutex_unlock(&speech->lock);
+				if (!is_cancelled)
+					log_message(WARN, "Speech backend \"%s\" stopped reading\n",
+								speech->cmd);
+				reap_backend(speech);
+			}
+		}
+		free(line);
+
+		pthread_mutex_lock(&speech->lock);
+	}
+	pthread_mutex_unlock(&speech->lock);
+
+	reap_backend(speech);
+	return NULL;
+}
+
+static bool spawn_backend(struct Speech *speech)
+{
+	assert(speech);
+
+	int fds[2] = {};
+	if (pipe2(fds, O_CLOEXEC) != 0) {
+		log_message(WARN, "Couldn't create a pipe for speech: %s\n", strerror(errno));
+		return false;
+	}
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO);
+
+	// the backend gets its own process group, so that cancelling also stops
+	// whatever the shell started, and the default SIGPIPE handling back
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+	sigset_t sigdefault;
+	sigemptyset(&sigdefault);
+	sigaddset(&sigdefault, SIGPIPE);
+	posix_spawnattr_setsigdefault(&attr, &sigdefault);
+	posix_spawnattr_setpgroup(&attr, 0);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF);
+
+	// posix_spawn takes a non-const argv
+	char sh_name[] = "sh";
+	char sh_flag[] = "-c";
+	char *cmd = strdup(speech->cmd);
+	char *argv[] = {sh_name, sh_flag, cmd, NULL};
+	pid_t pid = 0;
+	int err = cmd ? posix_spawn(&pid, "/bin/sh", &actions, &attr, argv, environ) : ENOMEM;
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attr);
+	free(cmd);
+	close(fds[0]);
+	if (err != 0) {
+		log_message(WARN, "Couldn't start speech backend \"%s\": %s\n",
+					speech->cmd, strerror(err));
+		close(fds[1]);
+		return false;
+	}
+
+	pthread_mutex_lock(&speech->lock);
+	speech->pid = pid;
+	speech->fd = fds[1];
+	pthread_mutex_unlock(&speech->lock);
+	return true;
+}
+
+// closing the pipe lets the backend finish; a cancelled one was killed before
+static void reap_backend(struct Speech *speech)
+{
+	assert(speech);
+
+	pthread_mutex_lock(&speech->lock);
+	pid_t pid = speech->pid;
+	int fd = speech->fd;
+	speech->pid = 0;
+	speech->fd = -1;
+	pthread_mutex_unlock(&speech->lock);
+
+	if (fd >= 0)
+		close(fd);
+	if (pid > 0)
+		waitpid(pid, NULL, 0);
+}
+
+static bool write_line(int fd, const char *text)
+{
+	assert(text);
+
+	size_t len = strlen(text);
+	while (len > 0) {
+		ssize_t written = write(fd, text, len);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written < 0)
+			return false;
+		text += written;
+		len -= (size_t) written;
+	}
+	while (true) {
+		ssize_t written = write(fd, "\n", 1);
+		if (written == 1)
+			return true;
+		if (written < 0 && errno != EINTR)
+			return false;
+	}
+}
+
+// with the lock held; a line is being written, is still in the pipe, or
+// hasn't had the time to be said
+static bool is_speaking(const struct Speech *speech)
+{
+	assert(speech);
+
+	if (speech->pid <= 0)
+		return false;
+	if (now_ms() < speech->busy_until_ms)
+		return true;
+	int unread = 0;
+	return speech->fd >= 0 && ioctl(speech->fd, FIONREAD, &unread) == 0 && unread > 0;
+}
+
+static uint64_t now_ms()
+{
+	struct timespec ts = {};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+}
+
+const char *speech_err_to_str(enum SpeechError err)
+{
+	switch (err) {
+		case SPEECH_THREAD_ERR:
+			return "Couldn't start the speech thread";
+		case SPEECH_NO_MEM_ERR:
+			return "Not enough memory for the speech queue";
+		case SPEECH_NO_ERR:
+			return "No error occured";
+		default:
+			return "An unknown error occured";
+	}
+}
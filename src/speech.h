@@ -0,0 +1,55 @@
+#ifndef _SPEECH_H
+#define _SPEECH_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Text-to-speech through one long-lived synthesizer process. The backend is
+ * any shell command that reads utterances from stdin, one per line. Lines are
+ * queued and written to the pipe by a worker thread, so the game never waits
+ * for playback. speech_cancel() drops the queued lines; only if a line is
+ * still being said, it kills the process to silence it, and a new one is
+ * started for the next line. A backend doesn't tell when it is done, so a
+ * written line is taken to be playing while the pipe still holds it, or until
+ * SPEECH_LINE_MS plus its length at SPEECH_BYTES_PER_SEC have passed.
+ */
+struct Speech {
+	const char *cmd;
+	pid_t pid;
+	int fd;
+
+	char **queue;
+	size_t head;
+	size_t count;
+	size_t cap;
+
+	// when the lines written so far should be said, in CLOCK_MONOTONIC ms
+	uint64_t busy_until_ms;
+	bool restart;
+	bool stop;
+	pthread_t worker;
+	pthread_mutex_t lock;
+	pthread_cond_t has_work;
+};
+
+enum SpeechError {
+	SPEECH_THREAD_ERR	= -2,
+	SPEECH_NO_MEM_ERR	= -1,
+	SPEECH_NO_ERR		= 0,
+};
+
+const char *const SPEECH_DEFAULT_CMD = "festival --tts";
+const size_t SPEECH_INIT_QUEUE		 = 16;
+const uint64_t SPEECH_LINE_MS		 = 500;
+// about 12 letters a second, most of them two bytes in UTF-8
+const uint64_t SPEECH_BYTES_PER_SEC	 = 24;
+
+enum SpeechError speech_ctor(struct Speech *speech, const char *cmd);
+void speech_dtor(struct Speech *speech);
+enum SpeechError speech_say(struct Speech *speech, const char *text);
+void speech_cancel(struct Speech *speech);
+const char *speech_err_to_str(enum SpeechError err);
+
+#endif /*_SPEECH_H*/
@@ -5,8 +5,10 @@
 #include "logger.h"
 #include "stack.h"
 #include "stack_debug.h"
+#include "mem.h"
 
 enum StackError reallocate_stack(struct Stack *stk, size_t old_size, size_t new_size);
+static size_t stack_bytes(size_t capacity);
 
 enum StackError stack_ctor(struct Stack *stk, stk_print_func print_elem,
 						   const char *varname, int line, const char *filename,
@@ -33,17 +35,18 @@ enum StackError stack_ctor(struct Stack *stk, stk_print_func print_elem,
 
 #ifdef CANARY_PROTECTION
 	stk->capacity += (sizeof(canary_t) - stk->capacity % sizeof(canary_t)) % sizeof(canary_t);
-	mem = (stk_elem_t*) calloc(stk->capacity * sizeof(stk_elem_t) + 2 * sizeof(canary_t),
-						   sizeof(char));
+	mem = (stk_elem_t*) mem_calloc(MEM_STACK, stack_bytes(stk->capacity), sizeof(char));
 	if (mem == NULL) return ERR_NO_MEM;
 	stk->data = (stk_elem_t*) ((unsigned char*) mem + sizeof(canary_t));
 #else
-	mem = (stk_elem_t*) calloc(stk->capacity, sizeof(stk_elem_t));
+	mem = (stk_elem_t*) mem_calloc(MEM_STACK, stk->capacity, sizeof(stk_elem_t));
 	if (mem == NULL) return ERR_NO_MEM;
 	stk->data = mem;
 #endif
 
+#ifdef POISON_PROTECTION
 	memset(stk->data, POISON, stk->capacity * sizeof(stk_elem_t));
+#endif
 	
 	stk->filename = filename;
 	stk->line = line;
@@ -57,7 +60,12 @@ enum StackError stack_ctor(struct Stack *stk, stk_print_func print_elem,
 	*((canary_t*) (stk->data + stk->capacity)) = DEFAULT_CANARY;
 #endif
 
+#if STACK_PROTECTION_LEVEL == STACK_PROTECT_SAMPLED
+	stk->num_ops = 0;
+#endif
+
 #ifdef HASH_PROTECTION
+	stk->data_hash = 0;
 	update_hash(stk);
 #endif
 	
@@ -67,16 +75,17 @@ enum StackError stack_ctor(struct Stack *stk, stk_print_func print_elem,
 enum StackError stack_dtor(struct Stack *stk)
 {
 	VALIDATE_STACK(stk);
-	
+
+	size_t bytes = stack_bytes(stk->capacity);
 	stk->size = 0;
 	stk->capacity = 0;
 
 #ifdef CANARY_PROTECTION
 	stk->right_canary = 0;
 	stk->left_canary = 0;
-	free((unsigned char*) stk->data - sizeof(canary_t));
+	mem_free(MEM_STACK, (unsigned char*) stk->data - sizeof(canary_t), bytes);
 #else
-	free(stk->data);
+	mem_free(MEM_STACK, stk->data, bytes);
 #endif
 
 	stk->data = NULL;
@@ -92,6 +101,9 @@ enum StackError stack_dtor(struct Stack *stk)
 enum StackError reallocate_stack(struct Stack *stk, size_t old_size, size_t new_size)
 {
 	VALIDATE_STACK(stk);
+#if STACK_PROTECTION_LEVEL == STACK_PROTECT_OFF
+	(void) old_size;
+#endif
 
 	stk_elem_t *mem = NULL;
 
@@ -100,19 +112,22 @@ enum StackError reallocate_stack(struct Stack *stk, size_t old_size, size_t new_
 	if (new_size == old_size)
 		return STACK_NO_ERR;
 	
-	mem = (stk_elem_t*) realloc((unsigned char*) stk->data - sizeof(canary_t),
-							new_size * sizeof(stk_elem_t) + 2 * sizeof(canary_t));
+	mem = (stk_elem_t*) mem_realloc(MEM_STACK, (unsigned char*) stk->data - sizeof(canary_t),
+									stack_bytes(stk->capacity), stack_bytes(new_size));
 	if (!mem) return ERR_NO_MEM;
 	stk->data = (stk_elem_t*) ((unsigned char*) mem + sizeof(canary_t));
 #else
-	mem = (stk_elem_t*) realloc(stk->data, new_size * sizeof(stk_elem_t));
+	mem = (stk_elem_t*) mem_realloc(MEM_STACK, stk->data, stack_bytes(stk->capacity),
+									stack_bytes(new_size));
 	if (!mem) return ERR_NO_MEM;
 	stk->data = mem;
 #endif
 
 	stk->capacity = new_size;
+#ifdef POISON_PROTECTION
 	if (new_size > old_size)
 		memset(stk->data + old_size, POISON, (new_size - old_size) * sizeof(stk_elem_t));
+#endif
 
 #ifdef HASH_PROTECTION
 	update_hash(stk);
@@ -138,6 +153,7 @@ enum StackError stack_push(struct Stack *stk, stk_elem_t value)
 	stk->data[stk->size++] = value;
 
 #ifdef HASH_PROTECTION
+	stk->data_hash += elem_hash(stk->size - 1, value);
 	update_hash(stk);
 #endif
 
@@ -157,15 +173,28 @@ enum StackError stack_pop(struct Stack *stk, stk_elem_t *value)
 	if (stk->size == 0) return ERR_STACK_EMPTY;
 
 	*value = stk->data[--stk->size];
+#ifdef POISON_PROTECTION
 	memset(stk->data + stk->size, POISON, sizeof(stk_elem_t));
+#endif
 
 #ifdef HASH_PROTECTION
+	stk->data_hash -= elem_hash(stk->size, *value);
 	update_hash(stk);
 #endif
 
 	return STACK_NO_ERR;
 }
 
+// the size of the data block of a stack, with its canaries
+static size_t stack_bytes(size_t capacity)
+{
+#ifdef CANARY_PROTECTION
+	return capacity * sizeof(stk_elem_t) + 2 * sizeof(canary_t);
+#else
+	return capacity * sizeof(stk_elem_t);
+#endif
+}
+
 const char *stack_err_to_str(enum StackError err)
 {
 	switch (err) {
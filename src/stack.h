@@ -4,6 +4,39 @@
 #include <limits.h>
 #include <stdio.h>
 
+/*
+ * Protection level of every stack, chosen at compile time with
+ * -D STACK_PROTECTION_LEVEL=N:
+ *   0 - off: no canaries, no poison, validation compiles to nothing;
+ *   1 - canaries: O(1) checks of the canaries and the size on every operation;
+ *   2 - sampled: canaries and the structure hash on every operation, the poison
+ *       scan and the data hash check once per max(STACK_SAMPLE_PERIOD, capacity)
+ *       operations of a stack, so checking stays O(1) amortized;
+ *   3 - full: canaries, poison scan and both hashes on every operation.
+ * The data hash is a position-weighted sum updated in O(1) by push and pop.
+ * Debug builds default to sampled protection and release builds to none.
+ */
+#define STACK_PROTECT_OFF		0
+#define STACK_PROTECT_CANARY	1
+#define STACK_PROTECT_SAMPLED	2
+#define STACK_PROTECT_FULL		3
+
+#ifndef STACK_PROTECTION_LEVEL
+#ifdef _DEBUG
+#define STACK_PROTECTION_LEVEL STACK_PROTECT_SAMPLED
+#else
+#define STACK_PROTECTION_LEVEL STACK_PROTECT_OFF
+#endif
+#endif
+
+#if STACK_PROTECTION_LEVEL >= STACK_PROTECT_CANARY
+#define CANARY_PROTECTION
+#endif
+#if STACK_PROTECTION_LEVEL >= STACK_PROTECT_SAMPLED
+#define POISON_PROTECTION
+#define HASH_PROTECTION
+#endif
+
 #define STACK_CTOR(stk, print) stack_ctor((stk), (print), #stk, __LINE__, __FILE__, __func__)
 
 typedef int stk_elem_t;
@@ -12,6 +45,9 @@ const int POISON 			= 0xAE;
 const size_t INIT_CAPACITY 	= 2;
 const size_t MULTIPLIER 	= 2;
 const size_t SHRINK_COEF	= 4;
+#if STACK_PROTECTION_LEVEL == STACK_PROTECT_SAMPLED
+const size_t STACK_SAMPLE_PERIOD = 64;
+#endif
 
 typedef void (*stk_print_func)(char*, stk_elem_t, size_t);
 
@@ -37,6 +73,10 @@ struct Stack {
 	const char *funcname;
 	int line;
 
+#if STACK_PROTECTION_LEVEL == STACK_PROTECT_SAMPLED
+	size_t num_ops;
+#endif
+
 #ifdef CANARY_PROTECTION
 	canary_t right_canary;
 #endif
@@ -17,6 +17,7 @@
 
 #ifdef HASH_PROTECTION
 unsigned long gnu_hash(void *data_ptr, size_t size);
+unsigned long struct_hash(struct Stack *stk);
 #endif
 
 stk_print_func PRINT_ELEM = NULL;
@@ -68,14 +69,8 @@ enum StackError validate_stack(struct Stack *stk, int *err)
 #endif
 
 #ifdef HASH_PROTECTION
-	unsigned long old_hash = stk->hash;
-	unsigned long old_data_hash = stk->data_hash;
-	stk->hash = 0;
-	stk->data_hash = 0;
-	if (old_hash != gnu_hash(stk, sizeof(Stack)))
+	if (stk->hash != struct_hash(stk))
 		*err |= 1 << WRONG_HASH;
-	stk->hash = old_hash;
-	stk->data_hash = old_data_hash;
 #endif
 
 #ifdef CANARY_PROTECTION
@@ -93,31 +88,41 @@ enum StackError validate_stack(struct Stack *stk, int *err)
 	if (*err & 1 << WRONG_HASH) {
 		return STACK_FAILED;
 	}
-	stk->hash = 0;
-	stk->data_hash = 0;
-	if (old_data_hash != gnu_hash(stk->data, stk->capacity))
-		*err |= 1 << WRONG_DATA_HASH;
-	stk->hash = old_hash;
-	stk->data_hash = old_data_hash;
 #endif
 
-#ifdef STACK_PROTECTION
+#ifdef CANARY_PROTECTION
 	if (stk->data && *((canary_t*) (stk->data + stk->capacity)) != DEFAULT_CANARY)
 		*err |= 1 << RIGHT_DATA_CANARY_BAD;
 #endif
 
-	if (stk->data) {
+#ifdef POISON_PROTECTION
+#if STACK_PROTECTION_LEVEL == STACK_PROTECT_SAMPLED
+	// the O(capacity) checks run once per max(STACK_SAMPLE_PERIOD, capacity)
+	// operations, which keeps them O(1) amortized; num_ops is not hashed
+	bool do_scan = ++stk->num_ops >= STACK_SAMPLE_PERIOD && stk->num_ops >= stk->capacity;
+	if (do_scan)
+		stk->num_ops = 0;
+#else
+	bool do_scan = true;
+#endif
+	if (stk->data && do_scan) {
 		unsigned char tester[sizeof(stk_elem_t)] = {};
 		memset(tester, POISON, sizeof(stk_elem_t));
+		unsigned long data_hash = 0;
 
-		for (size_t i = 0; i < stk->size; i++)
+		for (size_t i = 0; i < stk->size; i++) {
 			if (memcmp(stk->data + i, tester, sizeof(stk_elem_t)) == 0)
 				*err |= 1 << POISONED_VALUE;
+			data_hash += elem_hash(i, stk->data[i]);
+		}
+		if (data_hash != stk->data_hash)
+			*err |= 1 << WRONG_DATA_HASH;
 
 		for (size_t i = stk->size; i < stk->capacity; i++)
 			if (memcmp(stk->data + i, tester, sizeof(stk_elem_t)) != 0)
 				*err |= 1 << UNPOISONED_VALUE;
 	}
+#endif
 
 	if (*err != 0)
 		return STACK_FAILED;
@@ -159,9 +164,7 @@ void stack_dump(struct Stack *stk)
 #ifdef HASH_PROTECTION
 	unsigned long old_hash = stk->hash;
 	unsigned long old_data_hash = stk->data_hash;
-	stk->hash = 0;
-	stk->data_hash = 0;
-	unsigned long new_hash = gnu_hash(stk, sizeof(Stack));
+	unsigned long new_hash = struct_hash(stk);
 
 	if (old_hash == new_hash)
 		log_string(DEBUG, "%s\t\thash = 0x%lX\n%s",
@@ -173,7 +176,9 @@ void stack_dump(struct Stack *stk)
 		      BLUE, new_hash, RESET_COLOR);
 
 	if (old_hash == new_hash) {
-		unsigned long new_data_hash = gnu_hash(stk->data, stk->capacity);
+		unsigned long new_data_hash = 0;
+		for (size_t i = 0; i < stk->size && i < stk->capacity; i++)
+			new_data_hash += elem_hash(i, stk->data[i]);
 
 		if (old_data_hash == new_data_hash)
 			log_string(DEBUG, "%s\t\tdata hash = 0x%lX\n%s",
@@ -185,8 +190,6 @@ void stack_dump(struct Stack *stk)
 				   BLUE, new_data_hash, RESET_COLOR);
 	}
 
-	stk->hash = old_hash;
-	stk->data_hash = old_data_hash;
 #endif
 
 	log_string(DEBUG, "\t\tdata [%p]\n", stk->data);
@@ -267,6 +270,8 @@ void stack_report_fail(struct Stack *stk, int err,
 				filename, line, func_name);
 
 	stack_dump(stk);
+	// the caller aborts right after the report
+	log_flush();
 }
 
 #ifdef HASH_PROTECTION
@@ -281,11 +286,47 @@ unsigned long gnu_hash(void *data_ptr, size_t size)
 	return hash;
 }
 
-void update_hash(struct Stack *stk)
+// hash of the structure itself, excluding the hashes and the sampling counter
+unsigned long struct_hash(struct Stack *stk)
 {
+	unsigned long old_hash = stk->hash;
+	unsigned long old_data_hash = stk->data_hash;
 	stk->hash = 0;
 	stk->data_hash = 0;
-	stk->hash = gnu_hash(stk, sizeof(Stack));
-	stk->data_hash = gnu_hash(stk->data, stk->capacity);
+#if STACK_PROTECTION_LEVEL == STACK_PROTECT_SAMPLED
+	size_t old_num_ops = stk->num_ops;
+	stk->num_ops = 0;
+#endif
+
+	unsigned long hash = gnu_hash(stk, sizeof(Stack));
+
+	stk->hash = old_hash;
+	stk->data_hash = old_data_hash;
+#if STACK_PROTECTION_LEVEL == STACK_PROTECT_SAMPLED
+	stk->num_ops = old_num_ops;
+#endif
+	return hash;
+}
+
+void update_hash(struct Stack *stk)
+{
+	stk->hash = struct_hash(stk);
+}
+
+/*
+ * The data hash is the sum of elem_hash over the used slots. Mixing in the
+ * position makes swapped elements visible, and the sum lets push and pop
+ * update it in O(1) instead of rehashing the whole array.
+ */
+unsigned long elem_hash(size_t pos, stk_elem_t value)
+{
+	unsigned long long bits = 0;
+	memcpy(&bits, &value, sizeof(value) < sizeof(bits) ? sizeof(value) : sizeof(bits));
+
+	unsigned long long x = bits * 0x9E3779B97F4A7C15ull ^ (pos + 1) * 0xC2B2AE3D27D4EB4Full;
+	x ^= x >> 33;
+	x *= 0xFF51AFD7ED558CCDull;
+	x ^= x >> 33;
+	return (unsigned long) x;
 }
 #endif
\ No newline at end of file
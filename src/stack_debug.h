@@ -6,11 +6,15 @@
 #define STACK_REPORT_FAIL(stk, err) stack_report_fail((stk), (err), __FILE__,	\
 													  __LINE__, __func__)
 
+#if STACK_PROTECTION_LEVEL == STACK_PROTECT_OFF
+#define VALIDATE_STACK(stk)
+#else
 #define VALIDATE_STACK(stk) int err = 0;										\
 							if (validate_stack(stk, &err) == STACK_FAILED) {	\
 								STACK_REPORT_FAIL((stk), err);					\
 								abort();										\
 							}
+#endif
 
 #ifdef CANARY_PROTECTION
 const canary_t DEFAULT_CANARY = 0xDECAFBAD;
@@ -47,6 +51,7 @@ void stack_report_fail(struct Stack *stk, int err,
 
 #ifdef HASH_PROTECTION
 void update_hash(struct Stack *stk);
+unsigned long elem_hash(size_t pos, stk_elem_t value);
 #endif
 
 #endif
\ No newline at end of file
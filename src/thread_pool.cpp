@@ -0,0 +1,161 @@
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+
+#include "thread_pool.h"
+
+static void *pool_worker(void *arg);
+
+enum PoolError pool_ctor(struct ThreadPool *pool, size_t num_threads)
+{
+	assert(pool);
+	assert(num_threads > 0);
+
+	pool->tasks = (struct PoolTask*) calloc(POOL_INIT_TASKS, sizeof(struct PoolTask));
+	if (!pool->tasks)
+		return POOL_NO_MEM_ERR;
+	pool->threads = (pthread_t*) calloc(num_threads, sizeof(pthread_t));
+	if (!pool->threads) {
+		free(pool->tasks);
+		pool->tasks = NULL;
+		return POOL_NO_MEM_ERR;
+	}
+
+	pool->cap = POOL_INIT_TASKS;
+	pool->head = 0;
+	pool->count = 0;
+	pool->running = 0;
+	pool->stop = false;
+	pool->num_threads = 0;
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->has_tasks, NULL);
+	pthread_cond_init(&pool->all_done, NULL);
+
+	for (size_t i = 0; i < num_threads; i++) {
+		if (pthread_create(&pool->threads[i], NULL, pool_worker, pool) != 0) {
+			pool_dtor(pool);
+			return POOL_THREAD_ERR;
+		}
+		pool->num_threads++;
+	}
+
+	return POOL_NO_ERR;
+}
+
+enum PoolError pool_submit(struct ThreadPool *pool, pool_task_func func, void *arg)
+{
+	assert(pool);
+	assert(func);
+
+	pthread_mutex_lock(&pool->lock);
+
+	if (pool->count == pool->cap) {
+		struct PoolTask *tmp = (struct PoolTask*) calloc(2 * pool->cap,
+														 sizeof(struct PoolTask));
+		if (!tmp) {
+			pthread_mutex_unlock(&pool->lock);
+			return POOL_NO_MEM_ERR;
+		}
+		for (size_t i = 0; i < pool->count; i++)
+			tmp[i] = pool->tasks[(pool->head + i) % pool->cap];
+		free(pool->tasks);
+		pool->tasks = tmp;
+		pool->head = 0;
+		pool->cap *= 2;
+	}
+
+	pool->tasks[(pool->head + pool->count) % pool->cap] = {func, arg};
+	pool->count++;
+
+	pthread_cond_signal(&pool->has_tasks);
+	pthread_mutex_unlock(&pool->lock);
+	return POOL_NO_ERR;
+}
+
+void pool_wait(struct ThreadPool *pool)
+{
+	assert(pool);
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->count > 0 || pool->running > 0)
+		pthread_cond_wait(&pool->all_done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_dtor(struct ThreadPool *pool)
+{
+	assert(pool);
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = true;
+	pthread_cond_broadcast(&pool->has_tasks);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (size_t i = 0; i < pool->num_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->has_tasks);
+	pthread_cond_destroy(&pool->all_done);
+
+	free(pool->threads);
+	free(pool->tasks);
+	pool->threads = NULL;
+	pool->tasks = NULL;
+	pool->num_threads = 0;
+	pool->count = 0;
+	pool->cap = 0;
+}
+
+static void *pool_worker(void *arg)
+{
+	struct ThreadPool *pool = (struct ThreadPool*) arg;
+
+	pthread_mutex_lock(&pool->lock);
+	while (true) {
+		while (pool->count == 0 && !pool->stop)
+			pthread_cond_wait(&pool->has_tasks, &pool->lock);
+		// pending tasks are still run on shutdown
+		if (pool->count == 0)
+			break;
+
+		struct PoolTask task = pool->tasks[pool->head];
+		pool->head = (pool->head + 1) % pool->cap;
+		pool->count--;
+		pool->running++;
+		pthread_mutex_unlock(&pool->lock);
+
+		task.func(task.arg);
+
+		pthread_mutex_lock(&pool->lock);
+		pool->running--;
+		if (pool->count == 0 && pool->running == 0)
+			pthread_cond_broadcast(&pool->all_done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+size_t pool_default_threads()
+{
+	long num = sysconf(_SC_NPROCESSORS_ONLN);
+	if (num < 1)
+		return 1;
+	return (size_t) num;
+}
+
+const char *pool_err_to_str(enum PoolError err)
+{
+	switch (err) {
+		case POOL_THREAD_ERR:
+			return "Couldn't start a worker thread";
+		case POOL_NO_MEM_ERR:
+			return "Not enough memory for the thread pool";
+		case POOL_NO_ERR:
+			return "No error occured";
+		default:
+			return "An unknown error occured";
+	}
+}
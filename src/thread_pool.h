@@ -0,0 +1,45 @@
+#ifndef _THREAD_POOL_H
+#define _THREAD_POOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+typedef void (*pool_task_func)(void *arg);
+
+struct PoolTask {
+	pool_task_func func;
+	void *arg;
+};
+
+struct ThreadPool {
+	pthread_t *threads;
+	size_t num_threads;
+
+	struct PoolTask *tasks;
+	size_t head;
+	size_t count;
+	size_t cap;
+	size_t running;
+	bool stop;
+
+	pthread_mutex_t lock;
+	pthread_cond_t has_tasks;
+	pthread_cond_t all_done;
+};
+
+enum PoolError {
+	POOL_THREAD_ERR	= -2,
+	POOL_NO_MEM_ERR	= -1,
+	POOL_NO_ERR		= 0,
+};
+
+const size_t POOL_INIT_TASKS = 64;
+
+enum PoolError pool_ctor(struct ThreadPool *pool, size_t num_threads);
+enum PoolError pool_submit(struct ThreadPool *pool, pool_task_func func, void *arg);
+void pool_wait(struct ThreadPool *pool);
+void pool_dtor(struct ThreadPool *pool);
+size_t pool_default_threads();
+const char *pool_err_to_str(enum PoolError err);
+
+#endif /*_THREAD_POOL_H*/
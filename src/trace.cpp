@@ -0,0 +1,165 @@
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+
+#include "trace.h"
+#include "logger.h"
+
+bool TRACE_IS_ON = false;
+
+static struct Tracer TRACER = {NULL, 0, NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER};
+
+// the buffer of the current thread and the trace_start() it belongs to
+static thread_local struct TraceBuffer *THREAD_TRACE = NULL;
+static thread_local unsigned long THREAD_TRACE_GEN = 0;
+
+static struct TraceBuffer *get_thread_trace();
+static bool grow_buffer(struct TraceBuffer *buf);
+static void write_buffer(FILE *out, const struct TraceBuffer *buf, long pid, bool *is_first);
+
+enum TraceError trace_start(const char *filename)
+{
+	assert(filename);
+
+	FILE *out = fopen(filename, "w");
+	if (!out)
+		return TRACE_FILE_ERR;
+
+	pthread_mutex_lock(&TRACER.lock);
+	if (TRACER.out)
+		fclose(TRACER.out);
+	TRACER.out = out;
+	TRACER.start_ns = trace_now_ns();
+	__atomic_add_fetch(&TRACER.generation, 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&TRACER.lock);
+
+	__atomic_store_n(&TRACE_IS_ON, true, __ATOMIC_RELEASE);
+	return TRACE_NO_ERR;
+}
+
+// must be called when no other thread is tracing
+enum TraceError trace_stop()
+{
+	__atomic_store_n(&TRACE_IS_ON, false, __ATOMIC_RELEASE);
+
+	pthread_mutex_lock(&TRACER.lock);
+	FILE *out = TRACER.out;
+	TRACER.out = NULL;
+	__atomic_add_fetch(&TRACER.generation, 1, __ATOMIC_RELAXED);
+
+	enum TraceError err = TRACE_NO_ERR;
+	if (out) {
+		long pid = (long) getpid();
+		bool is_first = true;
+		fputs("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [", out);
+		for (struct TraceBuffer *buf = TRACER.buffers; buf; buf = buf->next) {
+			write_buffer(out, buf, pid, &is_first);
+			if (buf->num_dropped)
+				log_message(WARN, "Trace thread %zu dropped %zu events\n", buf->tid,
+							buf->num_dropped);
+		}
+		fputs("\n]}\n", out);
+		if (ferror(out))
+			err = TRACE_FILE_ERR;
+		if (fclose(out) != 0)
+			err = TRACE_FILE_ERR;
+	}
+
+	struct TraceBuffer *buf = TRACER.buffers;
+	while (buf) {
+		struct TraceBuffer *next = buf->next;
+		free(buf->events);
+		free(buf);
+		buf = next;
+	}
+	TRACER.buffers = NULL;
+	TRACER.num_buffers = 0;
+	pthread_mutex_unlock(&TRACER.lock);
+
+	return err;
+}
+
+void trace_record(const char *name, uint64_t start_ns, uint64_t end_ns)
+{
+	assert(name);
+
+	if (!__atomic_load_n(&TRACE_IS_ON, __ATOMIC_ACQUIRE))
+		return;
+	struct TraceBuffer *buf = get_thread_trace();
+	if (!buf)
+		return;
+
+	if (buf->num_events == buf->cap && !grow_buffer(buf)) {
+		buf->num_dropped++;
+		return;
+	}
+	buf->events[buf->num_events++] = {name, start_ns, end_ns};
+}
+
+static struct TraceBuffer *get_thread_trace()
+{
+	unsigned long generation = __atomic_load_n(&TRACER.generation, __ATOMIC_RELAXED);
+	if (THREAD_TRACE && THREAD_TRACE_GEN == generation)
+		return THREAD_TRACE;
+
+	struct TraceBuffer *buf = (struct TraceBuffer*) calloc(1, sizeof(struct TraceBuffer));
+	if (!buf)
+		return NULL;
+
+	pthread_mutex_lock(&TRACER.lock);
+	buf->tid = TRACER.num_buffers++;
+	buf->next = TRACER.buffers;
+	TRACER.buffers = buf;
+	pthread_mutex_unlock(&TRACER.lock);
+
+	THREAD_TRACE = buf;
+	THREAD_TRACE_GEN = generation;
+	return buf;
+}
+
+static bool grow_buffer(struct TraceBuffer *buf)
+{
+	assert(buf);
+
+	size_t new_cap = buf->cap ? 2 * buf->cap : TRACE_INIT_EVENTS;
+	struct TraceEvent *events = (struct TraceEvent*) realloc(buf->events,
+											new_cap * sizeof(struct TraceEvent));
+	if (!events)
+		return false;
+	buf->events = events;
+	buf->cap = new_cap;
+	return true;
+}
+
+// complete ("X") events with times in microseconds since trace_start()
+static void write_buffer(FILE *out, const struct TraceBuffer *buf, long pid, bool *is_first)
+{
+	assert(out);
+	assert(buf);
+	assert(is_first);
+
+	fprintf(out, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %ld, \"tid\": %zu, "
+			"\"args\": {\"name\": \"thread %zu\"}}", *is_first ? "" : ",", pid, buf->tid,
+			buf->tid);
+	*is_first = false;
+
+	for (size_t i = 0; i < buf->num_events; i++) {
+		const struct TraceEvent *event = &buf->events[i];
+		fprintf(out, ",\n{\"name\": \"%s\", \"cat\": \"akinator\", \"ph\": \"X\", \"pid\": %ld, "
+				"\"tid\": %zu, \"ts\": %.3f, \"dur\": %.3f}", event->name, pid, buf->tid,
+				(double) (event->start_ns - TRACER.start_ns) / 1e3,
+				(double) (event->end_ns - event->start_ns) / 1e3);
+	}
+}
+
+const char *trace_err_to_str(enum TraceError err)
+{
+	switch (err) {
+		case TRACE_FILE_ERR:
+			return "Couldn't write the trace file";
+		case TRACE_NO_ERR:
+			return "No error occured";
+		default:
+			return "An unknown error occured";
+	}
+}
@@ -0,0 +1,89 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+/*
+ * Scoped timers for the hot paths, written as Chrome trace events (open the
+ * file in chrome://tracing or Perfetto). TRACE_SCOPE("name") times the rest of
+ * the enclosing block; trace_begin() and trace_end() time a part of a function
+ * that jumps to its cleanup. A span is a CLOCK_MONOTONIC reading at each end,
+ * kept in the ring of its thread without locking; the rings are written out
+ * by trace_stop(), after the threads are done. Until trace_start(), a span is
+ * one load of TRACE_IS_ON and a branch. Names must be string literals.
+ */
+struct TraceSpan {
+	const char *name;
+	// 0 if tracing was off when the span began
+	uint64_t start_ns;
+};
+
+struct TraceEvent {
+	const char *name;
+	uint64_t start_ns;
+	uint64_t end_ns;
+};
+
+struct TraceBuffer {
+	struct TraceEvent *events;
+	size_t num_events;
+	size_t cap;
+	size_t num_dropped;
+	size_t tid;
+	struct TraceBuffer *next;
+};
+
+struct Tracer {
+	FILE *out;
+	uint64_t start_ns;
+	struct TraceBuffer *buffers;
+	size_t num_buffers;
+	// buffers of an earlier trace_start() are not reused
+	unsigned long generation;
+	pthread_mutex_t lock;
+};
+
+enum TraceError {
+	TRACE_FILE_ERR	= -1,
+	TRACE_NO_ERR	= 0,
+};
+
+const size_t TRACE_INIT_EVENTS = 1024;
+
+extern bool TRACE_IS_ON;
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name)																\
+	struct TraceSpan TRACE_CONCAT(trace_span_, __LINE__) __attribute__((cleanup(trace_end))) =	\
+		trace_begin(name)
+
+enum TraceError trace_start(const char *filename);
+enum TraceError trace_stop();
+void trace_record(const char *name, uint64_t start_ns, uint64_t end_ns);
+const char *trace_err_to_str(enum TraceError err);
+
+inline uint64_t trace_now_ns()
+{
+	struct timespec ts = {};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+inline struct TraceSpan trace_begin(const char *name)
+{
+	if (!__builtin_expect(__atomic_load_n(&TRACE_IS_ON, __ATOMIC_RELAXED), false))
+		return {name, 0};
+	return {name, trace_now_ns()};
+}
+
+inline void trace_end(struct TraceSpan *span)
+{
+	if (span->start_ns)
+		trace_record(span->name, span->start_ns, trace_now_ns());
+}
+
+#endif /*_TRACE_H*/
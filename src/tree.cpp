@@ -2,12 +2,13 @@
 #include <assert.h>
 
 #include "tree.h"
+#include "mem.h"
 
 enum TreeError node_op_new(struct Node **node, elem_t data)
 {
 	assert(node);
 
-	*node = (struct Node*) calloc(1, sizeof(struct Node));
+	*node = (struct Node*) mem_calloc(MEM_NODE, 1, sizeof(struct Node));
 	if (!(*node))
 		return TREE_NO_MEM_ERR;
 
@@ -24,14 +25,22 @@ void node_ctor(struct Node *node, elem_t data)
 	node->right = NULL;
 }
 
+// rotates every left child up until there is none, then frees the node and
+// goes right, so it needs neither recursion nor a stack
 void node_op_delete(struct Node *node)
 {
-	if (!node)
-		return;
-	
-	node_op_delete(node->left);
-	node_op_delete(node->right);
-	free(node);
+	while (node) {
+		struct Node *left = node->left;
+		if (left) {
+			node->left = left->right;
+			left->right = node;
+			node = left;
+		} else {
+			struct Node *right = node->right;
+			mem_free(MEM_NODE, node, sizeof(struct Node));
+			node = right;
+		}
+	}
 }
 
 const char *tree_err_to_str(enum TreeError err)
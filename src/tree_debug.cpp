@@ -7,13 +7,26 @@
 
 #include "tree_debug.h"
 #include "logger.h"
+#include "small_stack.h"
+#include "trace.h"
+#include "tree_svg.h"
 
 const int ELEM_BUF_SIZE = 1024;
 
 static void _subtree_dump_log(const struct Node *node, print_func print_el,
-							  size_t level);
-static void _subtree_dump_gui(const struct Node *node, print_func print_el,
-							  FILE *dump, size_t node_id);
+							  size_t level, struct Log_builder *dump);
+static void dump_gui_dot(const struct DumpNode *nodes, size_t num_nodes,
+						 print_func print_el, FILE *dump_html, struct Renderer *renderer,
+						 const char *varname);
+static void dump_gui_svg(const struct DumpNode *nodes, size_t num_nodes,
+						 print_func print_el, FILE *dump_html, const char *varname);
+static void write_dot(FILE *dot, const struct DumpNode *nodes, size_t num_nodes,
+					  print_func print_el);
+static void write_label(FILE *dot, const char *label);
+static const struct Node *find_node(const struct Node *tr, const char *name);
+static size_t count_leaves(const struct Node *tr);
+
+const size_t FILENAME_SIZE = 512;
 
 void tree_dump_log(const struct Node *tr, print_func print_el,
 				   const char *filename, const char* funcname, int line,
@@ -25,43 +38,47 @@ void tree_dump_log(const struct Node *tr, print_func print_el,
 	assert(funcname);
 	assert(varname);
 
+	// the walk is wasted if nobody reads DEBUG
+	if (!log_is_enabled(DEBUG))
+		return;
+	TRACE_SCOPE("dump_log");
+
 	log_message(DEBUG, "Dumping tree %s[%p]:\n", varname, tr);
 	log_message(DEBUG, "(called from %s:%d %s)\n", filename, line, funcname);
-	_subtree_dump_log(tr, print_el, 0);
+	// the whole tree is one message instead of several per node
+	struct Log_builder dump = {};
+	log_builder_ctor(&dump, DEBUG);
+	_subtree_dump_log(tr, print_el, 0, &dump);
+	log_builder_dtor(&dump);
 	log_message(DEBUG, "Dumping of %s[%p] ended\n", varname, tr);
 }
 
 static void _subtree_dump_log(const struct Node *node, print_func print_el,
-						  size_t level)
+						  size_t level, struct Log_builder *dump)
 {
 	assert(print_el);
+	assert(dump);
 
 	static char buf[ELEM_BUF_SIZE] = {};
 	
-	log_string(DEBUG, "   ");
-	for (size_t i = 0; i < level; i++)
-		log_string(DEBUG, "   ");
+	log_builder_pad(dump, 3 * (level + 1));
 	if (!node) {
-		log_string(DEBUG, "    nil\n");
+		log_builder_puts(dump, "    nil\n");
 		return;
 	}
-	log_string(DEBUG, "{\n");
+	log_builder_puts(dump, "{\n");
 
-	log_string(DEBUG, "   ");
-	for (size_t i = 0; i < level; i++)
-		log_string(DEBUG, "   ");
+	log_builder_pad(dump, 3 * (level + 1));
 
 	buf[0] = '\0';
 	print_el(buf, node->data, ELEM_BUF_SIZE - 1);
-	log_string(DEBUG, "   %s\n", buf);
+	log_builder_printf(dump, "   %s\n", buf);
 
-	_subtree_dump_log(node->left, print_el, level + 1);
-	_subtree_dump_log(node->right, print_el, level + 1);
+	_subtree_dump_log(node->left, print_el, level + 1, dump);
+	_subtree_dump_log(node->right, print_el, level + 1, dump);
 	
-	log_string(DEBUG, "   ");
-	for (size_t i = 0; i < level; i++)
-		log_string(DEBUG, "   ");
-	log_string(DEBUG, "}\n");
+	log_builder_pad(dump, 3 * (level + 1));
+	log_builder_puts(dump, "}\n");
 }
 
 FILE *tree_start_html_dump(const char *filename)
@@ -94,6 +111,7 @@ void tree_end_html_dump(FILE *file)
 }
 
 void tree_dump_gui(const struct Node *tr, print_func print_el, FILE *dump_html,
+				   struct Renderer *renderer, const struct DumpOptions *opts,
 				   const char *filename, const char *funcname, int line,
 				   const char *varname)
 {
@@ -103,94 +121,261 @@ void tree_dump_gui(const struct Node *tr, print_func print_el, FILE *dump_html,
 	assert(funcname);
 	assert(varname);
 	assert(dump_html);
+	assert(opts);
+	TRACE_SCOPE("dump");
 
 	log_message(DEBUG, "HTML-dumping tree %s[%p]:\n", varname, tr);
 	log_message(DEBUG, "(called from %s:%d %s)\n", filename, line, funcname);
 
-	static size_t dump_count = 0;
+	struct DumpNode *nodes = NULL;
+	size_t num_nodes = 0;
+	if (!dump_select(tr, opts, &nodes, &num_nodes)) {
+		log_message(ERROR, "No memory for the dump of %s\n", varname);
+		return;
+	}
 
-	const size_t FILENAME_SIZE = 512;
+	fprintf(dump_html, "<hr>\n<p style=\"font-size:30px\">"
+			"Tree %s[%p]</br>\n", varname, tr);
+	fprintf(dump_html, "(called from %s:%d %s</p>\n", filename, line, funcname);
+	mkdir("dump", 0777);
+	if (renderer)
+		dump_gui_dot(nodes, num_nodes, print_el, dump_html, renderer, varname);
+	else
+		dump_gui_svg(nodes, num_nodes, print_el, dump_html, varname);
+	free(nodes);
+	
+	log_message(DEBUG, "HTML-dumping of %s[%p] ended\n", varname, tr);
+}
 
-	time_t rawtime = 0;
-	struct tm *timeinfo = {};
-	time(&rawtime);
-	timeinfo = localtime(&rawtime);
+// breadth first, so that max_nodes keeps the top of the tree; a node's parent
+// comes before it
+bool dump_select(const struct Node *tr, const struct DumpOptions *opts,
+				 struct DumpNode **nodes, size_t *num_nodes)
+{
+	assert(tr);
+	assert(opts);
+	assert(nodes);
+	assert(num_nodes);
+	TRACE_SCOPE("dump_select");
+
+	if (opts->root_name) {
+		const struct Node *root = find_node(tr, opts->root_name);
+		if (root)
+			tr = root;
+		else
+			log_message(WARN, "No object or question \"%s\" in the tree, dumping all of it\n",
+						opts->root_name);
+	}
 
-	char dump_prefix[FILENAME_SIZE] = {};
-	strftime(dump_prefix, FILENAME_SIZE, "dump/%b-%d-%T", timeinfo);
-	snprintf(dump_prefix + strlen(dump_prefix),
-			 FILENAME_SIZE - strlen(dump_prefix), "-%lu", dump_count);
-	dump_count++;
+	// the array is the queue, what is behind its head is already selected
+	struct DumpNode *queue = (struct DumpNode*) calloc(DUMP_INIT_QUEUE, sizeof(struct DumpNode));
+	if (!queue)
+		return false;
+	size_t queue_cap = DUMP_INIT_QUEUE;
+	size_t tail = 0;
+	queue[tail++] = {tr, 0, 0, 0, false, false};
+
+	for (size_t head = 0; head < tail; head++) {
+		struct DumpNode *dump_node = &queue[head];
+		const struct Node *node = dump_node->node;
+
+		// every queued node is one to come, the children would add theirs
+		size_t num_children = 0;
+		num_children += node->left ? 1u : 0u;
+		num_children += node->right ? 1u : 0u;
+		if (num_children > 0 &&
+			((opts->max_depth && dump_node->depth >= opts->max_depth) ||
+			 (opts->max_nodes && tail + num_children > opts->max_nodes))) {
+			dump_node->is_collapsed = true;
+			dump_node->num_leaves = count_leaves(node);
+			continue;
+		}
+
+		if (tail + num_children > queue_cap) {
+			struct DumpNode *tmp = (struct DumpNode*) realloc(queue, 2 * queue_cap *
+															  sizeof(struct DumpNode));
+			if (!tmp) {
+				free(queue);
+				return false;
+			}
+			queue = tmp;
+			queue_cap *= 2;
+			dump_node = &queue[head];
+		}
+		if (node->left)
+			queue[tail++] = {node->left, dump_node->depth + 1, head + 1, 0, true, false};
+		if (node->right)
+			queue[tail++] = {node->right, dump_node->depth + 1, head + 1, 0, false, false};
+	}
 
-	char dot_name[FILENAME_SIZE] = {};
-	strncpy(dot_name, dump_prefix, FILENAME_SIZE);
-	strncat(dot_name, ".dot", FILENAME_SIZE - strlen(dot_name));
+	*nodes = queue;
+	*num_nodes = tail;
+	return true;
+}
 
-	mkdir("dump", 0777);
-	FILE *dot_file = fopen(dot_name, "w");
+static void dump_gui_dot(const struct DumpNode *nodes, size_t num_nodes,
+						 print_func print_el, FILE *dump_html, struct Renderer *renderer,
+						 const char *varname)
+{
+	assert(nodes);
+	assert(print_el);
+	assert(dump_html);
+	assert(renderer);
+	assert(varname);
+	TRACE_SCOPE("dump_dot");
+
+	// the text is kept to be hashed, an identical tree reuses the image
+	char *dot = NULL;
+	size_t dot_len = 0;
+	FILE *dot_file = open_memstream(&dot, &dot_len);
 	if (!dot_file) {
-		log_message(ERROR, "Opening dot file %s for dumping failed\n", dot_name);
+		log_message(ERROR, "No memory for the dot text of %s\n", varname);
 		return;
 	}
-
-	const char *BEGIN = \
-	"digraph {\n"
-	"graph [dpi = 200, splines=ortho];\n"
-	"node [shape = \"Mrecord\"];\n";
-
-	fputs(BEGIN, dot_file);
-	_subtree_dump_gui(tr, print_el, dot_file, 0);
-	fputs("}\n", dot_file);
+	write_dot(dot_file, nodes, num_nodes, print_el);
 	fclose(dot_file);
 
 	char image_name[FILENAME_SIZE] = {};
-	strncpy(image_name, dump_prefix, FILENAME_SIZE);
-	strncat(image_name, ".png", FILENAME_SIZE - strlen(image_name));
-
-	const size_t CMD_SIZE = 512;
-	char gen_dot_cmd[CMD_SIZE] = "dot -Tpng -o \"";
-	strncat(gen_dot_cmd, image_name, CMD_SIZE - strlen(gen_dot_cmd));
-	strncat(gen_dot_cmd, "\" \"", CMD_SIZE - strlen(gen_dot_cmd));
-	strncat(gen_dot_cmd, dot_name, CMD_SIZE - strlen(gen_dot_cmd));
-	strncat(gen_dot_cmd, "\"", CMD_SIZE - strlen(gen_dot_cmd));
-	system(gen_dot_cmd);
+	// the page refers to the image before it exists, it shows up once rendered
+	enum RenderError render_err = render_dot(renderer, "dump", dot, dot_len, image_name,
+											 FILENAME_SIZE);
+	free(dot);
+	if (render_err < 0) {
+		log_message(ERROR, "Couldn't render the dump of %s: %s\n", varname,
+					render_err_to_str(render_err));
+		return;
+	}
 
-	fprintf(dump_html, "<hr>\n<p style=\"font-size:30px\">"
-			"Tree %s[%p]</br>\n", varname, tr);
-	fprintf(dump_html, "(called from %s:%d %s</p>\n", filename, line, funcname);
 	fprintf(dump_html, "<img src=\"%s\">\n", image_name);
-	
-	log_message(DEBUG, "HTML-dumping of %s[%p] ended\n", varname, tr);
 }
 
-static void _subtree_dump_gui(const struct Node *node, print_func print_el,
-							  FILE *dump, size_t node_id)
+static void dump_gui_svg(const struct DumpNode *nodes, size_t num_nodes,
+						 print_func print_el, FILE *dump_html, const char *varname)
 {
-	if (!node)
-		return;
+	assert(nodes);
+	assert(print_el);
+	assert(dump_html);
+	assert(varname);
+	TRACE_SCOPE("dump_svg");
+
+	static size_t dump_count = 0;
+
+	time_t rawtime = 0;
+	time(&rawtime);
+	struct tm *timeinfo = localtime(&rawtime);
+
+	// big trees go into tiles named after it
+	char tile_prefix[FILENAME_SIZE] = {};
+	strftime(tile_prefix, FILENAME_SIZE, "dump/%b-%d-%T", timeinfo);
+	snprintf(tile_prefix + strlen(tile_prefix), FILENAME_SIZE - strlen(tile_prefix), "-%zu",
+			 dump_count);
+	dump_count++;
+
+	enum TreeSvgError svg_err = tree_svg_write(nodes, num_nodes, print_el, dump_html,
+											   tile_prefix);
+	if (svg_err < 0)
+		log_message(ERROR, "Couldn't draw the dump of %s: %s\n", varname,
+					tree_svg_err_to_str(svg_err));
+}
+
+// the ids are the positions in nodes plus one
+static void write_dot(FILE *dot, const struct DumpNode *nodes, size_t num_nodes,
+					  print_func print_el)
+{
+	assert(dot);
+	assert(nodes);
+	assert(print_el);
+
+	fputs("digraph {\n"
+		  "graph [dpi = 200, splines=ortho];\n"
+		  "node [shape = \"Mrecord\"];\n", dot);
 
 	static char buf[ELEM_BUF_SIZE] = {};
-	buf[0] = '\0';
-	print_el(buf, node->data, ELEM_BUF_SIZE - 1);
-	fprintf(dump, "node%lu [label=\"{%s | {", node_id, buf);
-	if (node->left)
-		fputs("да", dump);
-	else
-		fputs("-", dump);
-	fputs(" | ", dump);
-	if (node->right)
-		fputs("нет", dump);
-	else
-		fputs("-", dump);
-	fputs("}}\"]\n", dump);
-
-	_subtree_dump_gui(node->left, print_el, dump, 2 * node_id + 1);
-	_subtree_dump_gui(node->right, print_el, dump, 2 * node_id + 2);
-
-	if (node->left)
-		fprintf(dump, "node%lu -> node%lu [color=green]\n", node_id, 
-				2 * node_id + 1);
-	if (node->right)
-		fprintf(dump, "node%lu -> node%lu [color=red]\n", node_id,
-				2 * node_id + 2);
+	for (size_t i = 0; i < num_nodes; i++) {
+		const struct DumpNode *dump_node = &nodes[i];
+		const struct Node *node = dump_node->node;
+		size_t id = i + 1;
+
+		if (dump_node->parent)
+			fprintf(dot, "node%zu -> node%zu [color=%s]\n", dump_node->parent, id,
+					dump_node->is_left ? "green" : "red");
+
+		if (dump_node->is_collapsed) {
+			fprintf(dot, "node%zu [shape=box, style=dashed, label=\"%zu leaves\"]\n", id,
+					dump_node->num_leaves);
+			continue;
+		}
+
+		buf[0] = '\0';
+		print_el(buf, node->data, ELEM_BUF_SIZE - 1);
+		fprintf(dot, "node%zu [label=\"{", id);
+		write_label(dot, buf);
+		fprintf(dot, " | {%s | %s}}\"]\n", node->left ? "да" : "-",
+				node->right ? "нет" : "-");
+	}
+
+	fputs("}\n", dot);
+}
+
+// record labels give a meaning to these characters, a backslash takes it away
+static void write_label(FILE *dot, const char *label)
+{
+	assert(dot);
+	assert(label);
+
+	for (const char *c = label; *c; c++) {
+		if (strchr("\\\"{}|<>", *c))
+			fputc('\\', dot);
+		fputc(*c, dot);
+	}
+}
+
+// the first node with the data in preorder
+static const struct Node *find_node(const struct Node *tr, const char *name)
+{
+	assert(tr);
+	assert(name);
+
+	SmallStack<const struct Node*, DUMP_INIT_DEPTH> stack = {};
+	small_stack_ctor(&stack);
+	small_stack_push(&stack, tr);
+
+	const struct Node *node = NULL;
+	const struct Node *found = NULL;
+	while (!found && small_stack_pop(&stack, &node) == STACK_NO_ERR) {
+		const struct Node *left = node->left;
+		const struct Node *right = node->right;
+		if (strcmp(node->data, name) == 0)
+			found = node;
+		else if ((right && small_stack_push(&stack, right) < 0) ||
+				 (left && small_stack_push(&stack, left) < 0))
+			break;
+	}
+	small_stack_dtor(&stack);
+
+	return found;
+}
+
+static size_t count_leaves(const struct Node *tr)
+{
+	assert(tr);
+
+	SmallStack<const struct Node*, DUMP_INIT_DEPTH> stack = {};
+	small_stack_ctor(&stack);
+	small_stack_push(&stack, tr);
+
+	size_t num_leaves = 0;
+	const struct Node *node = NULL;
+	while (small_stack_pop(&stack, &node) == STACK_NO_ERR) {
+		const struct Node *left = node->left;
+		const struct Node *right = node->right;
+		if (!left && !right)
+			num_leaves++;
+		if ((right && small_stack_push(&stack, right) < 0) ||
+			(left && small_stack_push(&stack, left) < 0))
+			break;
+	}
+	small_stack_dtor(&stack);
+
+	return num_leaves;
 }
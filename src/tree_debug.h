@@ -3,21 +3,54 @@
 
 #include <stdio.h>
 #include "tree.h"
+#include "render.h"
 
 #define TREE_DUMP_LOG(tr, print_el) \
 	tree_dump_log((tr), (print_el), __FILE__, __PRETTY_FUNCTION__, __LINE__, #tr)
-#define TREE_DUMP_GUI(tr, file, print_el) \
-	tree_dump_gui((tr), (print_el), (file), __FILE__, __PRETTY_FUNCTION__, \
-				 __LINE__, #tr)
+#define TREE_DUMP_GUI(tr, file, renderer, opts, print_el) \
+	tree_dump_gui((tr), (print_el), (file), (renderer), (opts), __FILE__, \
+				  __PRETTY_FUNCTION__, __LINE__, #tr)
 
 typedef void (*print_func)(char*, elem_t, size_t);
 
+/*
+ * What part of the tree tree_dump_gui() draws. Nodes are drawn breadth first
+ * with sequential ids; a subtree below max_depth, or one that doesn't fit into
+ * max_nodes, is drawn as a single node with the number of its leaves. Zero
+ * limits are no limits.
+ */
+struct DumpOptions {
+	// the object or question the graph starts at, NULL for the whole tree
+	const char *root_name;
+	size_t max_depth;
+	size_t max_nodes;
+};
+
+// a node to draw, as dump_select() chose it
+struct DumpNode {
+	const struct Node *node;
+	size_t depth;
+	// the position of the parent plus one, 0 for the root
+	size_t parent;
+	// the leaves of a collapsed subtree
+	size_t num_leaves;
+	bool is_left;
+	bool is_collapsed;
+};
+
+const size_t DUMP_INIT_QUEUE = 256;
+const size_t DUMP_INIT_DEPTH = 64;
+
 void tree_dump_log(const struct Node *tr, print_func print_el,
 				   const char *filename, const char *funcname, int line,
 				   const char *varname);
+// without a renderer the tree is drawn as SVG in process, see tree_svg.h
 void tree_dump_gui(const struct Node *tr, print_func print_el, FILE *dump_html,
+				   struct Renderer *renderer, const struct DumpOptions *opts,
 				   const char *filename, const char *funcname, int line,
 				   const char *varname);
+bool dump_select(const struct Node *tr, const struct DumpOptions *opts,
+				 struct DumpNode **nodes, size_t *num_nodes);
 FILE *tree_start_html_dump(const char *filename);
 void tree_end_html_dump(FILE *file);
 
@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "tree_export.h"
+#include "small_stack.h"
+
+struct ExportFrame {
+	const struct Node *node;
+	size_t prefix_len;
+	int state;
+};
+
+struct Prefix {
+	char *data;
+	size_t len;
+	size_t cap;
+};
+
+static enum TreeExportError prefix_reserve(struct Prefix *pref, size_t add);
+static enum TreeExportError prefix_append_text(struct Prefix *pref,
+											   const char *str,
+											   enum ExportFormat format);
+static enum TreeExportError prefix_append_step(struct Prefix *pref,
+											   const char *question, bool answer,
+											   enum ExportFormat format);
+static void write_text(FILE *out, const char *str, enum ExportFormat format);
+static void write_leaf(FILE *out, const char *name, const struct Prefix *pref,
+					   enum ExportFormat format);
+
+enum TreeExportError tree_export_definitions(const struct Node *tree,
+											 const char *filename,
+											 enum ExportFormat format)
+{
+	assert(filename);
+
+	FILE *out = fopen(filename, "w");
+	if (!out)
+		return TEXP_FILE_ERR;
+	setvbuf(out, NULL, _IOFBF, EXPORT_OUT_BUF_SIZE);
+
+	enum TreeExportError err = TEXP_NO_ERR;
+	struct Prefix pref = {};
+	SmallStack<struct ExportFrame, EXPORT_INIT_DEPTH> frames = {};
+	small_stack_ctor(&frames);
+	err = prefix_reserve(&pref, EXPORT_INIT_PREFIX);
+	if (err < 0)
+		goto finally;
+
+	if (tree && small_stack_push(&frames, {tree, 0, 0}) < 0) {
+		err = TEXP_NO_MEM_ERR;
+		goto finally;
+	}
+
+	while (frames.size > 0) {
+		struct ExportFrame *top = small_stack_top(&frames);
+		const struct Node *node = top->node;
+		struct ExportFrame done = {};
+
+		if (!node->left && !node->right) {
+			write_leaf(out, node->data, &pref, format);
+			small_stack_pop(&frames, &done);
+			continue;
+		}
+		if (top->state == 2) {
+			small_stack_pop(&frames, &done);
+			continue;
+		}
+
+		bool answer = top->state == 0;
+		const struct Node *next = answer ? node->left : node->right;
+		top->state++;
+		if (!next)
+			continue;
+
+		pref.len = top->prefix_len;
+		err = prefix_append_step(&pref, node->data, answer, format);
+		if (err < 0)
+			goto finally;
+
+		if (small_stack_push(&frames, {next, pref.len, 0}) < 0) {
+			err = TEXP_NO_MEM_ERR;
+			goto finally;
+		}
+	}
+
+	if (ferror(out))
+		err = TEXP_FILE_ERR;
+
+	finally:
+		small_stack_dtor(&frames);
+		free(pref.data);
+		if (fclose(out) != 0 && err == TEXP_NO_ERR)
+			err = TEXP_FILE_ERR;
+
+	return err;
+}
+
+static enum TreeExportError prefix_reserve(struct Prefix *pref, size_t add)
+{
+	assert(pref);
+
+	if (pref->len + add <= pref->cap)
+		return TEXP_NO_ERR;
+
+	size_t new_cap = pref->cap ? pref->cap : EXPORT_INIT_PREFIX;
+	while (new_cap < pref->len + add)
+		new_cap *= 2;
+	char *tmp = (char*) realloc(pref->data, new_cap);
+	if (!tmp)
+		return TEXP_NO_MEM_ERR;
+	pref->data = tmp;
+	pref->cap = new_cap;
+	return TEXP_NO_ERR;
+}
+
+static enum TreeExportError prefix_append_text(struct Prefix *pref,
+											   const char *str,
+											   enum ExportFormat format)
+{
+	assert(pref);
+	assert(str);
+
+	// worst case is a control character escaped as \u00XX
+	enum TreeExportError err = prefix_reserve(pref, 6 * strlen(str));
+	if (err < 0)
+		return err;
+
+	for (; *str; str++) {
+		unsigned char c = (unsigned char) *str;
+		if (format == EXPORT_TSV) {
+			pref->data[pref->len++] = (c == '\t' || c == '\n' || c == '\r') ?
+									  ' ' : (char) c;
+		} else if (c == '"' || c == '\\') {
+			pref->data[pref->len++] = '\\';
+			pref->data[pref->len++] = (char) c;
+		} else if (c < 0x20) {
+			// written by hand, as snprintf would put its NUL past the reserve
+			const char hex[] = "0123456789abcdef";
+			memcpy(pref->data + pref->len, "\\u00", 4);
+			pref->data[pref->len + 4] = hex[c >> 4];
+			pref->data[pref->len + 5] = hex[c & 0xf];
+			pref->len += 6;
+		} else {
+			pref->data[pref->len++] = (char) c;
+		}
+	}
+	return TEXP_NO_ERR;
+}
+
+static enum TreeExportError prefix_append_step(struct Prefix *pref,
+											   const char *question, bool answer,
+											   enum ExportFormat format)
+{
+	assert(pref);
+	assert(question);
+
+	const char *head = NULL;
+	const char *tail = NULL;
+	if (format == EXPORT_TSV) {
+		head = answer ? "\t" : "\tНе ";
+		tail = "";
+	} else {
+		head = ",{\"question\":\"";
+		tail = answer ? "\",\"answer\":true}" : "\",\"answer\":false}";
+	}
+
+	enum TreeExportError err = prefix_reserve(pref, strlen(head) + strlen(tail));
+	if (err < 0)
+		return err;
+	memcpy(pref->data + pref->len, head, strlen(head));
+	pref->len += strlen(head);
+
+	err = prefix_append_text(pref, question, format);
+	if (err < 0)
+		return err;
+
+	err = prefix_reserve(pref, strlen(tail));
+	if (err < 0)
+		return err;
+	memcpy(pref->data + pref->len, tail, strlen(tail));
+	pref->len += strlen(tail);
+	return TEXP_NO_ERR;
+}
+
+static void write_text(FILE *out, const char *str, enum ExportFormat format)
+{
+	assert(out);
+	assert(str);
+
+	const char *run = str;
+	for (; *str; str++) {
+		unsigned char c = (unsigned char) *str;
+		bool is_special = (format == EXPORT_TSV) ?
+						  (c == '\t' || c == '\n' || c == '\r') :
+						  (c == '"' || c == '\\' || c < 0x20);
+		if (!is_special)
+			continue;
+
+		fwrite(run, sizeof(char), (size_t) (str - run), out);
+		run = str + 1;
+		if (format == EXPORT_TSV)
+			fputc(' ', out);
+		else if (c == '"' || c == '\\')
+			fprintf(out, "\\%c", c);
+		else
+			fprintf(out, "\\u%04x", c);
+	}
+	fwrite(run, sizeof(char), (size_t) (str - run), out);
+}
+
+static void write_leaf(FILE *out, const char *name, const struct Prefix *pref,
+					   enum ExportFormat format)
+{
+	assert(out);
+	assert(name);
+	assert(pref);
+
+	if (format == EXPORT_TSV) {
+		write_text(out, name, format);
+		fwrite(pref->data, sizeof(char), pref->len, out);
+		fputc('\n', out);
+		return;
+	}
+
+	fputs("{\"name\":\"", out);
+	write_text(out, name, format);
+	fputs("\",\"definition\":[", out);
+	// every step is stored with a leading comma
+	if (pref->len > 0)
+		fwrite(pref->data + 1, sizeof(char), pref->len - 1, out);
+	fputs("]}\n", out);
+}
+
+const char *tree_export_err_to_str(enum TreeExportError err)
+{
+	switch (err) {
+		case TEXP_FILE_ERR:
+			return "Error writing the export file";
+		case TEXP_NO_MEM_ERR:
+			return "Not enough memory for the export";
+		case TEXP_NO_ERR:
+			return "No error occured";
+		default:
+			return "An unknown error occured";
+	}
+}
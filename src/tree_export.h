@@ -0,0 +1,26 @@
+#ifndef _TREE_EXPORT_H
+#define _TREE_EXPORT_H
+
+#include "tree.h"
+
+enum ExportFormat {
+	EXPORT_JSONL = 0,
+	EXPORT_TSV	 = 1,
+};
+
+enum TreeExportError {
+	TEXP_FILE_ERR	= -2,
+	TEXP_NO_MEM_ERR	= -1,
+	TEXP_NO_ERR		= 0,
+};
+
+const size_t EXPORT_OUT_BUF_SIZE	= 1 << 20;
+const size_t EXPORT_INIT_DEPTH		= 64;
+const size_t EXPORT_INIT_PREFIX		= 4096;
+
+enum TreeExportError tree_export_definitions(const struct Node *tree,
+											 const char *filename,
+											 enum ExportFormat format);
+const char *tree_export_err_to_str(enum TreeExportError err);
+
+#endif /*_TREE_EXPORT_H*/
@@ -3,12 +3,25 @@
 #include <string.h>
 
 #include "tree_io.h"
+#include "small_stack.h"
+
+// a node still to be read into slot, or its closing bracket when slot is NULL
+struct LoadFrame {
+	struct Node **slot;
+};
+
+// a node still to be written, or its closing bracket
+struct SaveFrame {
+	const struct Node *node;
+	size_t level;
+	bool is_close;
+};
 
 static enum TreeIOError _tree_load(struct Node **tree, char **buf);
 static char *skip_space(char *str);
 static size_t get_word_len(const char *str);
 static enum TreeIOError cut_between_brackets(char **buf);
-static void _subtree_save(const struct Node *node, FILE *out, size_t level);
+static void put_indent(FILE *out, size_t level);
 
 enum TreeIOError tree_load_from_buf(struct Node **tree, struct Buffer *buf)
 {
@@ -56,75 +69,107 @@ static enum TreeIOError cut_between_brackets(char **buf)
 	return TRIO_NO_ERR;
 }
 
+// the tree is read with an explicit stack, so a degenerate one as deep as it
+// is long doesn't overflow the call stack
 static enum TreeIOError _tree_load(struct Node **tree, char **buf)
 {
 	assert(tree);
 	assert(buf);
 	assert(*buf);
 
-	*buf = skip_space(*buf);
-	size_t word_len = get_word_len(*buf);
+	enum TreeIOError err = TRIO_NO_ERR;
+	SmallStack<struct LoadFrame, TRIO_INIT_DEPTH> stack = {};
+	small_stack_ctor(&stack);
+	small_stack_push(&stack, {tree});
+
+	struct LoadFrame frame = {};
+	while (err == TRIO_NO_ERR && small_stack_pop(&stack, &frame) == STACK_NO_ERR) {
+		*buf = skip_space(*buf);
+		if (!frame.slot) {
+			if (*buf[0] != ')')
+				err = TRIO_SYNTAX_ERR;
+			else
+				(*buf)++;
+			continue;
+		}
+
+		size_t word_len = get_word_len(*buf);
+		if (strncmp(*buf, "nil", word_len) == 0 && word_len == strlen("nil")) {
+			*buf = skip_space(*buf + word_len);
+			*frame.slot = NULL;
+			continue;
+		}
+		if (strncmp(*buf, "(", word_len) != 0 || word_len != strlen("(")) {
+			err = TRIO_SYNTAX_ERR;
+			continue;
+		}
 
-	if (strncmp(*buf, "nil", word_len) == 0 && word_len == strlen("nil")) {
-		*buf = skip_space(*buf + word_len);
-		*tree = NULL;
-		return TRIO_NO_ERR;
-	}
-	if (strncmp(*buf, "(", word_len) == 0 && word_len == strlen("("))  {
 		*buf = skip_space(*buf + word_len);
-		enum TreeIOError trio_err = cut_between_brackets(buf);
-		if (trio_err < 0)
-			return trio_err;
-		enum TreeError tr_err = node_op_new(tree, *buf);
-		if (tr_err < 0)
-			return TRIO_TREE_ERR;
+		err = cut_between_brackets(buf);
+		if (err < 0)
+			continue;
+		if (node_op_new(frame.slot, *buf) < 0) {
+			err = TRIO_TREE_ERR;
+			continue;
+		}
 		*buf = *buf + strlen(*buf) + 1;
-		trio_err = _tree_load(&(*tree)->left, buf);
-		if (trio_err < 0)
-			return trio_err;
-		trio_err = _tree_load(&(*tree)->right, buf);
-		if (trio_err < 0)
-			return trio_err;
-		*buf = skip_space(*buf);
-		if (*buf[0] != ')')
-			return TRIO_SYNTAX_ERR;
-		(*buf)++;
-		return TRIO_NO_ERR;
+
+		struct Node *node = *frame.slot;
+		if (small_stack_push(&stack, {NULL}) < 0 ||
+			small_stack_push(&stack, {&node->right}) < 0 ||
+			small_stack_push(&stack, {&node->left}) < 0)
+			err = TRIO_NO_MEM_ERR;
 	}
-	return TRIO_SYNTAX_ERR;
+
+	small_stack_dtor(&stack);
+	return err;
 }
 
-void tree_save(const struct Node *tree, FILE *out)
+enum TreeIOError tree_save(const struct Node *tree, FILE *out)
 {
 	assert(out);
 
-	_subtree_save(tree, out, 0);
+	enum TreeIOError err = TRIO_NO_ERR;
+	SmallStack<struct SaveFrame, TRIO_INIT_DEPTH> stack = {};
+	small_stack_ctor(&stack);
+	small_stack_push(&stack, {tree, 0, false});
+
+	struct SaveFrame frame = {};
+	while (err == TRIO_NO_ERR && small_stack_pop(&stack, &frame) == STACK_NO_ERR) {
+		put_indent(out, frame.level);
+		if (frame.is_close) {
+			fputs(")\n", out);
+			continue;
+		}
+		if (!frame.node) {
+			fputs("nil\n", out);
+			continue;
+		}
+
+		fprintf(out, "(<%s>\n", frame.node->data);
+		if (small_stack_push(&stack, {frame.node, frame.level, true}) < 0 ||
+			small_stack_push(&stack, {frame.node->right, frame.level + 1, false}) < 0 ||
+			small_stack_push(&stack, {frame.node->left, frame.level + 1, false}) < 0)
+			err = TRIO_NO_MEM_ERR;
+	}
+
+	small_stack_dtor(&stack);
+	return err;
 }
 
-static void _subtree_save(const struct Node *node, FILE *out, size_t level)
+static void put_indent(FILE *out, size_t level)
 {
 	assert(out);
 
 	for (size_t i = 0; i < level; i++)
 		fputs("    ", out);
-	
-	if (!node) {
-		fputs("nil\n", out);
-		return;
-	}
-
-	fprintf(out, "(<%s>\n", node->data);
-	_subtree_save(node->left, out, level + 1);
-	_subtree_save(node->right, out, level + 1);
-
-	for (size_t i = 0; i < level; i++)
-		fputs("    ", out);
-	fputs(")\n", out);
 }
 
 const char *tree_io_err_to_str(enum TreeIOError err)
 {
 	switch (err) {
+		case TRIO_NO_MEM_ERR:
+			return "Not enough memory to walk the tree\n";
 		case TRIO_SYNTAX_ERR:
 			return "Syntax error in tree's string representation\n";
 		case TRIO_TREE_ERR:
@@ -5,13 +5,16 @@
 #include "tree.h"
 
 enum TreeIOError {
+	TRIO_NO_MEM_ERR	= -3,
 	TRIO_SYNTAX_ERR = -2,
 	TRIO_TREE_ERR	= -1,
 	TRIO_NO_ERR		= 0,
 };
 
+const size_t TRIO_INIT_DEPTH = 64;
+
 enum TreeIOError tree_load_from_buf(struct Node **tree, struct Buffer *buf);
-void tree_save(const struct Node *tree, FILE *out);
+enum TreeIOError tree_save(const struct Node *tree, FILE *out);
 const char *tree_io_err_to_str(enum TreeIOError err);
 
 #endif /*_TREE_IO_H*/
@@ -0,0 +1,436 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+
+#include "tree_svg.h"
+
+static const size_t SVG_NONE = SIZE_MAX;
+static const size_t SVG_FILENAME_SIZE = 512;
+static const size_t SVG_LABEL_SIZE = 1024;
+
+static const char SVG_STYLE[] =
+"<style>\n"
+"rect{stroke:#333;stroke-width:1.5}\n"
+".q{fill:#e8eefc}.o{fill:#e8f7e8}.c{fill:#fff;stroke-dasharray:5 4}\n"
+"line{stroke-width:1.5}.y{stroke:green}.n{stroke:red}\n"
+"text{font:13px sans-serif;text-anchor:middle;dominant-baseline:central}\n"
+"</style>\n";
+
+// the leftmost or rightmost node of a subtree's deepest level
+struct Extreme {
+	size_t node;
+	size_t depth;
+	// relative to the subtree's root
+	long x;
+};
+
+struct SvgNode {
+	size_t left;
+	size_t right;
+	// the next node of the left and right contours: a child, or a thread from
+	// the bottom of a shallower subtree into a deeper one
+	size_t cont_left;
+	size_t cont_right;
+	// the children are at x - off and x + off; a leaf with a thread keeps the
+	// distance to the thread's end here
+	long off;
+	// relative to the parent while laying out, the center on the page after
+	long x;
+	struct Extreme lmost;
+	struct Extreme rmost;
+};
+
+// an edge into node item, or node item - num_nodes itself, drawn on a tile
+struct SvgItem {
+	size_t tile;
+	size_t item;
+};
+
+struct SvgItems {
+	struct SvgItem *items;
+	size_t num_items;
+	size_t cap;
+};
+
+static void layout(struct SvgNode *svg, const struct DumpNode *nodes, size_t num_nodes);
+static void place_children(struct SvgNode *svg, const struct DumpNode *nodes, size_t v);
+static struct Extreme shift(struct Extreme extreme, long dx);
+static enum TreeSvgError write_tiles(const struct SvgNode *svg, const struct DumpNode *nodes,
+									 size_t num_nodes, print_func print_el, FILE *html,
+									 const char *tile_prefix, long width, long height);
+static bool add_items(struct SvgItems *items, size_t item, long x0, long y0, long x1, long y1,
+					  size_t num_cols);
+static int item_cmp(const void *a, const void *b);
+static void write_header(FILE *out, long x, long y, long width, long height);
+static void write_item(FILE *out, const struct SvgNode *svg, const struct DumpNode *nodes,
+					   size_t num_nodes, size_t item, print_func print_el);
+static void write_text(FILE *out, const char *text, size_t max_chars);
+static long node_top(const struct DumpNode *node);
+
+enum TreeSvgError tree_svg_write(const struct DumpNode *nodes, size_t num_nodes,
+								 print_func print_el, FILE *html, const char *tile_prefix)
+{
+	assert(nodes);
+	assert(num_nodes > 0);
+	assert(print_el);
+	assert(html);
+	assert(tile_prefix);
+
+	struct SvgNode *svg = (struct SvgNode*) calloc(num_nodes, sizeof(struct SvgNode));
+	if (!svg)
+		return SVG_NO_MEM_ERR;
+	layout(svg, nodes, num_nodes);
+
+	long min_x = 0;
+	long max_x = 0;
+	size_t max_depth = 0;
+	for (size_t i = 0; i < num_nodes; i++) {
+		min_x = svg[i].x < min_x ? svg[i].x : min_x;
+		max_x = svg[i].x > max_x ? svg[i].x : max_x;
+		max_depth = nodes[i].depth > max_depth ? nodes[i].depth : max_depth;
+	}
+	for (size_t i = 0; i < num_nodes; i++)
+		svg[i].x += SVG_MARGIN + SVG_NODE_WIDTH / 2 - min_x;
+	long width = max_x - min_x + SVG_NODE_WIDTH + 2 * SVG_MARGIN;
+	long height = (long) max_depth * SVG_LEVEL_HEIGHT + SVG_NODE_HEIGHT + 2 * SVG_MARGIN;
+
+	enum TreeSvgError err = SVG_NO_ERR;
+	if (width <= SVG_TILE_SIZE && height <= SVG_TILE_SIZE) {
+		write_header(html, 0, 0, width, height);
+		// edges first, so that the nodes cover their ends
+		for (size_t item = 0; item < 2 * num_nodes; item++)
+			write_item(html, svg, nodes, num_nodes, item, print_el);
+		fputs("</svg>\n", html);
+	} else {
+		err = write_tiles(svg, nodes, num_nodes, print_el, html, tile_prefix, width, height);
+	}
+
+	free(svg);
+	return err;
+}
+
+// nodes come breadth first, so going backwards places every subtree before
+// its parent, and going forwards places every parent before its children
+static void layout(struct SvgNode *svg, const struct DumpNode *nodes, size_t num_nodes)
+{
+	assert(svg);
+	assert(nodes);
+
+	for (size_t i = 0; i < num_nodes; i++) {
+		svg[i].left = svg[i].right = SVG_NONE;
+		svg[i].cont_left = svg[i].cont_right = SVG_NONE;
+	}
+	for (size_t i = 1; i < num_nodes; i++) {
+		struct SvgNode *parent = &svg[nodes[i].parent - 1];
+		if (nodes[i].is_left)
+			parent->left = parent->cont_left = i;
+		else
+			parent->right = parent->cont_right = i;
+	}
+
+	for (size_t v = num_nodes; v-- > 0; )
+		place_children(svg, nodes, v);
+
+	svg[0].x = 0;
+	for (size_t i = 1; i < num_nodes; i++) {
+		const struct SvgNode *parent = &svg[nodes[i].parent - 1];
+		svg[i].x = parent->x + (nodes[i].is_left ? -parent->off : parent->off);
+	}
+}
+
+// spreads the children of v just enough for their subtrees not to overlap at
+// any level, and threads the contour of the shallower subtree into the deeper one
+static void place_children(struct SvgNode *svg, const struct DumpNode *nodes, size_t v)
+{
+	assert(svg);
+	assert(nodes);
+
+	struct SvgNode *node = &svg[v];
+	size_t left = node->left;
+	size_t right = node->right;
+	if (left == SVG_NONE && right == SVG_NONE) {
+		node->lmost = node->rmost = {v, nodes[v].depth, 0};
+		node->off = 0;
+		return;
+	}
+
+	// walk the right contour of the left subtree and the left contour of the
+	// right one; lx and rx are relative to the roots of the subtrees
+	const long min_sep = SVG_NODE_WIDTH + SVG_NODE_GAP;
+	long root_sep = min_sep;
+	long lx = 0;
+	long rx = 0;
+	size_t l = left;
+	size_t r = right;
+	while (l != SVG_NONE && r != SVG_NONE) {
+		if (root_sep + rx - lx < min_sep)
+			root_sep = min_sep - rx + lx;
+
+		if (svg[l].cont_right != SVG_NONE) {
+			lx += svg[l].off;
+			l = svg[l].cont_right;
+		} else {
+			lx -= svg[l].off;
+			l = svg[l].cont_left;
+		}
+		if (svg[r].cont_left != SVG_NONE) {
+			rx -= svg[r].off;
+			r = svg[r].cont_left;
+		} else {
+			rx += svg[r].off;
+			r = svg[r].cont_right;
+		}
+	}
+
+	long half = (root_sep + 1) / 2;
+	node->off = half;
+	lx -= half;
+	rx += half;
+
+	if (left == SVG_NONE) {
+		node->lmost = shift(svg[right].lmost, half);
+		node->rmost = shift(svg[right].rmost, half);
+		return;
+	}
+	if (right == SVG_NONE) {
+		node->lmost = shift(svg[left].lmost, -half);
+		node->rmost = shift(svg[left].rmost, -half);
+		return;
+	}
+
+	struct Extreme ll = shift(svg[left].lmost, -half);
+	struct Extreme lr = shift(svg[left].rmost, -half);
+	struct Extreme rl = shift(svg[right].lmost, half);
+	struct Extreme rr = shift(svg[right].rmost, half);
+	node->lmost = rl.depth > ll.depth ? rl : ll;
+	node->rmost = lr.depth > rr.depth ? lr : rr;
+
+	// the walk stopped one level below the shallower subtree, at the node its
+	// outer contour goes on to; the bottom node of that contour is a leaf
+	if (l != SVG_NONE) {
+		svg[rr.node].off = labs(lx - rr.x);
+		if (lx >= rr.x)
+			svg[rr.node].cont_right = l;
+		else
+			svg[rr.node].cont_left = l;
+	} else if (r != SVG_NONE) {
+		svg[ll.node].off = labs(rx - ll.x);
+		if (rx >= ll.x)
+			svg[ll.node].cont_right = r;
+		else
+			svg[ll.node].cont_left = r;
+	}
+}
+
+static struct Extreme shift(struct Extreme extreme, long dx)
+{
+	extreme.x += dx;
+	return extreme;
+}
+
+// an item goes to every tile its box touches; the tiles are written one by one
+static enum TreeSvgError write_tiles(const struct SvgNode *svg, const struct DumpNode *nodes,
+									 size_t num_nodes, print_func print_el, FILE *html,
+									 const char *tile_prefix, long width, long height)
+{
+	assert(svg);
+	assert(nodes);
+	assert(print_el);
+	assert(html);
+	assert(tile_prefix);
+
+	size_t num_cols = (size_t) ((width + SVG_TILE_SIZE - 1) / SVG_TILE_SIZE);
+	struct SvgItems items = {};
+	items.items = (struct SvgItem*) calloc(SVG_INIT_ITEMS, sizeof(struct SvgItem));
+	if (!items.items)
+		return SVG_NO_MEM_ERR;
+	items.cap = SVG_INIT_ITEMS;
+
+	enum TreeSvgError err = SVG_NO_ERR;
+	for (size_t i = 0; i < num_nodes; i++) {
+		long x = svg[i].x;
+		long top = node_top(&nodes[i]);
+		bool is_added = add_items(&items, num_nodes + i, x - SVG_NODE_WIDTH / 2, top,
+								  x + SVG_NODE_WIDTH / 2, top + SVG_NODE_HEIGHT, num_cols);
+		if (is_added && i > 0) {
+			long parent_x = svg[nodes[i].parent - 1].x;
+			is_added = add_items(&items, i, parent_x < x ? parent_x : x,
+								 top - SVG_LEVEL_HEIGHT + SVG_NODE_HEIGHT,
+								 parent_x < x ? x : parent_x, top, num_cols);
+		}
+		if (!is_added) {
+			err = SVG_NO_MEM_ERR;
+			goto finally;
+		}
+	}
+	qsort(items.items, items.num_items, sizeof(struct SvgItem), item_cmp);
+
+	fprintf(html, "<div style=\"overflow:auto;max-width:100%%;max-height:90vh\">\n"
+			"<div style=\"position:relative;width:%ldpx;height:%ldpx\">\n", width, height);
+	for (size_t start = 0; start < items.num_items; ) {
+		size_t tile = items.items[start].tile;
+		long tile_x = (long) (tile % num_cols) * SVG_TILE_SIZE;
+		long tile_y = (long) (tile / num_cols) * SVG_TILE_SIZE;
+		long tile_width = width - tile_x < SVG_TILE_SIZE ? width - tile_x : SVG_TILE_SIZE;
+		long tile_height = height - tile_y < SVG_TILE_SIZE ? height - tile_y : SVG_TILE_SIZE;
+
+		char tile_name[SVG_FILENAME_SIZE] = {};
+		snprintf(tile_name, SVG_FILENAME_SIZE, "%s-%zu-%zu.svg", tile_prefix, tile % num_cols,
+				 tile / num_cols);
+		FILE *tile_file = fopen(tile_name, "w");
+		if (!tile_file) {
+			err = SVG_FILE_ERR;
+			break;
+		}
+		write_header(tile_file, tile_x, tile_y, tile_width, tile_height);
+		for (; start < items.num_items && items.items[start].tile == tile; start++)
+			write_item(tile_file, svg, nodes, num_nodes, items.items[start].item, print_el);
+		fputs("</svg>\n", tile_file);
+		fclose(tile_file);
+
+		fprintf(html, "<img loading=\"lazy\" src=\"%s\" style=\"position:absolute;"
+				"left:%ldpx;top:%ldpx;width:%ldpx;height:%ldpx\">\n",
+				tile_name, tile_x, tile_y, tile_width, tile_height);
+	}
+	fputs("</div>\n</div>\n", html);
+
+finally:
+	free(items.items);
+	return err;
+}
+
+static bool add_items(struct SvgItems *items, size_t item, long x0, long y0, long x1, long y1,
+					  size_t num_cols)
+{
+	assert(items);
+
+	for (long row = y0 / SVG_TILE_SIZE; row <= y1 / SVG_TILE_SIZE; row++) {
+		for (long col = x0 / SVG_TILE_SIZE; col <= x1 / SVG_TILE_SIZE; col++) {
+			if (items->num_items == items->cap) {
+				struct SvgItem *tmp = (struct SvgItem*) realloc(items->items, 2 * items->cap *
+																sizeof(struct SvgItem));
+				if (!tmp)
+					return false;
+				items->items = tmp;
+				items->cap *= 2;
+			}
+			items->items[items->num_items++] = {(size_t) row * num_cols + (size_t) col, item};
+		}
+	}
+	return true;
+}
+
+// by tile, and edges before nodes within one
+static int item_cmp(const void *a, const void *b)
+{
+	const struct SvgItem *item_a = (const struct SvgItem*) a;
+	const struct SvgItem *item_b = (const struct SvgItem*) b;
+	if (item_a->tile != item_b->tile)
+		return (item_a->tile > item_b->tile) - (item_a->tile < item_b->tile);
+	return (item_a->item > item_b->item) - (item_a->item < item_b->item);
+}
+
+static void write_header(FILE *out, long x, long y, long width, long height)
+{
+	assert(out);
+
+	fprintf(out, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%ld\" height=\"%ld\" "
+			"viewBox=\"%ld %ld %ld %ld\">\n", width, height, x, y, width, height);
+	fputs(SVG_STYLE, out);
+}
+
+static void write_item(FILE *out, const struct SvgNode *svg, const struct DumpNode *nodes,
+					   size_t num_nodes, size_t item, print_func print_el)
+{
+	assert(out);
+	assert(svg);
+	assert(nodes);
+	assert(print_el);
+
+	if (item < num_nodes) {
+		if (item == 0)
+			return;
+		const struct DumpNode *node = &nodes[item];
+		long top = node_top(node);
+		fprintf(out, "<line x1=\"%ld\" y1=\"%ld\" x2=\"%ld\" y2=\"%ld\" class=\"%s\"/>\n",
+				svg[node->parent - 1].x, top - SVG_LEVEL_HEIGHT + SVG_NODE_HEIGHT,
+				svg[item].x, top, node->is_left ? "y" : "n");
+		return;
+	}
+
+	size_t i = item - num_nodes;
+	const struct DumpNode *node = &nodes[i];
+	long top = node_top(node);
+	bool is_leaf = !node->node->left && !node->node->right;
+	const char *kind = node->is_collapsed ? "c" : is_leaf ? "o" : "q";
+
+	static char buf[SVG_LABEL_SIZE] = {};
+	buf[0] = '\0';
+	if (node->is_collapsed)
+		snprintf(buf, SVG_LABEL_SIZE, "%zu leaves", node->num_leaves);
+	else
+		print_el(buf, node->node->data, SVG_LABEL_SIZE - 1);
+
+	fputs("<g><title>", out);
+	write_text(out, buf, SIZE_MAX);
+	fprintf(out, "</title><rect x=\"%ld\" y=\"%ld\" width=\"%ld\" height=\"%ld\" rx=\"6\" "
+			"class=\"%s\"/><text x=\"%ld\" y=\"%ld\">", svg[i].x - SVG_NODE_WIDTH / 2, top,
+			SVG_NODE_WIDTH, SVG_NODE_HEIGHT, kind, svg[i].x, top + SVG_NODE_HEIGHT / 2);
+	write_text(out, buf, SVG_MAX_LABEL);
+	fputs("</text></g>\n", out);
+}
+
+// escapes XML and cuts the text after max_chars UTF-8 characters
+static void write_text(FILE *out, const char *text, size_t max_chars)
+{
+	assert(out);
+	assert(text);
+
+	size_t num_chars = 0;
+	for (const char *c = text; *c; c++) {
+		// continuation bytes don't start a character
+		if (((unsigned char) *c & 0xC0) != 0x80 && num_chars++ == max_chars) {
+			fputs("…", out);
+			return;
+		}
+		switch (*c) {
+			case '&':
+				fputs("&amp;", out);
+				break;
+			case '<':
+				fputs("&lt;", out);
+				break;
+			case '>':
+				fputs("&gt;", out);
+				break;
+			case '"':
+				fputs("&quot;", out);
+				break;
+			default:
+				fputc(*c, out);
+				break;
+		}
+	}
+}
+
+static long node_top(const struct DumpNode *node)
+{
+	assert(node);
+
+	return SVG_MARGIN + (long) node->depth * SVG_LEVEL_HEIGHT;
+}
+
+const char *tree_svg_err_to_str(enum TreeSvgError err)
+{
+	switch (err) {
+		case SVG_FILE_ERR:
+			return "Couldn't write an SVG tile";
+		case SVG_NO_MEM_ERR:
+			return "Not enough memory for the SVG layout";
+		case SVG_NO_ERR:
+			return "No error occured";
+		default:
+			return "An unknown error occured";
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef _TREE_SVG_H
+#define _TREE_SVG_H
+
+#include <stdio.h>
+
+#include "tree_debug.h"
+
+/*
+ * Draws the nodes dump_select() chose as SVG without Graphviz. The layout is
+ * Reingold-Tilford's tidy tree: subtrees are placed bottom up as close as their
+ * contours allow, and threads from the bottom of a shallower subtree into the
+ * deeper one keep every contour walk short, so the layout is O(N). A drawing
+ * that fits into one tile goes into the page itself. A bigger one is cut into
+ * SVG_TILE_SIZE tiles, files "<prefix>-<column>-<row>.svg" which the page
+ * places in a grid and the browser loads lazily, only the ones scrolled to.
+ */
+enum TreeSvgError {
+	SVG_FILE_ERR	= -2,
+	SVG_NO_MEM_ERR	= -1,
+	SVG_NO_ERR		= 0,
+};
+
+const long SVG_NODE_WIDTH	= 160;
+const long SVG_NODE_HEIGHT	= 40;
+const long SVG_NODE_GAP		= 20;
+const long SVG_LEVEL_HEIGHT	= 90;
+const long SVG_MARGIN		= 20;
+const long SVG_TILE_SIZE	= 4096;
+// longer labels are cut, the whole one is the node's tooltip
+const size_t SVG_MAX_LABEL	= 18;
+const size_t SVG_INIT_ITEMS	= 256;
+
+enum TreeSvgError tree_svg_write(const struct DumpNode *nodes, size_t num_nodes,
+								 print_func print_el, FILE *html, const char *tile_prefix);
+const char *tree_svg_err_to_str(enum TreeSvgError err);
+
+#endif /*_TREE_SVG_H*/
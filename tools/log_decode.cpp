@@ -0,0 +1,42 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "logger.h"
+#include "log_format.h"
+
+/*
+ * Turns a log written with --binary-log back into the text a plain log file
+ * would have got. Reads the file given as the first argument, or stdin, and
+ * writes to the second argument, or stdout.
+ */
+int main(int argc, const char *argv[])
+{
+	if (argc > 3 || (argc > 1 && strcmp(argv[1], "--help") == 0)) {
+		fprintf(stderr, "Usage: %s [binary log] [text log]\n", argv[0]);
+		return 1;
+	}
+
+	FILE *in = argc > 1 ? fopen(argv[1], "rb") : stdin;
+	if (!in) {
+		fprintf(stderr, "Couldn't read file %s\n", argv[1]);
+		return 1;
+	}
+	FILE *out = argc > 2 ? fopen(argv[2], "w") : stdout;
+	if (!out) {
+		fprintf(stderr, "Couldn't write file %s\n", argv[2]);
+		fclose(in);
+		return 1;
+	}
+
+	enum Log_error err = log_binary_decode(in, out);
+	if (err == ERR_FORMAT)
+		fprintf(stderr, "The log is not a binary log or is damaged\n");
+	else if (err == LOG_ERR_MEM)
+		fprintf(stderr, "Not enough memory to decode the log\n");
+
+	if (in != stdin)
+		fclose(in);
+	if (out != stdout)
+		fclose(out);
+	return err == NO_LOG_ERR ? 0 : 1;
+}